@@ -0,0 +1,162 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+
+// ベンチマークの最小限の実行環境（Google Benchmarkを入れずに済ませるため）
+//
+// - 1回の計測で min_time を超えるまで反復回数を倍々に増やし、1反復あたりの時間を求める
+// - 計測を repetitions 回繰り返し、中央値・最小値・最大値を記録する
+// - 結果はJSONに書き出し、リリース間で比較できるようにする
+class BenchHarness {
+public:
+    // 反復回数を受け取り、その回数だけ処理を実行する関数
+    using Body = std::function<void(uint64_t iterations)>;
+
+    struct Result {
+        std::string name;
+        uint64_t iterations = 0;   // 1回の計測の反復回数
+        double median_ns = 0.0;    // 1反復あたり
+        double min_ns = 0.0;
+        double max_ns = 0.0;
+        double items_per_iteration = 0.0; // 0でなければスループットも出す（例：1反復のバイト数）
+        std::string items_label;
+        std::vector<std::pair<std::string, double>> counters; // 時間以外の計測値（メモリ確保の回数など）
+    };
+
+    BenchHarness(std::chrono::milliseconds min_time, int repetitions, std::string filter)
+        : min_time_(min_time), repetitions_(std::max(1, repetitions)), filter_(std::move(filter)) {}
+
+    bool selected(const std::string& name) const {
+        return filter_.empty() || name.find(filter_) != std::string::npos;
+    }
+
+    // ベンチマークを実行して結果を記録する（filterに一致しなければ何もしない）
+    void run(const std::string& name, const Body& body, double items_per_iteration = 0.0, const std::string& items_label = "") {
+        last_run_ = name;
+        if (!selected(name)) {
+            return;
+        }
+        body(1); // ウォームアップ（初回のメモリ確保やキャッシュの影響を除く）
+
+        uint64_t iterations = 1;
+        while (true) {
+            double elapsed = measure(body, iterations);
+            if (elapsed >= min_time_.count() * 1e6 || iterations >= (1ull << 30)) {
+                break;
+            }
+            // 目標時間に届く回数を見積もる（増やしすぎないよう10倍まで）
+            double scale = elapsed > 0.0 ? (min_time_.count() * 1e6 * 1.2) / elapsed : 10.0;
+            iterations = std::max<uint64_t>(iterations + 1, static_cast<uint64_t>(iterations * std::min(scale, 10.0)));
+        }
+
+        std::vector<double> per_iteration;
+        for (int r = 0; r < repetitions_; r++) {
+            per_iteration.push_back(measure(body, iterations) / iterations);
+        }
+        std::sort(per_iteration.begin(), per_iteration.end());
+
+        Result result;
+        result.name = name;
+        result.iterations = iterations;
+        result.median_ns = per_iteration[per_iteration.size() / 2];
+        result.min_ns = per_iteration.front();
+        result.max_ns = per_iteration.back();
+        result.items_per_iteration = items_per_iteration;
+        result.items_label = items_label;
+        print(result);
+        results_.push_back(result);
+    }
+
+    // 直前に実行したベンチマークに計測値を追加する
+    void add_counter(const std::string& key, double value) {
+        if (results_.empty() || results_.back().name != last_run_) {
+            return;
+        }
+        results_.back().counters.emplace_back(key, value);
+        std::printf("%-40s %10.3f %s\n", "", value, key.c_str());
+    }
+
+    // 直前に実行したベンチマークの結果（絞り込みで実行しなかった場合はnullptr）
+    const Result* last_result() const {
+        if (results_.empty() || results_.back().name != last_run_) {
+            return nullptr;
+        }
+        return &results_.back();
+    }
+
+    // 実行しなかったベンチマーク（カスケードやエンコーダーがない環境など）
+    void skip(const std::string& name, const std::string& reason) {
+        if (!selected(name)) {
+            return;
+        }
+        std::printf("%-40s skipped (%s)\n", name.c_str(), reason.c_str());
+        skipped_.push_back({{"name", name}, {"reason", reason}});
+    }
+
+    nlohmann::json to_json(const nlohmann::json& context) const {
+        nlohmann::json out;
+        out["context"] = context;
+        out["benchmarks"] = nlohmann::json::array();
+        for (const Result& r : results_) {
+            nlohmann::json j = {{"name", r.name},
+                                {"iterations", r.iterations},
+                                {"median_ns", r.median_ns},
+                                {"min_ns", r.min_ns},
+                                {"max_ns", r.max_ns},
+                                {"repetitions", repetitions_}};
+            if (r.items_per_iteration > 0.0) {
+                j[r.items_label + "_per_second"] = r.items_per_iteration / (r.median_ns / 1e9);
+            }
+            for (const auto& counter : r.counters) {
+                j[counter.first] = counter.second;
+            }
+            out["benchmarks"].push_back(j);
+        }
+        out["skipped"] = skipped_;
+        return out;
+    }
+
+private:
+    // iterations回の実行にかかった時間（ナノ秒）
+    static double measure(const Body& body, uint64_t iterations) {
+        auto begin = std::chrono::steady_clock::now();
+        body(iterations);
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count();
+    }
+
+    static void print(const Result& r) {
+        const char* unit = "ns";
+        double value = r.median_ns;
+        if (value >= 1e6) {
+            value /= 1e6;
+            unit = "ms";
+        } else if (value >= 1e3) {
+            value /= 1e3;
+            unit = "us";
+        }
+        std::printf("%-40s %10.2f %s/iter  (min %.0f ns, max %.0f ns, %llu iters)\n", r.name.c_str(), value, unit,
+                    r.min_ns, r.max_ns, static_cast<unsigned long long>(r.iterations));
+    }
+
+    std::chrono::milliseconds min_time_;
+    int repetitions_;
+    std::string filter_;
+    std::vector<Result> results_;
+    std::string last_run_; // 直前にrun()を呼んだベンチマーク（filterで除外されていればadd_counterは何もしない）
+    nlohmann::json skipped_ = nlohmann::json::array();
+};
+
+// 最適化で処理が消されないようにする
+template <typename T>
+inline void bench_keep(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
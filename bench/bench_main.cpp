@@ -0,0 +1,1149 @@
+// パイプラインの主な処理のベンチマーク
+//
+//   ./bench [--out bench.json] [--filter <名前の一部>] [--min-time <ミリ秒>] [--repetitions <回数>]
+//           [--cascade <カスケードのXML>] [--image <入力画像>]
+//
+// 結果は画面とJSONに出力する（リリースごとのJSONを比較して性能の劣化を見つける）
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <stdlib.h> // mkdtemp
+#include <time.h>   // clock_gettime
+
+#include <openssl/evp.h>
+
+#include "httplib.h"
+#include <opencv2/opencv.hpp>
+#include "nlohmann/json.hpp"
+
+#include "bench_harness.h"
+#include "config_store.h"
+#include "detection_track.h"
+#include "event_index.h"
+#include "frame_hub.h"
+#include "frame_pool.h"
+#include "http_request_timer.h"
+#include "line_client.h"
+#include "line_message.h"
+#include "line_signature.h"
+#include "logger.h"
+#include "metrics.h"
+#include "picam_context.h"
+#include "retention_manager.h"
+#include "trace_buffer.h"
+#include "web_server.h"
+#include "webhook_parser.h"
+
+namespace {
+
+// このスレッドでoperator newを呼んだ回数（カメラスレッドの定常状態のメモリ確保を数える）
+thread_local uint64_t thread_allocations = 0;
+
+} // namespace
+
+void* operator new(std::size_t size) {
+    thread_allocations++;
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+namespace {
+
+struct BenchOptions {
+    std::string out_path = "bench.json";
+    std::string filter;
+    int min_time_ms = 500;
+    int repetitions = 5;
+    std::string cascade_path = "/usr/share/opencv4/haarcascades/haarcascade_frontalface_default.xml";
+    std::string image_path; // 空なら合成画像
+};
+
+bool parse_options(int argc, char* argv[], BenchOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::fprintf(stderr, "値がありません: %s\n", arg.c_str());
+            return false;
+        }
+        std::string value = argv[++i];
+        if (arg == "--out") {
+            options.out_path = value;
+        } else if (arg == "--filter") {
+            options.filter = value;
+        } else if (arg == "--min-time") {
+            options.min_time_ms = std::stoi(value);
+        } else if (arg == "--repetitions") {
+            options.repetitions = std::stoi(value);
+        } else if (arg == "--cascade") {
+            options.cascade_path = value;
+        } else if (arg == "--image") {
+            options.image_path = value;
+        } else {
+            std::fprintf(stderr, "不明な引数です: %s\n", arg.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+// カメラの解像度（CAMERA_WIDTH x CAMERA_HEIGHTのデフォルト）の入力フレーム
+// 画像の指定がなければ、ノイズと図形で作る（単色だとJPEGやH.264の負荷が実際より軽くなる）
+cv::Mat make_frame(const BenchOptions& options, int width, int height) {
+    cv::Mat frame;
+    if (!options.image_path.empty()) {
+        cv::Mat image = cv::imread(options.image_path, cv::IMREAD_COLOR);
+        if (!image.empty()) {
+            cv::resize(image, frame, cv::Size(width, height));
+            return frame;
+        }
+        std::fprintf(stderr, "画像を読み込めないため合成画像を使います: %s\n", options.image_path.c_str());
+    }
+    frame = cv::Mat(height, width, CV_8UC3);
+    cv::randu(frame, cv::Scalar(0, 0, 0), cv::Scalar(64, 64, 64));
+    for (int i = 0; i < 12; i++) {
+        cv::Rect box(width * i / 12, height * (i % 4) / 4, width / 8, height / 5);
+        cv::rectangle(frame, box, cv::Scalar(40 + 15 * i, 200 - 10 * i, 90 + 7 * i), -1);
+    }
+    return frame;
+}
+
+// ---- 前処理（カメラスレッドの縮小とグレースケール変換）----
+void bench_preprocess(BenchHarness& harness, const cv::Mat& frame) {
+    cv::Mat small_frame;
+    cv::Mat gray_frame;
+    harness.run("preprocess/resize_gray_0.5", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            cv::resize(frame, small_frame, cv::Size(), 0.5, 0.5);
+            cv::cvtColor(small_frame, gray_frame, cv::COLOR_BGR2GRAY);
+        }
+        bench_keep(gray_frame.data);
+    });
+}
+
+// ---- フレームの受け渡し（cap.readの代わりに入力画像をコピーする）----
+// 以前：読み込んだフレームをライブ映像の変換スレッドに渡すたびにコピーしていた
+// 現在：プールのバッファに読み込み、変換スレッドにはRefを渡すだけ
+// あわせて、カメラスレッドが定常状態でメモリを確保していないことを確かめる
+//   - std::vectorなどのoperator newはスレッドごとに数える
+//   - cv::MatのバッファはOpenCVのアロケーターで確保されるので、プールの統計（追加・作り直し）で確かめる
+//   （detectMultiScaleとエンコーダーの内部の確保はOpenCVの実装によるため、ここでは数えない）
+void bench_frame_pool(BenchHarness& harness, const cv::Mat& frame) {
+    cv::Mat captured;
+    cv::Mat live_input;
+    harness.run("frame/capture_publish_copy", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            frame.copyTo(captured);
+            captured.copyTo(live_input);
+        }
+        bench_keep(live_input.data);
+    });
+
+    FramePool pool(4);
+    pool.reserve(frame.size(), frame.type());
+    FrameHub::Params live_params;
+    live_params.max_fps = 1000; // 毎フレーム渡す（変換が追いつかなければ古いフレームはプールに戻る）
+    FrameHub hub(live_params);
+    hub.start();
+    auto viewer = hub.add_viewer();
+
+    // カメラスレッドの1フレーム（顔検出の前処理も含める）
+    cv::Mat small_frame;
+    cv::Mat gray_frame;
+    const std::vector<cv::Rect> faces = {cv::Rect(100, 100, 80, 80)};
+    auto process_frame = [&] {
+        FramePool::Ref ref = pool.acquire();
+        frame.copyTo(ref.mat());
+        cv::resize(ref.mat(), small_frame, cv::Size(), 0.5, 0.5);
+        cv::cvtColor(small_frame, gray_frame, cv::COLOR_BGR2GRAY);
+        auto now = std::chrono::steady_clock::now();
+        if (hub.wanted(now)) {
+            hub.publish(ref, faces, now);
+        }
+    };
+    harness.run("frame/capture_publish_pooled", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            process_frame();
+        }
+    });
+
+    // 定常状態（計測後）のフレームごとのメモリ確保
+    const int frames = 1000;
+    FramePoolStats before = pool.stats();
+    uint64_t allocations_before = thread_allocations;
+    for (int i = 0; i < frames; i++) {
+        process_frame();
+    }
+    double allocations_per_frame = static_cast<double>(thread_allocations - allocations_before) / frames;
+    FramePoolStats after = pool.stats();
+    harness.add_counter("allocations_per_frame", allocations_per_frame);
+    harness.add_counter("pool_grown", static_cast<double>(after.grown - before.grown));
+    harness.add_counter("pool_reallocated", static_cast<double>(after.reallocated - before.reallocated));
+    if (harness.selected("frame/capture_publish_pooled") &&
+        (allocations_per_frame > 0.0 || after.grown != before.grown || after.reallocated != before.reallocated)) {
+        std::printf("警告: 定常状態のカメラスレッドでメモリを確保しています\n");
+    }
+
+    viewer.reset();
+    hub.stop();
+}
+
+// ---- 顔検出（スケール係数ごと。他のパラメータはデフォルト設定と同じ）----
+void bench_detect(BenchHarness& harness, const BenchOptions& options, const cv::Mat& frame) {
+    const double scale_factors[] = {1.05, 1.1, 1.2, 1.3};
+    cv::CascadeClassifier detector;
+    if (!detector.load(options.cascade_path)) {
+        for (double scale : scale_factors) {
+            harness.skip("detect/scale_factor_" + std::to_string(scale).substr(0, 4), "カスケードを読み込めません: " + options.cascade_path);
+        }
+        return;
+    }
+    cv::Mat small_frame;
+    cv::Mat gray_frame;
+    cv::resize(frame, small_frame, cv::Size(), 0.5, 0.5);
+    cv::cvtColor(small_frame, gray_frame, cv::COLOR_BGR2GRAY);
+
+    std::vector<cv::Rect> faces;
+    std::vector<int> neighbors;
+    for (double scale : scale_factors) {
+        harness.run("detect/scale_factor_" + std::to_string(scale).substr(0, 4), [&](uint64_t n) {
+            for (uint64_t i = 0; i < n; i++) {
+                detector.detectMultiScale(gray_frame, faces, neighbors, scale, 7, 0, cv::Size(30, 30));
+            }
+            bench_keep(faces.size());
+        });
+    }
+}
+
+// ---- JPEG変換（ライブ映像の640幅・品質70と、写真の保存の品質95）----
+void bench_jpeg(BenchHarness& harness, const cv::Mat& frame) {
+    cv::Mat live_frame;
+    cv::resize(frame, live_frame, cv::Size(640, frame.rows * 640 / std::max(1, frame.cols)), 0, 0, cv::INTER_AREA);
+    std::vector<unsigned char> jpeg;
+
+    const std::vector<int> live_params = {cv::IMWRITE_JPEG_QUALITY, 70};
+    harness.run("jpeg/encode_live_640_q70", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            cv::imencode(".jpg", live_frame, jpeg, live_params);
+        }
+        bench_keep(jpeg.size());
+    });
+
+    const std::vector<int> photo_params = {cv::IMWRITE_JPEG_QUALITY, 95};
+    harness.run("jpeg/encode_photo_q95", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            cv::imencode(".jpg", frame, jpeg, photo_params);
+        }
+        bench_keep(jpeg.size());
+    });
+}
+
+// ---- H.264への録画（録画と同じVideoWriterの設定で、1フレームの書き込み）----
+void bench_h264(BenchHarness& harness, const cv::Mat& frame) {
+    const std::string path = "/tmp/picam_bench.mp4";
+    cv::VideoWriter writer;
+    writer.open(path, cv::VideoWriter::fourcc('H', '2', '6', '4'), 15.0, frame.size());
+    if (!writer.isOpened()) {
+        harness.skip("h264/write_frame", "H.264のVideoWriterを開けません");
+        return;
+    }
+    // 毎フレーム同じ画像だと差分が小さくなるので、少しずつずらしたフレームを使う
+    std::vector<cv::Mat> frames;
+    for (int i = 0; i < 8; i++) {
+        cv::Mat shifted = frame.clone();
+        cv::rectangle(shifted, cv::Rect(40 * i, 30 * i, 120, 120), cv::Scalar(255, 255, 255), -1);
+        frames.push_back(shifted);
+    }
+    uint64_t index = 0;
+    harness.run("h264/write_frame", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            writer.write(frames[index++ % frames.size()]);
+        }
+    });
+    writer.release();
+    std::remove(path.c_str());
+}
+
+// ---- 顔の枠（録画1フレームあたり）----
+// 以前：録画するフレームに毎フレーム枠を描き込んでいた
+// 現在：枠が変わったときだけ検出結果のトラック（.vtt）にキューを書く
+// トラックは毎回枠を変えて必ずキューを書く最悪の場合で計測し、差を saved_ns_per_frame に記録する
+void bench_overlay(BenchHarness& harness, const cv::Mat& frame) {
+    const std::vector<cv::Rect> faces = {cv::Rect(100, 100, 96, 96), cv::Rect(400, 150, 120, 120)};
+    cv::Mat canvas = frame.clone();
+    harness.run("overlay/burn_in", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            for (const cv::Rect& face : faces) {
+                cv::rectangle(canvas, face, cv::Scalar(0, 0, 255), 2);
+            }
+        }
+        bench_keep(canvas.data);
+    });
+    const BenchHarness::Result* burn_in = harness.last_result();
+    bool burn_in_ran = burn_in != nullptr;
+    double burn_in_ns = burn_in_ran ? burn_in->median_ns : 0.0;
+
+    const std::string path = "/tmp/picam_bench.vtt";
+    DetectionTrack track;
+    std::vector<cv::Rect> moving = faces;
+    const std::vector<int> neighbors = {7, 5};
+    uint64_t frame_index = 0;
+    harness.run("overlay/track_cue", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            if (frame_index % 65536 == 0) {
+                track.open(path); // ファイルが大きくなりすぎないよう、ときどき作り直す
+            }
+            moving[0].x = 100 + static_cast<int>(frame_index % 64);
+            track.add(frame_index / 15.0, moving, neighbors);
+            frame_index++;
+        }
+    });
+    const BenchHarness::Result* cue = harness.last_result();
+    if (cue && burn_in_ran) {
+        harness.add_counter("saved_ns_per_frame", burn_in_ns - cue->median_ns);
+    }
+    track.close(frame_index / 15.0);
+    std::remove(path.c_str());
+}
+
+// ---- JSON（LINEへのpushの組み立てと、Webhookの解析）----
+void bench_json(BenchHarness& harness) {
+    LineMessageBuilder builder;
+    const std::string user_id = "U0123456789abcdef0123456789abcdef";
+    const std::string url = "https://example.ngrok-free.app/image?file=2026_01_01--12_00_00.jpg";
+    harness.run("json/line_push_build", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            builder.begin_push(user_id);
+            builder.add_text("動画を撮影しました。https://example.ngrok-free.app/video?file=2026_01_01--12_00_00.mp4");
+            builder.add_image(url, url);
+            bench_keep(builder.finish().size());
+        }
+    });
+
+    const std::string body =
+        R"({"destination":"Uxxxxxxxx","events":[{"type":"message","message":{"type":"text","id":"468789577898262530",)"
+        R"("quoteToken":"q3Plxr4AgKd...","text":"！"},"webhookEventId":"01H810YECXQQZ37VAXPF6H9E6T",)"
+        R"("deliveryContext":{"isRedelivery":false},"timestamp":1692251666727,"source":{"type":"user",)"
+        R"("userId":"U0123456789abcdef0123456789abcdef"},"replyToken":"38ef843bde154d9b91c21320ffd17a0f","mode":"active"}]})";
+    // 大きなボディ（イベント50件、LINEのテキストの上限に近い長さの本文）
+    std::string oversized = R"({"destination":"Uxxxxxxxx","events":[)";
+    const std::string long_text(4500, 'a');
+    for (int i = 0; i < 50; i++) {
+        oversized += (i > 0 ? "," : "");
+        oversized += R"({"type":"message","message":{"type":"text","id":")" + std::to_string(i) +
+                     R"(","text":")" + long_text + R"("},"source":{"type":"user","userId":"U0123456789abcdef0123456789abcdef"},)"
+                     R"("replyToken":"38ef843bde154d9b91c21320ffd17a0f","mode":"active"})";
+    }
+    oversized += "]}";
+
+    // 解析の時間と、定常状態（イベントのvectorと文字列の容量が足りている状態）での1回あたりのメモリ確保の回数
+    std::vector<WebhookEvent> events;
+    auto run_parse = [&](const char* name, const std::string& payload, bool sax) {
+        auto parse = [&] {
+            if (sax) {
+                events.clear();
+                parse_webhook_events(payload, events);
+                bench_keep(events.size());
+            } else {
+                auto j = nlohmann::json::parse(payload);
+                bench_keep(j.size());
+            }
+        };
+        harness.run(name, [&](uint64_t n) {
+            for (uint64_t i = 0; i < n; i++) {
+                parse();
+            }
+        }, static_cast<double>(payload.size()), "bytes");
+        parse();
+        uint64_t allocations_before = thread_allocations;
+        for (int i = 0; i < 100; i++) {
+            parse();
+        }
+        harness.add_counter("allocations_per_parse", static_cast<double>(thread_allocations - allocations_before) / 100);
+    };
+    run_parse("json/webhook_parse_sax", body, true);
+    run_parse("json/webhook_parse_dom", body, false);
+    run_parse("json/webhook_parse_sax_oversized", oversized, true);
+    run_parse("json/webhook_parse_dom_oversized", oversized, false);
+}
+
+// ---- HTTPのリクエストごとの計測（WebServerのpre-routing・post-routing・ロガーと同じ処理）----
+// 計測だけの時間と、ループバックの小さなGETで計測あり・なしの差（overhead_ns）を出す
+void bench_http_instrumentation(BenchHarness& harness) {
+    MetricsRegistry registry;
+    Histogram& histogram = registry.histogram("bench_http_request_duration_seconds", "", "route=\"/events\"");
+    Counter& responses = registry.counter("bench_http_responses_total", "", "code=\"2xx\"");
+    httplib::Request request;
+    request.path = "/events";
+    auto instrument = [&](const httplib::Request& req) {
+        HttpRequestTimer::begin(req);
+        HttpRequestTimer::respond(req);
+        responses.add();
+        HttpRequestTimer::Clock::time_point begin;
+        if (HttpRequestTimer::take(req, begin)) {
+            auto end = HttpRequestTimer::Clock::now();
+            histogram.observe(end - begin);
+            trace_buffer().record("/events", begin, end);
+        }
+    };
+    auto run_instrumented = [&](const char* name) {
+        harness.run(name, [&](uint64_t n) {
+            for (uint64_t i = 0; i < n; i++) {
+                instrument(request);
+            }
+        });
+        uint64_t allocations_before = thread_allocations;
+        for (int i = 0; i < 1000; i++) {
+            instrument(request);
+        }
+        harness.add_counter("allocations_per_request", static_cast<double>(thread_allocations - allocations_before) / 1000);
+    };
+    // トレースは一度有効にすると戻せないので、無効の計測を先に行う
+    run_instrumented("http/instrumentation");
+    if (harness.selected("http/instrumentation_traced") || harness.selected("http/get_instrumented")) {
+        trace_buffer().enable(4096);
+    }
+    run_instrumented("http/instrumentation_traced");
+
+    auto run_get = [&](const char* name, bool instrumented) {
+        if (!harness.selected(name)) {
+            return;
+        }
+        httplib::Server server;
+        server.Get("/events", [](const httplib::Request&, httplib::Response& res) {
+            res.set_content("[]", "application/json");
+        });
+        if (instrumented) {
+            server.set_pre_routing_handler([](const httplib::Request& req, httplib::Response&) {
+                HttpRequestTimer::begin(req);
+                return httplib::Server::HandlerResponse::Unhandled;
+            });
+            server.set_post_routing_handler([](const httplib::Request& req, httplib::Response&) {
+                HttpRequestTimer::respond(req);
+            });
+            server.set_logger([&](const httplib::Request& req, const httplib::Response&) {
+                responses.add();
+                HttpRequestTimer::Clock::time_point begin;
+                if (HttpRequestTimer::take(req, begin)) {
+                    auto end = HttpRequestTimer::Clock::now();
+                    histogram.observe(end - begin);
+                    trace_buffer().record("/events", begin, end);
+                }
+            });
+        }
+        // 小さな応答なので、Nagleと遅延ACKの待ち（約40ms）で差が埋もれないようにする
+        server.set_tcp_nodelay(true);
+        int port = server.bind_to_any_port("127.0.0.1");
+        std::thread thread([&server] { server.listen_after_bind(); });
+        server.wait_until_ready();
+        httplib::Client client("127.0.0.1", port);
+        client.set_keep_alive(true);
+        client.set_tcp_nodelay(true);
+        harness.run(name, [&](uint64_t n) {
+            for (uint64_t i = 0; i < n; i++) {
+                auto res = client.Get("/events");
+                bench_keep(res ? res->body.size() : 0);
+            }
+        });
+        server.stop();
+        thread.join();
+    };
+    run_get("http/get_plain", false);
+    const BenchHarness::Result* plain = harness.last_result();
+    double plain_ns = plain ? plain->median_ns : 0.0;
+    run_get("http/get_instrumented", true);
+    const BenchHarness::Result* instrumented = harness.last_result();
+    if (plain && instrumented) {
+        harness.add_counter("overhead_ns", instrumented->median_ns - plain_ns);
+    }
+}
+
+// ---- Webサーバーの負荷（WebServerをループバックで起動し、Webhookの応答時間を計る）----
+
+// 一時ディレクトリで起動したWebServer（設定はワーカー数などを含めてデフォルトのまま）
+// LINEへの返信先は閉じたポートにしておく（計測するのはWebhookに200を返すまで）
+class BenchWebServer {
+public:
+    // extra_configは設定ファイルに追記する行（"KEY=VALUE\n"）
+    // setupはWebServerを作る前に呼ぶ（索引やライブ映像など、ベンチマークで使う部品を用意する）
+    explicit BenchWebServer(const std::string& extra_config = "",
+                            const std::function<void(PicamContext&, const std::string& dir)>& setup = {}) {
+        char pattern[] = "/tmp/picam_bench_XXXXXX";
+        const char* created = mkdtemp(pattern);
+        dir_ = created ? created : "/tmp";
+        std::ofstream(dir_ + "/config.txt") << "CHANNEL_ACCESS_TOKEN=bench-token\n"
+                                            << "CHANNEL_SECRET=" << SECRET << "\n"
+                                            << "USER_ID_TO_SEND=Ubench\n"
+                                            << "NGROK_URL_BASE=bench.example\n"
+                                            << "PHOTO_DIR=" << dir_ << "\n"
+                                            << "VIDEO_DIR=" << dir_ << "\n"
+                                            << "RETENTION_MIN_FREE=0\n"
+                                            << extra_config;
+        config_store_ = std::make_unique<ConfigStore>(dir_ + "/config.txt");
+        config_store_->reload();
+        // /videoが読み手の登録に使う（削除はしないので走査スレッドは起動しない）
+        context_.retention = std::make_unique<RetentionManager>(std::vector<std::string>{dir_}, RetentionManager::Params());
+        if (setup) {
+            setup(context_, dir_);
+        }
+        line_ = std::make_unique<LineClient>(context_, "http://127.0.0.1:9");
+        server_ = std::make_unique<WebServer>(context_, *config_store_, *line_);
+        thread_ = std::thread(&WebServer::run, server_.get(), 0);
+        port_ = server_->wait_until_ready();
+    }
+
+    ~BenchWebServer() {
+        server_->stop();
+        thread_.join();
+        if (context_.frame_hub) {
+            context_.frame_hub->stop();
+        }
+        if (context_.event_index) {
+            context_.event_index->close();
+        }
+        std::error_code ec;
+        std::filesystem::remove_all(dir_, ec);
+    }
+
+    BenchWebServer(const BenchWebServer&) = delete;
+    BenchWebServer& operator=(const BenchWebServer&) = delete;
+
+    int port() const { return port_; }
+    const std::string& dir() const { return dir_; }
+    PicamContext& context() { return context_; }
+
+    // X-Line-Signature（Base64(HMAC-SHA256(シークレット, ボディ))）
+    static std::string sign(const std::string& body) {
+        unsigned char mac[EVP_MAX_MD_SIZE];
+        size_t mac_len = 0;
+        EVP_Q_mac(nullptr, "HMAC", nullptr, "SHA256", nullptr, SECRET, std::strlen(SECRET),
+                  reinterpret_cast<const unsigned char*>(body.data()), body.size(), mac, sizeof(mac), &mac_len);
+        unsigned char encoded[64];
+        EVP_EncodeBlock(encoded, mac, static_cast<int>(mac_len));
+        return reinterpret_cast<const char*>(encoded);
+    }
+
+    static constexpr const char* SECRET = "bench-secret";
+
+private:
+    std::string dir_;
+    PicamContext context_;
+    std::unique_ptr<ConfigStore> config_store_;
+    std::unique_ptr<LineClient> line_;
+    std::unique_ptr<WebServer> server_;
+    std::thread thread_;
+    int port_ = -1;
+};
+
+// 分位数（samplesと同じ単位）
+double percentile(std::vector<double>& samples, double q) {
+    if (samples.empty()) {
+        return 0.0;
+    }
+    size_t i = std::min(samples.size() - 1, static_cast<size_t>(q * samples.size()));
+    std::nth_element(samples.begin(), samples.begin() + static_cast<std::ptrdiff_t>(i), samples.end());
+    return samples[i];
+}
+
+// 動画のダウンロードを続けるクライアントを走らせたまま、Webhookを1件ずつ送って200までの時間を計る
+// 動画の同時実行数（HTTP_VIDEO_MAX_CONCURRENCY）より1つ多いクライアントを走らせ、503も数える
+void bench_web_load(BenchHarness& harness) {
+    const char* name = "http/webhook_ack_under_video_load";
+    if (!harness.selected(name)) {
+        return;
+    }
+    BenchWebServer server;
+    const size_t file_size = 4 * 1024 * 1024;
+    {
+        std::ofstream out(server.dir() + "/load.mp4", std::ios::binary);
+        std::string chunk(64 * 1024, 'x');
+        for (size_t written = 0; written < file_size; written += chunk.size()) {
+            out.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+        }
+    }
+
+    std::atomic<bool> loading{true};
+    std::atomic<uint64_t> video_bytes{0};
+    std::atomic<uint64_t> video_busy{0};
+    std::vector<std::thread> viewers;
+    const int video_clients = AppConfig().http_video_max_concurrency + 1;
+    for (int i = 0; i < video_clients; i++) {
+        viewers.emplace_back([&] {
+            httplib::Client client("127.0.0.1", server.port());
+            while (loading.load()) {
+                auto res = client.Get("/video?file=load.mp4", [&](const char*, size_t len) {
+                    video_bytes.fetch_add(len);
+                    return loading.load();
+                });
+                if (res && res->status == 503) {
+                    video_busy.fetch_add(1);
+                    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                }
+            }
+        });
+    }
+
+    const std::string body = R"({"destination":"Ubench","events":[]})";
+    httplib::Headers headers = {{"X-Line-Signature", BenchWebServer::sign(body)}};
+    httplib::Client client("127.0.0.1", server.port());
+    client.set_tcp_nodelay(true);
+    std::vector<double> latencies_us;
+    uint64_t failed = 0;
+    auto started = std::chrono::steady_clock::now();
+    uint64_t bytes_before = video_bytes.load();
+    harness.run(name, [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            auto begin = std::chrono::steady_clock::now();
+            auto res = client.Post("/webhook", headers, body, "application/json");
+            latencies_us.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count());
+            failed += (!res || res->status != 200);
+        }
+    });
+    double elapsed_sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    uint64_t bytes = video_bytes.load() - bytes_before;
+
+    loading.store(false);
+    for (auto& viewer : viewers) {
+        viewer.join();
+    }
+    harness.add_counter("p50_us", percentile(latencies_us, 0.50));
+    harness.add_counter("p99_us", percentile(latencies_us, 0.99));
+    harness.add_counter("webhook_failed", static_cast<double>(failed));
+    harness.add_counter("video_MB_per_s", bytes / 1e6 / elapsed_sec);
+    harness.add_counter("video_busy_503", static_cast<double>(video_busy.load()));
+}
+
+// LINEから届くのと同じ形のWebhookのボディ（テキストメッセージのイベントをevents件）
+std::string webhook_burst_body(const std::string& text, int events) {
+    nlohmann::json body = {{"destination", "Ubench"}, {"events", nlohmann::json::array()}};
+    for (int i = 0; i < events; i++) {
+        body["events"].push_back({{"type", "message"},
+                                  {"replyToken", "bench-reply-" + std::to_string(i)},
+                                  {"source", {{"type", "user"}, {"userId", "Ubench"}}},
+                                  {"message", {{"type", "text"}, {"id", std::to_string(i)}, {"text", text}}}});
+    }
+    return body.dump();
+}
+
+// 複数のクライアントから、イベントをまとめたWebhookを同時に送り続けたときの応答時間
+// 返信（LINEへの送信）はディスパッチャーのスレッドが行うので、200までの時間には含まれない
+// （返信先は閉じたポートなので、ディスパッチャーは接続に失敗してすぐ次のイベントに進む）
+void bench_webhook_burst(BenchHarness& harness) {
+    const char* name = "http/webhook_ack_burst";
+    if (!harness.selected(name)) {
+        return;
+    }
+    BenchWebServer server;
+    const std::string body = webhook_burst_body("？", 5);
+    const httplib::Headers headers = {{"X-Line-Signature", BenchWebServer::sign(body)}};
+
+    // 計測するクライアントのほかに、Webhookの予約分を除いたワーカー数だけ同時に送る
+    std::atomic<bool> sending{true};
+    std::mutex latencies_mutex;
+    std::vector<double> latencies_us;
+    std::atomic<uint64_t> failed{0};
+    auto post = [&](httplib::Client& client, std::vector<double>& samples) {
+        auto begin = std::chrono::steady_clock::now();
+        auto res = client.Post("/webhook", headers, body, "application/json");
+        samples.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count());
+        if (!res || res->status != 200) {
+            failed.fetch_add(1);
+        }
+    };
+    std::vector<std::thread> senders;
+    const int concurrent = AppConfig().http_workers - AppConfig().http_webhook_reserved_workers - 1;
+    for (int i = 0; i < concurrent; i++) {
+        senders.emplace_back([&] {
+            httplib::Client client("127.0.0.1", server.port());
+            client.set_tcp_nodelay(true);
+            std::vector<double> samples;
+            while (sending.load()) {
+                post(client, samples);
+            }
+            std::lock_guard<std::mutex> lock(latencies_mutex);
+            latencies_us.insert(latencies_us.end(), samples.begin(), samples.end());
+        });
+    }
+
+    httplib::Client client("127.0.0.1", server.port());
+    client.set_tcp_nodelay(true);
+    std::vector<double> samples;
+    harness.run(name, [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            post(client, samples);
+        }
+    });
+
+    sending.store(false);
+    for (auto& sender : senders) {
+        sender.join();
+    }
+    latencies_us.insert(latencies_us.end(), samples.begin(), samples.end());
+    harness.add_counter("clients", concurrent + 1);
+    harness.add_counter("events_per_request", 5);
+    harness.add_counter("p50_us", percentile(latencies_us, 0.50));
+    harness.add_counter("p99_us", percentile(latencies_us, 0.99));
+    harness.add_counter("failed", static_cast<double>(failed.load()));
+}
+
+// ---- Webhookの署名検証（X-Line-Signature）----
+// 以前の作り方（リクエストごとに鍵を設定してHMACを計算）と、鍵を設定済みのコンテキストを使い回す検証器の比較
+// あわせて、署名のない大量のリクエストをHTTPでどれだけの速さで断れるかを計る
+void bench_webhook_signature(BenchHarness& harness) {
+    const std::string body = webhook_burst_body("！", 1);
+    const std::string signature = BenchWebServer::sign(body);
+    const std::string forged(signature.size(), 'A'); // 長さは正しいが一致しない署名
+
+    harness.run("webhook/hmac_per_request_key", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            bench_keep(BenchWebServer::sign(body) == signature);
+        }
+    }, static_cast<double>(body.size()), "bytes");
+
+    LineSignatureVerifier verifier(BenchWebServer::SECRET);
+    auto run_verify = [&](const char* name, const std::string& header, bool expected) {
+        bool ok = !expected;
+        harness.run(name, [&](uint64_t n) {
+            for (uint64_t i = 0; i < n; i++) {
+                ok = verifier.verify(body, header);
+            }
+        }, static_cast<double>(body.size()), "bytes");
+        uint64_t allocations_before = thread_allocations;
+        for (int i = 0; i < 1000; i++) {
+            bench_keep(verifier.verify(body, header));
+        }
+        harness.add_counter("allocations_per_request", static_cast<double>(thread_allocations - allocations_before) / 1000);
+        if (harness.selected(name) && ok != expected) {
+            std::printf("警告: %s の検証結果が想定と異なります\n", name);
+        }
+    };
+    run_verify("webhook/verify_signature", signature, true);
+    run_verify("webhook/verify_forged_signature", forged, false);
+    run_verify("webhook/verify_missing_signature", "", false); // HMACを計算せずに断る
+
+    // 署名のないWebhookを複数のクライアントから送り続け、401を返す速さを計る
+    const char* flood = "http/webhook_unsigned_flood";
+    if (!harness.selected(flood)) {
+        return;
+    }
+    BenchWebServer server;
+    const std::string large_body(64 * 1024, ' '); // 署名の検証より前にJSONを解析していれば重くなる大きさ
+    std::atomic<bool> sending{true};
+    std::atomic<uint64_t> rejected{0};
+    std::atomic<uint64_t> accepted{0};
+    auto post_unsigned = [&](httplib::Client& client) {
+        auto res = client.Post("/webhook", {{"X-Line-Signature", forged}}, large_body, "application/json");
+        if (res && res->status == 401) {
+            rejected.fetch_add(1);
+        } else {
+            accepted.fetch_add(1);
+        }
+    };
+    std::vector<std::thread> senders;
+    const int concurrent = 3;
+    for (int i = 0; i < concurrent; i++) {
+        senders.emplace_back([&] {
+            httplib::Client client("127.0.0.1", server.port());
+            client.set_tcp_nodelay(true);
+            while (sending.load()) {
+                post_unsigned(client);
+            }
+        });
+    }
+    httplib::Client client("127.0.0.1", server.port());
+    client.set_tcp_nodelay(true);
+    auto started = std::chrono::steady_clock::now();
+    uint64_t rejected_before = rejected.load();
+    harness.run(flood, [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            post_unsigned(client);
+        }
+    }, static_cast<double>(large_body.size()), "bytes");
+    double elapsed_sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    uint64_t rejected_total = rejected.load() - rejected_before;
+    sending.store(false);
+    for (auto& sender : senders) {
+        sender.join();
+    }
+    harness.add_counter("clients", concurrent + 1);
+    harness.add_counter("rejected_per_s", rejected_total / elapsed_sec);
+    harness.add_counter("not_rejected", static_cast<double>(accepted.load()));
+}
+
+// ---- 録画イベントの索引（10万件）----
+// 10分ごとに1件、約2年分の録画を登録した索引の読み込みと検索、/events の応答
+void bench_event_index(BenchHarness& harness) {
+    const std::vector<std::string> names = {"events/index_load_100k", "events/query_latest_page", "events/query_one_day",
+                                            "events/query_deep_page", "events/get_by_id", "http/events_100k"};
+    if (std::none_of(names.begin(), names.end(), [&](const std::string& name) { return harness.selected(name); })) {
+        return;
+    }
+    const int count = 100000;
+    const int64_t origin_ms = 1704067200000; // 2024-01-01
+    const int64_t step_ms = 10 * 60 * 1000;
+    char pattern[] = "/tmp/picam_bench_XXXXXX";
+    const std::string dir = mkdtemp(pattern) ? pattern : "/tmp";
+    const std::string path = dir + "/events.idx";
+    {
+        EventIndex writer(path);
+        writer.open();
+        for (int i = 0; i < count; i++) {
+            EventRecord record;
+            record.incident = static_cast<uint64_t>(i / 3);
+            record.start_ms = origin_ms + i * step_ms;
+            record.video_file = "2024_01_01--00_00_00.mp4";
+            record.photo_file = "2024_01_01--00_00_00.jpg";
+            record.id = writer.begin_event(record);
+            record.end_ms = record.start_ms + 30000;
+            record.max_faces = 1 + i % 3;
+            record.video_bytes = 4 * 1024 * 1024;
+            writer.update_event(record);
+        }
+    }
+
+    harness.run("events/index_load_100k", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            EventIndex loaded(path);
+            loaded.open();
+            bench_keep(loaded.size());
+        }
+    }, count, "events");
+
+    EventIndex index(path);
+    index.open();
+    const int64_t all_from = 0;
+    const int64_t all_to = std::numeric_limits<int64_t>::max();
+    harness.run("events/query_latest_page", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            bench_keep(index.query(all_from, all_to, 50).size());
+        }
+    });
+    harness.run("events/query_one_day", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            int64_t day_from = origin_ms + static_cast<int64_t>(i % 600) * 24 * 60 * 60 * 1000;
+            bench_keep(index.query(day_from, day_from + 24 * 60 * 60 * 1000, 500).size());
+        }
+    });
+    EventCursor middle;
+    middle.start_ms = origin_ms + (count / 2) * step_ms;
+    middle.id = count / 2;
+    harness.run("events/query_deep_page", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            bench_keep(index.query(all_from, all_to, 50, middle).size());
+        }
+    });
+    EventRecord record;
+    harness.run("events/get_by_id", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            bench_keep(index.get(1 + i % count, record));
+        }
+    });
+    index.close();
+
+    // /events（fromを毎回変えて応答のキャッシュに当てない）
+    if (harness.selected("http/events_100k")) {
+        BenchWebServer server("", [&](PicamContext& context, const std::string&) {
+            context.event_index = std::make_unique<EventIndex>(path);
+            context.event_index->open();
+        });
+        httplib::Client client("127.0.0.1", server.port());
+        client.set_tcp_nodelay(true);
+        uint64_t failed = 0;
+        harness.run("http/events_100k", [&](uint64_t n) {
+            for (uint64_t i = 0; i < n; i++) {
+                int64_t from_sec = origin_ms / 1000 + static_cast<int64_t>(i % 600) * 24 * 60 * 60;
+                auto res = client.Get("/events?limit=50&from=" + std::to_string(from_sec));
+                failed += (!res || res->status != 200);
+            }
+        });
+        harness.add_counter("failed", static_cast<double>(failed));
+    }
+    std::error_code ec;
+    std::filesystem::remove_all(dir, ec);
+}
+
+// ---- ライブ映像の視聴者数とCPU使用率 ----
+// カメラの代わりのスレッドが15fpsでフレームを渡し、視聴者数を1〜10人に変えて /live.mjpg を受信し続ける
+// JPEGへの変換は視聴者数によらず1フレーム1回なので、プロセスのCPU使用率はほぼ一定になるはず
+void bench_live_viewers(BenchHarness& harness, const cv::Mat& frame) {
+    const std::vector<int> viewer_counts = {1, 2, 5, 10};
+    for (int viewers : viewer_counts) {
+        const std::string name = "live/viewers_" + std::to_string(viewers);
+        if (!harness.selected(name)) {
+            continue;
+        }
+        FramePool pool(4);
+        pool.reserve(frame.size(), frame.type());
+        BenchWebServer server("HTTP_WORKERS=16\nLIVE_MAX_VIEWERS=10\n", [&](PicamContext& context, const std::string&) {
+            FrameHub::Params live_params; // 5fps・幅640（設定のデフォルトと同じ）
+            context.frame_hub = std::make_unique<FrameHub>(live_params);
+            context.frame_hub->start();
+        });
+        FrameHub& hub = *server.context().frame_hub;
+
+        std::atomic<bool> running{true};
+        std::thread camera([&] {
+            const std::vector<cv::Rect> faces = {cv::Rect(100, 100, 80, 80)};
+            while (running.load()) {
+                FramePool::Ref ref = pool.acquire();
+                frame.copyTo(ref.mat());
+                auto now = std::chrono::steady_clock::now();
+                if (hub.wanted(now)) {
+                    hub.publish(ref, faces, now);
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(66));
+            }
+        });
+
+        std::atomic<bool> watching{true};
+        std::atomic<uint64_t> received_frames{0};
+        std::vector<std::thread> clients;
+        for (int i = 0; i < viewers; i++) {
+            clients.emplace_back([&] {
+                httplib::Client client("127.0.0.1", server.port());
+                client.Get("/live.mjpg", [&](const char* data, size_t len) {
+                    std::string_view chunk(data, len);
+                    for (size_t pos = chunk.find("--frame"); pos != std::string_view::npos; pos = chunk.find("--frame", pos + 1)) {
+                        received_frames.fetch_add(1);
+                    }
+                    return watching.load();
+                });
+            });
+        }
+
+        // 1反復 = 200msの視聴。その間のプロセス全体のCPU時間を計る
+        auto cpu_now = [] {
+            timespec ts;
+            clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+            return ts.tv_sec + ts.tv_nsec / 1e9;
+        };
+        double cpu_sec = 0.0;
+        double wall_sec = 0.0;
+        uint64_t frames_before = 0;
+        uint64_t encoded_before = 0;
+        bool first = true;
+        harness.run(name, [&](uint64_t n) {
+            if (first) { // ウォームアップの後から数える
+                first = false;
+                std::this_thread::sleep_for(std::chrono::milliseconds(200) * n);
+                frames_before = received_frames.load();
+                encoded_before = hub.stats().encoded;
+                return;
+            }
+            double cpu_begin = cpu_now();
+            auto wall_begin = std::chrono::steady_clock::now();
+            std::this_thread::sleep_for(std::chrono::milliseconds(200) * n);
+            cpu_sec += cpu_now() - cpu_begin;
+            wall_sec += std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_begin).count();
+        });
+        uint64_t frames = received_frames.load() - frames_before;
+        uint64_t encoded = hub.stats().encoded - encoded_before;
+
+        // 視聴者は次のフレームを受け取ったときに切断するので、カメラより先に止める
+        watching.store(false);
+        for (auto& client : clients) {
+            client.join();
+        }
+        running.store(false);
+        camera.join();
+        harness.add_counter("viewers", viewers);
+        harness.add_counter("cpu_percent", wall_sec > 0.0 ? cpu_sec / wall_sec * 100.0 : 0.0);
+        harness.add_counter("encoded_per_s", wall_sec > 0.0 ? encoded / wall_sec : 0.0);
+        harness.add_counter("frames_per_viewer_per_s", wall_sec > 0.0 ? frames / wall_sec / viewers : 0.0);
+    }
+}
+
+// ---- ログの呼び出し（カメラとHTTPのワーカーが同時に書く場合）----
+// 以前：std::coutにstd::endlで書いていた（呼び出しごとにロックと同期的な書き出し）
+// 現在：リングバッファにコピーするだけで、書き出しは専用スレッド
+// 計測するスレッドのほかに、threads - 1本のスレッドが0.5msごと（HTTPのワーカーが忙しい場合より多め）に書く
+// 1反復は64回の呼び出しと、書き出しスレッドがバッファを空けるまでの待ち（バッファを溢れさせると捨てる分だけを計ることになる）
+// そのため時間はp50_ns・p99_ns（1回の呼び出し）を見る
+void bench_logger(BenchHarness& harness) {
+    char pattern[] = "/tmp/picam_bench_XXXXXX";
+    const std::string dir = mkdtemp(pattern) ? pattern : "/tmp";
+    const int burst = 64;
+
+    auto run_contended = [&](const std::string& name, int threads, const std::function<void(int)>& call) {
+        if (!harness.selected(name)) {
+            return;
+        }
+        std::atomic<bool> running{true};
+        std::vector<std::thread> writers;
+        for (int t = 1; t < threads; t++) {
+            writers.emplace_back([&, t] {
+                for (int i = 0; running.load(std::memory_order_relaxed); i++) {
+                    call(t * 1000000 + i);
+                    std::this_thread::sleep_for(std::chrono::microseconds(500));
+                }
+            });
+        }
+        std::vector<double> latencies_ns;
+        latencies_ns.reserve(1 << 20);
+        harness.run(name, [&](uint64_t n) {
+            for (uint64_t i = 0; i < n; i++) {
+                for (int k = 0; k < burst; k++) {
+                    auto begin = std::chrono::steady_clock::now();
+                    call(k);
+                    if (latencies_ns.size() < latencies_ns.capacity()) {
+                        latencies_ns.push_back(std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count());
+                    }
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(25));
+            }
+        });
+        running.store(false);
+        for (auto& writer : writers) {
+            writer.join();
+        }
+        harness.add_counter("threads", threads);
+        harness.add_counter("p50_ns", percentile(latencies_ns, 0.50));
+        harness.add_counter("p99_ns", percentile(latencies_ns, 0.99));
+    };
+
+    for (int threads : {1, 2, 4, 8}) {
+        Logger bench_logger;
+        Logger::Params params;
+        params.path = dir + "/picam.log";
+        params.max_bytes = 8 * 1024 * 1024;
+        params.max_files = 1;
+        params.console_level = LogLevel::Error; // 標準出力には書かない
+        bench_logger.start(params);
+        const std::string path = "/home/pi/Videos/2026_01_01--12_00_00.mp4";
+        run_contended("log/async_threads_" + std::to_string(threads), threads, [&](int i) {
+            bench_logger.log(LogLevel::Info, "録画停止", {{"path", path}, {"frame", i}});
+        });
+        harness.add_counter("dropped", static_cast<double>(bench_logger.dropped()));
+        bench_logger.stop();
+
+        std::mutex stream_mutex; // std::coutの同期と同じく、1行ずつ排他して書く
+        std::ofstream stream(dir + "/cout.log");
+        run_contended("log/ostream_endl_threads_" + std::to_string(threads), threads, [&](int i) {
+            std::lock_guard<std::mutex> lock(stream_mutex);
+            stream << "録画停止 path=" << path << " frame=" << i << std::endl;
+        });
+    }
+    std::error_code ec;
+    std::filesystem::remove_all(dir, ec);
+}
+
+// ---- HTTPのファイル配信（/videoと同じく64KBずつ読みながら送る。ループバックでkeep-alive）----
+void bench_http(BenchHarness& harness) {
+    const size_t file_size = 4 * 1024 * 1024;
+    const std::string path = "/tmp/picam_bench_video.bin";
+    {
+        std::ofstream out(path, std::ios::binary);
+        std::string chunk(64 * 1024, 'x');
+        for (size_t written = 0; written < file_size; written += chunk.size()) {
+            out.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+        }
+    }
+
+    httplib::Server server;
+    server.Get("/video", [&path](const httplib::Request&, httplib::Response& res) {
+        auto ifs = std::make_shared<std::ifstream>(path, std::ios::binary | std::ios::ate);
+        size_t size = static_cast<size_t>(ifs->tellg());
+        res.set_content_provider(size, "video/mp4", [ifs](size_t offset, size_t length, httplib::DataSink& sink) {
+            char buffer[64 * 1024];
+            ifs->seekg(static_cast<std::streamoff>(offset));
+            ifs->read(buffer, static_cast<std::streamsize>(std::min(length, sizeof(buffer))));
+            std::streamsize n = ifs->gcount();
+            return n > 0 && sink.write(buffer, static_cast<size_t>(n));
+        });
+    });
+    int port = server.bind_to_any_port("127.0.0.1");
+    std::thread thread([&server] { server.listen_after_bind(); });
+    server.wait_until_ready();
+
+    httplib::Client client("127.0.0.1", port);
+    client.set_keep_alive(true);
+    harness.run("http/serve_file_4MB", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            size_t received = 0;
+            client.Get("/video", [&](const char*, size_t len) {
+                received += len;
+                return true;
+            });
+            bench_keep(received);
+        }
+    }, static_cast<double>(file_size), "bytes");
+
+    server.stop();
+    thread.join();
+    std::remove(path.c_str());
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    if (!parse_options(argc, argv, options)) {
+        return 2;
+    }
+    BenchHarness harness(std::chrono::milliseconds(options.min_time_ms), options.repetitions, options.filter);
+
+    // WebServerのリクエストごとのログ（返信先に接続できない警告を含む）で計測が乱れないよう、ERRORだけを書く
+    Logger::Params log_params;
+    log_params.file_level = LogLevel::Error;
+    log_params.console_level = LogLevel::Error;
+    logger().start(log_params);
+
+    cv::Mat frame = make_frame(options, 1280, 720);
+
+    bench_preprocess(harness, frame);
+    bench_frame_pool(harness, frame);
+    bench_detect(harness, options, frame);
+    bench_jpeg(harness, frame);
+    bench_h264(harness, frame);
+    bench_overlay(harness, frame);
+    bench_json(harness);
+    bench_logger(harness);
+    bench_http_instrumentation(harness);
+    bench_event_index(harness);
+    bench_live_viewers(harness, frame);
+    bench_http(harness);
+    bench_webhook_signature(harness);
+    bench_webhook_burst(harness);
+    bench_web_load(harness);
+
+    // 実行環境（比較するときに条件が同じか確かめる）
+    char date[32];
+    std::time_t now = std::time(nullptr);
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+    nlohmann::json context = {{"date", date},
+                              {"opencv", cv::getVersionString()},
+                              {"opencv_threads", cv::getNumThreads()},
+                              {"hardware_concurrency", std::thread::hardware_concurrency()},
+                              {"input", options.image_path.empty() ? "synthetic" : options.image_path},
+                              {"min_time_ms", options.min_time_ms}};
+
+    std::ofstream out(options.out_path);
+    out << harness.to_json(context).dump(2) << "\n";
+    if (!out) {
+        std::fprintf(stderr, "結果を書き出せませんでした: %s\n", options.out_path.c_str());
+        return 1;
+    }
+    std::printf("結果を書き出しました: %s\n", options.out_path.c_str());
+    return 0;
+}
@@ -0,0 +1,384 @@
+#pragma once
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <string>
+
+#include "logger.h"
+
+// 設定ファイルのキーと値
+using ConfigMap = std::map<std::string, std::string>;
+
+// アプリケーション全体の設定（型付き・デフォルト値つき）
+// config.txt の値と環境変数 PICAM_<キー名> から作られる（環境変数が優先）
+struct AppConfig {
+    // -LINE
+    std::string channel_access_token;
+    std::string channel_secret;
+    std::string user_id_to_send;
+    std::string ngrok_url_base;
+
+    // -Webサーバー
+    int server_port = 8080;
+    int http_workers = 8;
+    int http_max_queued = 16;
+    int http_webhook_reserved_workers = 2;
+    int http_image_max_concurrency = 4;
+    int http_video_max_concurrency = 2;
+    int http_query_max_concurrency = 2; // /events・/metrics・/traceの同時実行数
+    std::chrono::milliseconds http_read_timeout{5000};
+    std::chrono::milliseconds http_write_timeout{10000};
+    std::chrono::milliseconds http_keep_alive_timeout{2000};
+    int http_keep_alive_max_count = 5;
+    std::chrono::milliseconds http_max_transfer{120000};
+    uint64_t webhook_max_body = 64 * 1024;
+
+    // -カメラ
+    int camera_width = 800;
+    int camera_height = 600;
+    int camera_fps = 15;
+    std::string camera_pipeline; // 空ならwidth/height/fpsから組み立てる
+
+    // -ライブ映像（/live.mjpg）
+    int live_max_viewers = 3;
+    int live_max_fps = 5;
+    int live_width = 640;       // 0ならカメラの解像度のまま
+    int live_jpeg_quality = 70;
+    std::chrono::milliseconds live_max_duration{10 * 60 * 1000}; // 1回の視聴の上限（ワーカーを占有し続けないように）
+
+    // -録画中のHLSライブ配信（/live/live.m3u8）
+    bool hls_enabled = false;
+    std::string hls_dir = "/dev/shm/picam_hls";
+    std::chrono::milliseconds hls_segment{1000};
+    int hls_playlist_length = 4;
+    std::string hls_encoder = "v4l2h264enc";
+
+    // -顔検出
+    std::string cascade_path = "/usr/share/opencv4/haarcascades/haarcascade_frontalface_default.xml";
+    int detection_interval = 5;       // 何フレームに一度検出するか
+    double detection_downscale = 0.5; // 検出前の縮小率
+    double detection_scale_factor = 1.1;
+    int detection_min_neighbors = 7;
+    int detection_min_size = 30;      // 縮小後の画像での最小サイズ（ピクセル）
+
+    // -録画と通知の制御
+    int incident_start_hits = 1;
+    std::chrono::milliseconds record_hold{5000};
+    std::chrono::milliseconds record_max_hold{30000};
+    std::chrono::milliseconds incident_gap{60000};
+    int incident_max_notifications = 2;
+    int notify_max_per_hour = 20;
+
+    // -LINE通知
+    std::chrono::milliseconds notify_coalesce{1000};
+    std::chrono::milliseconds notify_min_interval{1000};
+    std::string outbox_path = "../line_outbox.log";
+
+    // -保存先
+    std::string photo_dir = "../line_photo";
+    std::string video_dir = "../line_video";
+    std::string event_index_path = "../line_events.idx"; // 録画イベントの索引
+
+    // -保存ファイルの整理（0なら無効）
+    std::chrono::milliseconds retention_max_age{6 * 60 * 60 * 1000};
+    uint64_t retention_quota = 0;
+    uint64_t retention_min_free = 0; // 既定では確認しない（小さいSDカードで録画が消え続けないように）
+    std::chrono::milliseconds retention_interval{60 * 1000};
+    std::chrono::milliseconds retention_rescan_interval{60 * 60 * 1000};
+
+    // -ログ
+    std::string log_path = "../picam.log";
+    uint64_t log_max_size = 10ull * 1024 * 1024; // これを超えたらローテーション
+    int log_max_files = 3;
+    LogLevel log_level = LogLevel::Info;          // ファイルに書くレベル
+    LogLevel log_console_level = LogLevel::Warn;  // 画面に出すレベル
+
+    // -処理区間のトレース（起動時のみ反映）
+    bool trace_enabled = false;
+    int trace_capacity = 32768;                   // 保持する区間の数（1区間40バイト）
+    std::chrono::milliseconds trace_window{60 * 1000}; // 書き出す期間
+    std::string trace_dump_path = "../picam_trace.json"; // SIGUSR1で書き出す先
+
+    // カメラのGStreamerパイプライン
+    std::string pipeline() const {
+        if (!camera_pipeline.empty()) {
+            return camera_pipeline;
+        }
+        return "libcamerasrc ! video/x-raw, width=" + std::to_string(camera_width) +
+               ", height=" + std::to_string(camera_height) +
+               ", framerate=" + std::to_string(camera_fps) + "/1 ! videoconvert ! videoscale ! appsink";
+    }
+};
+
+// 設定値を型ごとに読み取るクラス
+// 範囲外・書式の誤りがあれば最初のエラーを記録し、値はデフォルトのまま残す
+class AppConfigParser {
+public:
+    AppConfigParser(const ConfigMap& raw, std::string& error) : raw_(raw), error_(error) {}
+
+    bool ok() const { return ok_; }
+
+    // 文字列
+    void text(const char* key, std::string& out, bool required = false) {
+        std::string value;
+        if (lookup(key, value)) {
+            out = value;
+        }
+        if (required && out.empty()) {
+            fail(key, "が未設定です");
+        }
+    }
+
+    // 整数
+    void integer(const char* key, int& out, int min, int max) {
+        std::string value;
+        if (!lookup(key, value)) {
+            return;
+        }
+        char* end = nullptr;
+        long v = std::strtol(value.c_str(), &end, 10);
+        if (end == value.c_str() || *end != '\0') {
+            fail(key, "の値が整数ではありません: " + value);
+        } else if (v < min || v > max) {
+            fail(key, "の値が範囲外です（" + std::to_string(min) + "〜" + std::to_string(max) + "）: " + value);
+        } else {
+            out = static_cast<int>(v);
+        }
+    }
+
+    // ログのレベル（debug / info / warn / error）
+    void log_level(const char* key, LogLevel& out) {
+        std::string value;
+        if (!lookup(key, value)) {
+            return;
+        }
+        if (!parse_log_level(value, out)) {
+            fail(key, "の値はdebug / info / warn / errorのいずれかにしてください: " + value);
+        }
+    }
+
+    // 真偽値（1/0, true/false, on/off）
+    void boolean(const char* key, bool& out) {
+        std::string value;
+        if (!lookup(key, value)) {
+            return;
+        }
+        if (value == "1" || value == "true" || value == "on") {
+            out = true;
+        } else if (value == "0" || value == "false" || value == "off") {
+            out = false;
+        } else {
+            fail(key, "の値が真偽値ではありません（1/0, true/false, on/off）: " + value);
+        }
+    }
+
+    // 小数
+    void real(const char* key, double& out, double min, double max) {
+        std::string value;
+        if (!lookup(key, value)) {
+            return;
+        }
+        char* end = nullptr;
+        double v = std::strtod(value.c_str(), &end);
+        if (end == value.c_str() || *end != '\0' || !std::isfinite(v)) {
+            fail(key, "の値が数値ではありません: " + value);
+        } else if (v < min || v > max) {
+            fail(key, "の値が範囲外です（" + std::to_string(min) + "〜" + std::to_string(max) + "）: " + value);
+        } else {
+            out = v;
+        }
+    }
+
+    // 時間（"500ms", "5s", "2m", "1h"。単位がなければ秒）
+    void duration(const char* key, std::chrono::milliseconds& out, std::chrono::milliseconds min, std::chrono::milliseconds max) {
+        std::string value;
+        if (!lookup(key, value)) {
+            return;
+        }
+        double number = 0;
+        std::string unit;
+        if (!split_number(value, number, unit)) {
+            fail(key, "の値が時間ではありません: " + value);
+            return;
+        }
+        double ms_per_unit = 0;
+        if (unit == "ms") ms_per_unit = 1;
+        else if (unit == "s" || unit.empty()) ms_per_unit = 1000;
+        else if (unit == "m" || unit == "min") ms_per_unit = 60 * 1000;
+        else if (unit == "h") ms_per_unit = 60 * 60 * 1000;
+        else {
+            fail(key, "の単位が不正です（ms, s, m, h）: " + value);
+            return;
+        }
+        auto v = std::chrono::milliseconds(static_cast<int64_t>(std::llround(number * ms_per_unit)));
+        if (v < min || v > max) {
+            fail(key, "の値が範囲外です（" + std::to_string(min.count()) + "ms〜" + std::to_string(max.count()) + "ms）: " + value);
+        } else {
+            out = v;
+        }
+    }
+
+    // サイズ（"512KB", "10MB", "1GB"。単位がなければバイト）
+    void bytes(const char* key, uint64_t& out, uint64_t min, uint64_t max) {
+        std::string value;
+        if (!lookup(key, value)) {
+            return;
+        }
+        double number = 0;
+        std::string unit;
+        if (!split_number(value, number, unit)) {
+            fail(key, "の値がサイズではありません: " + value);
+            return;
+        }
+        double bytes_per_unit = 0;
+        if (unit.empty() || unit == "B") bytes_per_unit = 1;
+        else if (unit == "KB" || unit == "K") bytes_per_unit = 1024.0;
+        else if (unit == "MB" || unit == "M") bytes_per_unit = 1024.0 * 1024;
+        else if (unit == "GB" || unit == "G") bytes_per_unit = 1024.0 * 1024 * 1024;
+        else {
+            fail(key, "の単位が不正です（B, KB, MB, GB）: " + value);
+            return;
+        }
+        double v = number * bytes_per_unit;
+        if (v < static_cast<double>(min) || v > static_cast<double>(max)) {
+            fail(key, "の値が範囲外です（" + std::to_string(min) + "〜" + std::to_string(max) + "バイト）: " + value);
+        } else {
+            out = static_cast<uint64_t>(v);
+        }
+    }
+
+    void fail(const std::string& key, const std::string& message) {
+        if (ok_) {
+            error_ = key + message;
+            ok_ = false;
+        }
+    }
+
+private:
+    // 環境変数 PICAM_<キー名> があればそちらを優先する
+    bool lookup(const char* key, std::string& value) const {
+        std::string env_name = std::string("PICAM_") + key;
+        if (const char* env = std::getenv(env_name.c_str())) {
+            value = env;
+            return true;
+        }
+        auto it = raw_.find(key);
+        if (it == raw_.end() || it->second.empty()) {
+            return false;
+        }
+        value = it->second;
+        return true;
+    }
+
+    // "10MB" → 10 と "MB" に分ける
+    static bool split_number(const std::string& value, double& number, std::string& unit) {
+        char* end = nullptr;
+        number = std::strtod(value.c_str(), &end);
+        if (end == value.c_str() || !std::isfinite(number) || number < 0) {
+            return false;
+        }
+        unit = end;
+        return true;
+    }
+
+    const ConfigMap& raw_;
+    std::string& error_;
+    bool ok_ = true;
+};
+
+// 設定ファイルの値からAppConfigを作る（不正な値があればfalseとerrorを返す）
+// require_lineがfalseなら（リプレイ）LINEのキーがなくてもよい
+inline bool parse_app_config(const ConfigMap& raw, AppConfig& config, std::string& error, bool require_line = true) {
+    using std::chrono::milliseconds;
+    AppConfigParser p(raw, error);
+
+    p.text("CHANNEL_ACCESS_TOKEN", config.channel_access_token, require_line);
+    p.text("CHANNEL_SECRET", config.channel_secret);
+    p.text("USER_ID_TO_SEND", config.user_id_to_send, require_line);
+    p.text("NGROK_URL_BASE", config.ngrok_url_base, require_line);
+
+    p.integer("SERVER_PORT", config.server_port, 1, 65535);
+    p.integer("HTTP_WORKERS", config.http_workers, 2, 64);
+    p.integer("HTTP_MAX_QUEUED", config.http_max_queued, 1, 1024);
+    p.integer("HTTP_WEBHOOK_RESERVED_WORKERS", config.http_webhook_reserved_workers, 1, 63);
+    p.integer("HTTP_IMAGE_MAX_CONCURRENCY", config.http_image_max_concurrency, 1, 64);
+    p.integer("HTTP_VIDEO_MAX_CONCURRENCY", config.http_video_max_concurrency, 1, 64);
+    p.integer("HTTP_QUERY_MAX_CONCURRENCY", config.http_query_max_concurrency, 1, 64);
+    p.duration("HTTP_READ_TIMEOUT", config.http_read_timeout, milliseconds(100), milliseconds(300000));
+    p.duration("HTTP_WRITE_TIMEOUT", config.http_write_timeout, milliseconds(100), milliseconds(300000));
+    p.duration("HTTP_KEEP_ALIVE_TIMEOUT", config.http_keep_alive_timeout, milliseconds(0), milliseconds(300000));
+    p.integer("HTTP_KEEP_ALIVE_MAX_COUNT", config.http_keep_alive_max_count, 1, 1000);
+    p.duration("HTTP_MAX_TRANSFER", config.http_max_transfer, milliseconds(1000), milliseconds(3600000));
+    p.bytes("WEBHOOK_MAX_BODY", config.webhook_max_body, 1024, 10 * 1024 * 1024);
+    if (config.http_webhook_reserved_workers >= config.http_workers) {
+        p.fail("HTTP_WEBHOOK_RESERVED_WORKERS", "はHTTP_WORKERSより小さくしてください");
+    }
+
+    p.integer("CAMERA_WIDTH", config.camera_width, 160, 4096);
+    p.integer("CAMERA_HEIGHT", config.camera_height, 120, 3072);
+    p.integer("CAMERA_FPS", config.camera_fps, 1, 120);
+    p.text("CAMERA_PIPELINE", config.camera_pipeline);
+
+    p.integer("LIVE_MAX_VIEWERS", config.live_max_viewers, 0, 32);
+    p.integer("LIVE_MAX_FPS", config.live_max_fps, 1, 30);
+    p.integer("LIVE_WIDTH", config.live_width, 0, 4096);
+    p.integer("LIVE_JPEG_QUALITY", config.live_jpeg_quality, 10, 100);
+    p.duration("LIVE_MAX_DURATION", config.live_max_duration, milliseconds(10 * 1000), milliseconds(24LL * 3600 * 1000));
+    // 視聴中はWebhook予約分を除いたワーカーの枠を1つずつ使うので、画像・動画・検索に最低1つは残す
+    if (config.live_max_viewers >= config.http_workers - config.http_webhook_reserved_workers) {
+        p.fail("LIVE_MAX_VIEWERS", "はHTTP_WORKERS - HTTP_WEBHOOK_RESERVED_WORKERSより小さくしてください（視聴中はワーカーを1つ使います）");
+    }
+
+    p.boolean("HLS_ENABLED", config.hls_enabled);
+    p.text("HLS_DIR", config.hls_dir);
+    p.duration("HLS_SEGMENT", config.hls_segment, milliseconds(1000), milliseconds(10000));
+    p.integer("HLS_PLAYLIST_LENGTH", config.hls_playlist_length, 2, 20);
+    p.text("HLS_ENCODER", config.hls_encoder);
+
+    p.text("CASCADE_PATH", config.cascade_path);
+    p.integer("DETECTION_INTERVAL", config.detection_interval, 1, 1000);
+    p.real("DETECTION_DOWNSCALE", config.detection_downscale, 0.1, 1.0);
+    p.real("DETECTION_SCALE_FACTOR", config.detection_scale_factor, 1.01, 2.0);
+    p.integer("DETECTION_MIN_NEIGHBORS", config.detection_min_neighbors, 0, 50);
+    p.integer("DETECTION_MIN_SIZE", config.detection_min_size, 8, 2000);
+
+    p.integer("INCIDENT_START_HITS", config.incident_start_hits, 1, 100);
+    p.duration("RECORD_HOLD", config.record_hold, milliseconds(500), milliseconds(600000));
+    p.duration("RECORD_MAX_HOLD", config.record_max_hold, milliseconds(500), milliseconds(3600000));
+    p.duration("INCIDENT_GAP", config.incident_gap, milliseconds(0), milliseconds(3600000));
+    p.integer("INCIDENT_MAX_NOTIFICATIONS", config.incident_max_notifications, 0, 100);
+    p.integer("NOTIFY_MAX_PER_HOUR", config.notify_max_per_hour, 0, 1000);
+    if (config.record_max_hold < config.record_hold) {
+        p.fail("RECORD_MAX_HOLD", "はRECORD_HOLD以上にしてください");
+    }
+
+    p.duration("NOTIFY_COALESCE", config.notify_coalesce, milliseconds(0), milliseconds(60000));
+    p.duration("NOTIFY_MIN_INTERVAL", config.notify_min_interval, milliseconds(0), milliseconds(60000));
+    p.text("OUTBOX_PATH", config.outbox_path);
+
+    p.text("PHOTO_DIR", config.photo_dir);
+    p.text("VIDEO_DIR", config.video_dir);
+    p.text("EVENT_INDEX_PATH", config.event_index_path);
+
+    p.duration("RETENTION_MAX_AGE", config.retention_max_age, milliseconds(0), milliseconds(365LL * 24 * 3600 * 1000));
+    p.bytes("RETENTION_QUOTA", config.retention_quota, 0, 1ull << 50);
+    p.bytes("RETENTION_MIN_FREE", config.retention_min_free, 0, 1ull << 50);
+    p.duration("RETENTION_INTERVAL", config.retention_interval, milliseconds(1000), milliseconds(24LL * 3600 * 1000));
+    p.duration("RETENTION_RESCAN_INTERVAL", config.retention_rescan_interval, milliseconds(60 * 1000), milliseconds(7LL * 24 * 3600 * 1000));
+
+    p.text("LOG_PATH", config.log_path);
+    p.bytes("LOG_MAX_SIZE", config.log_max_size, 64 * 1024, 1ull << 32);
+    p.integer("LOG_MAX_FILES", config.log_max_files, 0, 20);
+    p.log_level("LOG_LEVEL", config.log_level);
+    p.log_level("LOG_CONSOLE_LEVEL", config.log_console_level);
+
+    p.boolean("TRACE_ENABLED", config.trace_enabled);
+    p.integer("TRACE_CAPACITY", config.trace_capacity, 1024, 1 << 20);
+    p.duration("TRACE_WINDOW", config.trace_window, milliseconds(1000), milliseconds(3600 * 1000));
+    p.text("TRACE_DUMP_PATH", config.trace_dump_path);
+
+    return p.ok();
+}
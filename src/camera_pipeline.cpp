@@ -0,0 +1,319 @@
+#include "camera_pipeline.h"
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "logger.h"
+#include "metrics.h"
+#include "trace_buffer.h"
+
+namespace {
+
+// 録画と通知の制御のパラメーター
+IncidentPolicy::Params incident_params(const AppConfig& config) {
+    IncidentPolicy::Params params;
+    params.start_hits = config.incident_start_hits;
+    params.hold = config.record_hold; // 録画を継続する時間
+    params.max_hold = config.record_max_hold;
+    params.incident_gap = config.incident_gap;
+    params.max_notifications_per_incident = config.incident_max_notifications;
+    params.max_notifications_per_hour = config.notify_max_per_hour;
+    return params;
+}
+
+} // namespace
+
+
+CameraPipeline::CameraPipeline(PicamContext& context, ConfigStore& config_store, GpioBackend& gpio, LineClient& line,
+                               FrameSource& source)
+    : context_(context),
+      config_store_(config_store),
+      gpio_(gpio),
+      line_(line),
+      source_(source),
+      startup_config_(config_store.get()),
+      detector_(context.metrics),
+      recorder_(context, startup_config_->app.photo_dir, startup_config_->app.video_dir),
+      incident_policy_(incident_params(startup_config_->app)) {}
+
+bool CameraPipeline::open(const ReplayOptions& replay_options) {
+    const AppConfig& config = startup_config_->app;
+
+    // 初期設定と検出機のロード（リプレイでラベルを検出結果として使う場合は不要）
+    bool use_labels = context_.replay && context_.replay->labels();
+    if (!use_labels && !detector_.load(config.cascade_path)) {
+        log_error("顔カスケード分類機を読み込めませんでした", {{"path", config.cascade_path}});
+        return false;
+    }
+
+    // カメラの初期化（リプレイでは動画ファイルや連番画像から読む）
+    if (!source_.open()) {
+        log_error("カメラを開けませんでした");
+        return false;
+    }
+
+    // カメラの解像度でフレームのバッファを確保しておく（以降はフレームごとに使い回す）
+    // 解像度が取れないソースでは、最初のフレームで各スロットが1回だけ確保される
+    cv::Size frame_size = source_.frame_size();
+    if (!frame_size.empty()) {
+        context_.frame_pool->reserve(frame_size, CV_8UC3);
+    }
+
+    // 動画設定の取得
+    fps_ = config.camera_fps; // カメラFPS
+    if (context_.replay) {
+        // 指定がなければ動画のFPSを使う（連番画像などで取れなければCAMERA_FPS）
+        double source_fps = replay_options.fps > 0.0 ? replay_options.fps : source_.fps();
+        if (source_fps > 0.0) {
+            fps_ = source_fps;
+        }
+        context_.replay->start(fps_);
+    }
+    return true;
+}
+
+void CameraPipeline::run() {
+    Replay* replay = context_.replay.get();
+    FrameHub& frame_hub = *context_.frame_hub;
+    FramePool& frame_pool = *context_.frame_pool;
+
+    std::vector<cv::Rect> last_faces;
+    std::vector<int> face_neighbors; // 顔ごとの近傍矩形の数（検出の確からしさ）
+    int frame_count = 0;
+    size_t replay_faces = 0; // リプレイで最後に記録した顔の数
+
+    log_info("モニターモードを開始：顔検出を待機しています");
+
+    while (true) { // 無限ループで監視を続ける
+
+        // 赤ボタンが押されたらプログラム終了
+        if (gpio_.read(BTN_RED) == GPIO_LOW) {
+            break;
+        }
+
+        // プールのバッファに直接読み込む（前のフレームは、ライブ映像の変換中でなければここでプールに戻る）
+        FramePool::Ref frame_ref = frame_pool.acquire();
+        cv::Mat& frame = frame_ref.mat();
+        bool captured;
+        {
+            ScopedTimer timer(context_.metrics.capture_seconds, "capture");
+            captured = source_.read(frame);
+        }
+        if (!captured) {
+            context_.metrics.capture_failures_total.add();
+            break;
+        }
+        ScopedTimer frame_timer(context_.metrics.frame_seconds, "frame");
+        context_.metrics.frames_total.add();
+
+        // 最新の設定を取得（再読み込みされた値がこのフレームから反映される）
+        auto live_config_snapshot = config_store_.get();
+        const AppConfig& live_config = live_config_snapshot->app;
+        const int detection_interval = live_config.detection_interval; // 数フレームに一度だけ検出
+
+        // LINEからの制御コマンドを処理
+        if (handle_control_commands(frame, live_config)) {
+            break;
+        }
+
+        // 緑ボタンが押されたら、監視状態を切り替える
+        if (gpio_.read(BTN_GREEN) == GPIO_LOW) {
+            toggle_monitoring(live_config);
+        }
+
+        // 監視が停止中なら処理をスキップ、赤LEDは消灯
+        if (!context_.monitoring_enabled.load()) {
+            gpio_.write(LED_RED, GPIO_LOW);
+            // CPU負荷を下げるために待機（コマンドが届けばすぐに起床する）
+            context_.control_queue.wait_for(std::chrono::milliseconds(500));
+            continue;
+        }
+
+        // 監視が開始したら赤LEDを点灯
+        gpio_.write(LED_RED, GPIO_HIGH);
+
+        // 顔検出の間引き
+        bool detection_ran = (frame_count % detection_interval == 0);
+        if (detection_ran) {
+            const DetectionLabels* labels = replay ? replay->labels() : nullptr;
+            if (labels) {
+                // リプレイの --detections: ラベルをそのまま検出結果にする（容量が足りていれば確保しない）
+                last_faces = labels->at(static_cast<int>(replay->frame()));
+                face_neighbors.assign(last_faces.size(), 0);
+            } else {
+                detector_.detect(frame, DetectionParams::from_config(live_config), last_faces, face_neighbors);
+            }
+
+            // 映っている顔の数が変わったときだけ記録する
+            if (replay && last_faces.size() != replay_faces) {
+                replay_faces = last_faces.size();
+                context_.replay_event("faces", {{"count", replay_faces}});
+            }
+        }
+
+        // 録画ロジックの核
+        bool face_detected_this_frame = !last_faces.empty();
+        // リプレイではフレーム番号から求めた仮想時刻で判定する（--fastでも録画の長さが変わらない）
+        auto now = replay ? replay->now() : std::chrono::steady_clock::now();
+        IncidentActions actions = incident_policy_.update(now, face_detected_this_frame, detection_ran);
+
+        // 顔を検知したら青LED点灯、検知していない時は消灯
+        gpio_.write(LED_BLUE, face_detected_this_frame ? GPIO_HIGH : GPIO_LOW);
+
+        if (actions.incident_opened) {
+            log_info("[インシデント開始]");
+            context_.replay_event("incident_open");
+        }
+
+        // 録画を開始する
+        if (actions.start_clip) {
+            bool recording = recorder_.start(frame, fps_, incident_policy_.stats().incidents);
+            // 書き込めたかどうかはエンコーダーの有無で変わるので、events.logには書かない（正解ファイルと比較できるように）
+            // （動画を開けなければ録画終了時の動画の通知も送らないので、正解ファイルとの比較は動画を書き出せる環境で行う）
+            context_.replay_event("clip_start");
+
+            // 写真をLINEに送信（同じインシデント内の再開や、通知の上限に達した場合は送らない）
+            if (actions.notify_image) {
+                line_.notify_image(live_config.user_id_to_send, live_config, recorder_.photo_filename(), [](bool ok) {
+                    if (ok) {
+                        log_info("メッセージの送信が完了しました");
+                    } else {
+                        log_error("メッセージの送信に失敗しました");
+                    }
+                });
+            }
+
+            // HLSが有効なら、録画中に見られるようライブ配信のURLも送る（写真と同じpushにまとめられる）
+            if (actions.notify_image && context_.hls && recording) {
+                line_.notify_text(live_config.user_id_to_send,
+                    "ライブ配信中：https://" + live_config.ngrok_url_base + "/live/" + HlsStream::PLAYLIST_NAME, "", live_config);
+            }
+        }
+
+        // 顔が映らなくなったら書き込みを止め、戻ってきたら同じ動画に続けて書く
+        if (actions.pause_clip) {
+            recorder_.pause();
+            context_.replay_event("clip_pause");
+        }
+        if (actions.resume_clip) {
+            recorder_.resume();
+            log_info("録画を再開");
+            context_.replay_event("clip_resume");
+        }
+
+        // 最後の検出から一定時間が経過したら録画を終了
+        if (actions.stop_clip) {
+            bool clip_written = recorder_.stop();
+            context_.replay_event("clip_stop");
+
+            if (actions.notify_video && clip_written) {
+                // テキストとvideoのURLを送信（動画を書き出せなかった場合は、存在しないファイルのURLを送らない）
+                line_.notify_text(live_config.user_id_to_send, "動画を撮影しました。", recorder_.video_filename(), live_config);
+            }
+        }
+
+        if (actions.incident_closed) {
+            const IncidentPolicy::Stats& stats = incident_policy_.stats();
+            log_info("[インシデント終了]", {{"incidents", stats.incidents}, {"clips", stats.clips},
+                                           {"notifications", stats.notifications}, {"suppressed", stats.suppressed}});
+            context_.replay_event("incident_close", {{"notifications", stats.notifications}, {"suppressed", stats.suppressed}});
+        }
+
+        // 顔の枠はフレームに描かない（録画の映像は加工せず、枠は検出結果のトラックに残す）
+        // 録画中の検出結果をイベントに集計し、トラックに書く
+        if (detection_ran) {
+            recorder_.add_detection(last_faces, face_neighbors);
+        }
+
+        // ライブ映像の視聴者がいればフレームと顔の枠を渡す（コピーせずにRefを渡し、枠は変換スレッドが描く）
+        // 以降、このフレームは読むだけにする
+        auto frame_time = std::chrono::steady_clock::now();
+        if (frame_hub.wanted(frame_time)) {
+            TraceSpan span("live_publish");
+            frame_hub.publish(frame_ref, last_faces, frame_time);
+        }
+
+        // 録画中の場合、フレームをファイルに書き込む
+        recorder_.write(frame);
+
+        frame_count++;
+        if (replay) {
+            // 次のフレームの時刻まで待つ（--fastなら待たない）
+            replay->next_frame();
+        } else {
+            // 負荷軽減のため、わずかに待機時間を入れる
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+}
+
+void CameraPipeline::close() {
+    recorder_.close();
+    source_.release();
+}
+
+bool CameraPipeline::handle_control_commands(const cv::Mat& frame, const AppConfig& live_config) {
+    bool end_requested = false;
+    ControlQueue& control_queue = context_.control_queue;
+    // 毎フレーム呼ばれるので、コマンドがなければキューのロックも取らない
+    if (!control_queue.has_pending()) {
+        return false;
+    }
+    ControlCommand cmd;
+    while (control_queue.try_pop(cmd)) {
+        bool ok = false;
+
+        switch (cmd.type) {
+        // 写真を保存し、LINEに送信
+        case ControlCommandType::TakePhoto: {
+            std::string photo_filename;
+            if (!recorder_.take_photo(frame, photo_filename)) {
+                break;
+            }
+
+            // 写真をLINEに送信（送信結果は通知スレッドからWebhook側へ返す）
+            double latency_ms = control_queue.record_latency(cmd);
+            log_info("[制御] コマンド処理遅延", {{"latency_ms", latency_ms}});
+            line_.notify_image(live_config.user_id_to_send, live_config, photo_filename,
+                [on_complete = std::move(cmd.on_complete)](bool sent) {
+                    if (on_complete) {
+                        on_complete(sent);
+                    }
+                });
+            continue;
+        }
+
+        // 監視状態を切り替え（状態が変わればtrue）
+        case ControlCommandType::SetMonitoring:
+            ok = (context_.monitoring_enabled.exchange(cmd.enable) != cmd.enable);
+            break;
+
+        // プログラム終了
+        case ControlCommandType::Shutdown:
+            end_requested = true;
+            ok = true;
+            break;
+        }
+
+        double latency_ms = control_queue.complete(cmd, ok);
+        log_info("[制御] コマンド処理遅延", {{"latency_ms", latency_ms}});
+    }
+    return end_requested;
+}
+
+void CameraPipeline::toggle_monitoring(const AppConfig& live_config) {
+    if (context_.monitoring_enabled.load()) {
+        context_.monitoring_enabled.store(false);
+
+        // LINEに変更を通知
+        line_.notify_text(live_config.user_id_to_send, "監視を停止します。", "", live_config);
+    } else {
+        context_.monitoring_enabled.store(true);
+
+        line_.notify_text(live_config.user_id_to_send, "監視を再開します。", "", live_config);
+    }
+
+    // チャタリングを防ぐために少し待つ
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "config_store.h"
+#include "face_detector.h"
+#include "frame_source.h"
+#include "gpio_backend.h"
+#include "incident_policy.h"
+#include "line_client.h"
+#include "picam_context.h"
+#include "recorder.h"
+#include "replay.h"
+
+// カメラスレッドの処理（撮影 → 顔検出 → 録画・通知 → ライブ配信）
+// 制御コマンドとボタンもここで処理する（監視状態を書き換えるのはこのスレッドだけ）
+class CameraPipeline {
+public:
+    // sourceはフレームの入力元（実機はカメラ、リプレイは動画ファイルなど）
+    CameraPipeline(PicamContext& context, ConfigStore& config_store, GpioBackend& gpio, LineClient& line,
+                   FrameSource& source);
+
+    CameraPipeline(const CameraPipeline&) = delete;
+    CameraPipeline& operator=(const CameraPipeline&) = delete;
+
+    // カスケード分類機とフレームの入力元を開く
+    bool open(const ReplayOptions& replay_options);
+
+    // 監視ループ（赤ボタン・終了コマンド・映像の終わりで戻る）
+    void run();
+
+    // 録画中なら閉じて、カメラを解放する
+    void close();
+
+private:
+    // LINEからの制御コマンドを処理する（終了が要求されたらtrue）
+    bool handle_control_commands(const cv::Mat& frame, const AppConfig& live_config);
+
+    // 緑ボタンで監視状態を切り替える（監視中 ⇄ 監視停止中）
+    void toggle_monitoring(const AppConfig& live_config);
+
+    PicamContext& context_;
+    ConfigStore& config_store_;
+    GpioBackend& gpio_;
+    LineClient& line_;
+    FrameSource& source_;
+    std::shared_ptr<const ConfigSnapshot> startup_config_; // 起動時にしか反映できない値に使う
+
+    FaceDetector detector_;
+    Recorder recorder_;
+    IncidentPolicy incident_policy_; // 録画と通知の制御（検知イベントをインシデント単位にまとめる）
+    double fps_ = 0.0;
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+// 同時実行数の上限を管理するクラス
+// HTTPのルートごとに用意し、上限を超えたリクエストは待たせずにすぐ断る
+class ConcurrencyLimiter {
+public:
+    explicit ConcurrencyLimiter(int limit = 0) : limit_(limit) {}
+
+    void set_limit(int limit) { limit_.store(limit); }
+    int limit() const { return limit_.load(); }
+    int active() const { return active_.load(); }
+
+    // 空きがあれば1枠確保してtrueを返す
+    bool try_acquire() {
+        int current = active_.load();
+        while (current < limit_.load()) {
+            if (active_.compare_exchange_weak(current, current + 1)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void release() { active_.fetch_sub(1); }
+
+private:
+    std::atomic<int> limit_;
+    std::atomic<int> active_{0};
+};
+
+// 確保した枠を破棄時に返却するハンドル
+// レスポンスの送信が終わるまで枠を保持するため、shared_ptrで送信処理に渡せるようにしている
+class ConcurrencySlot {
+public:
+    ConcurrencySlot(ConcurrencyLimiter& route, ConcurrencyLimiter& shared)
+        : route_(route), shared_(shared) {}
+
+    ~ConcurrencySlot() {
+        route_.release();
+        shared_.release();
+    }
+
+    // ルートの枠と共有の枠を両方確保できた場合のみハンドルを返す
+    static std::shared_ptr<ConcurrencySlot> acquire(ConcurrencyLimiter& route, ConcurrencyLimiter& shared) {
+        if (!route.try_acquire()) {
+            return nullptr;
+        }
+        if (!shared.try_acquire()) {
+            route.release();
+            return nullptr;
+        }
+        return std::make_shared<ConcurrencySlot>(route, shared);
+    }
+
+    ConcurrencySlot(const ConcurrencySlot&) = delete;
+    ConcurrencySlot& operator=(const ConcurrencySlot&) = delete;
+
+private:
+    ConcurrencyLimiter& route_;
+    ConcurrencyLimiter& shared_;
+};
@@ -0,0 +1,207 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "app_config.h"
+#include "logger.h"
+
+// 設定ファイルを読み込んで、キーと値のmapを返す関数
+inline ConfigMap load_config(const std::string& filename) {
+    ConfigMap config;
+    std::ifstream file(filename);
+    std::string line;
+
+    if(!file.is_open()) {
+        log_error("設定ファイルを開けませんでした", {{"path", filename}});
+        return config;
+    }
+
+    while(std::getline(file, line)) {
+        // 空行やコメント（#で始まる行）はスキップ
+        if(line.empty() || line[0] == '#')
+            continue;
+
+        // =で分解し位置をposに格納、=が見つからずposがnposだったらスキップ
+        size_t pos = line.find('=');
+        if(pos == std::string::npos)
+            continue;
+
+        std::string key = line.substr(0, pos);
+        std::string value = line.substr(pos + 1);
+        config[key] = value;
+    }
+    return config;
+}
+
+// ある時点の設定（公開後は変更しない）
+struct ConfigSnapshot {
+    ConfigMap values; // ファイルの生の値
+    AppConfig app;    // 型付きの設定
+    uint64_t version = 0; // 読み込みに成功するたびに1増える
+    std::chrono::system_clock::time_point loaded_at;
+};
+
+// 設定ファイルを監視し、変更されたらparse_app_config()で検証してから差し替えるクラス
+//
+// 読み手はget()でその時点のスナップショットを受け取る。スナップショットはスレッドごとにキャッシュし、
+// バージョン（atomic）が変わっていなければキャッシュを返すのでロックを取らない
+// （差し替え直後の最初のget()だけmutexで取り直す）。取得したスナップショットは読み手が持っている間は有効
+class ConfigStore {
+public:
+    // require_lineがfalseなら（リプレイ）LINEのキーを必須にしない
+    explicit ConfigStore(std::string path, bool require_line = true)
+        : path_(std::move(path)), require_line_(require_line), id_(next_id().fetch_add(1) + 1) {}
+
+    ~ConfigStore() { stop_watching(); }
+
+    ConfigStore(const ConfigStore&) = delete;
+    ConfigStore& operator=(const ConfigStore&) = delete;
+
+    // ファイルを読み込み、検証に通れば公開する
+    bool reload() {
+        ConfigMap values = load_config(path_);
+        AppConfig app;
+        std::string error;
+        if (values.empty() && require_line_) {
+            error = "設定が空です";
+        } else if (!parse_app_config(values, app, error, require_line_)) {
+            // errorはparse_app_configが設定
+        } else {
+            auto snapshot = std::make_shared<ConfigSnapshot>();
+            snapshot->values = std::move(values);
+            snapshot->app = std::move(app);
+            snapshot->loaded_at = std::chrono::system_clock::now();
+            std::lock_guard<std::mutex> lock(mutex_);
+            snapshot->version = version_.load(std::memory_order_relaxed) + 1;
+            current_ = std::move(snapshot);
+            // current_を差し替えてからバージョンを公開する（読み手はこれを見てキャッシュを取り直す）
+            version_.store(current_->version, std::memory_order_release);
+            return true;
+        }
+        log_error("設定ファイルを反映しませんでした", {{"error", error}, {"path", path_}});
+        return false;
+    }
+
+    // 現在の設定
+    std::shared_ptr<const ConfigSnapshot> get() const {
+        // ストアの識別番号とバージョンが一致する間はキャッシュを返す
+        // （識別番号で比べるので、同じアドレスに作り直したストアの古い設定は返さない）
+        thread_local SnapshotCache cache;
+        uint64_t version = version_.load(std::memory_order_acquire);
+        if (cache.store_id != id_ || cache.version != version) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            cache.snapshot = current_;
+            cache.version = current_ ? current_->version : 0;
+            cache.store_id = id_;
+        }
+        return cache.snapshot;
+    }
+
+    uint64_t version() const { return version_.load(); }
+
+    // 設定ファイルの監視を開始する
+    // エディタは一時ファイルからの置き換えで保存することが多いため、ディレクトリごと監視する
+    bool start_watching() {
+        inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotify_fd_ < 0) {
+            log_warn("設定ファイルの監視を開始できませんでした");
+            return false;
+        }
+        std::string dir = ".";
+        size_t slash = path_.find_last_of('/');
+        if (slash != std::string::npos) {
+            dir = path_.substr(0, slash);
+            file_name_ = path_.substr(slash + 1);
+        } else {
+            file_name_ = path_;
+        }
+        if (inotify_add_watch(inotify_fd_, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+            log_warn("設定ファイルの監視を開始できませんでした", {{"dir", dir}});
+            close(inotify_fd_);
+            inotify_fd_ = -1;
+            return false;
+        }
+        watching_ = true;
+        watcher_ = std::thread(&ConfigStore::watch_loop, this);
+        return true;
+    }
+
+    void stop_watching() {
+        watching_ = false;
+        if (watcher_.joinable()) {
+            watcher_.join();
+        }
+        if (inotify_fd_ >= 0) {
+            close(inotify_fd_);
+            inotify_fd_ = -1;
+        }
+    }
+
+private:
+    struct SnapshotCache {
+        uint64_t store_id = 0;
+        uint64_t version = 0;
+        std::shared_ptr<const ConfigSnapshot> snapshot;
+    };
+
+    static std::atomic<uint64_t>& next_id() {
+        static std::atomic<uint64_t> id{0};
+        return id;
+    }
+
+    void watch_loop() {
+        alignas(inotify_event) char buffer[4096];
+        while (watching_) {
+            pollfd pfd{inotify_fd_, POLLIN, 0};
+            // 停止要求を確認するため、1秒ごとに起きる
+            if (poll(&pfd, 1, 1000) <= 0) {
+                continue;
+            }
+
+            bool changed = false;
+            ssize_t len;
+            while ((len = read(inotify_fd_, buffer, sizeof(buffer))) > 0) {
+                for (char* p = buffer; p < buffer + len;) {
+                    auto* event = reinterpret_cast<inotify_event*>(p);
+                    if (event->len > 0 && file_name_ == event->name) {
+                        changed = true;
+                    }
+                    p += sizeof(inotify_event) + event->len;
+                }
+            }
+
+            if (changed) {
+                // 連続した書き込みをまとめるため少し待ってから読み込む
+                std::this_thread::sleep_for(std::chrono::milliseconds(200));
+                while (read(inotify_fd_, buffer, sizeof(buffer)) > 0) {
+                }
+                if (reload()) {
+                    log_info("設定ファイルを再読み込みしました", {{"version", version()}});
+                }
+            }
+        }
+    }
+
+    std::string path_;
+    bool require_line_;
+    std::string file_name_;
+    const uint64_t id_; // スレッドごとのキャッシュがどのストアのものかを見分ける
+    mutable std::mutex mutex_; // current_を守る（読み手はバージョンが変わったときだけ取る）
+    std::shared_ptr<const ConfigSnapshot> current_;
+    std::atomic<uint64_t> version_{0}; // 公開済みのcurrent_のバージョン
+
+    int inotify_fd_ = -1;
+    std::atomic<bool> watching_{false};
+    std::thread watcher_;
+};
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+
+// Webhookスレッド → カメラスレッドへの制御コマンドの種類
+enum class ControlCommandType {
+    TakePhoto,     // 写真を撮影してLINEに送信
+    SetMonitoring, // 監視のON/OFFを切り替え
+    Shutdown       // プログラム終了
+};
+
+// 制御コマンド
+// on_completeで処理結果（成功/失敗）を要求元に返す（カメラスレッドか通知スレッドから1回だけ呼ばれる）
+struct ControlCommand {
+    ControlCommandType type = ControlCommandType::TakePhoto;
+    bool enable = false; // SetMonitoring用：trueで監視ON
+    std::function<void(bool ok)> on_complete;
+    std::chrono::steady_clock::time_point enqueued_at;
+};
+
+// コマンドの投入から実行までの遅延の統計
+struct ControlLatencyStats {
+    uint64_t count = 0;
+    double avg_ms = 0.0;
+    double max_ms = 0.0;
+    double last_ms = 0.0;
+};
+
+// 条件変数で待ち受けできる制御コマンドのキュー
+// フラグのポーリングと違い、push()した瞬間に待機中のスレッドが起床する
+class ControlQueue {
+public:
+    // コマンドを投入する。処理結果はon_completeで受け取る（要求元は結果を待たない）
+    void push(ControlCommandType type, bool enable = false, std::function<void(bool ok)> on_complete = {}) {
+        ControlCommand cmd;
+        cmd.type = type;
+        cmd.enable = enable;
+        cmd.on_complete = std::move(on_complete);
+        cmd.enqueued_at = std::chrono::steady_clock::now();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_.push_back(std::move(cmd));
+            pending_.store(queue_.size());
+        }
+        cv_.notify_all();
+    }
+
+    // コマンドがあれば取り出す（待たない）
+    bool try_pop(ControlCommand& out) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (queue_.empty()) {
+            return false;
+        }
+        out = std::move(queue_.front());
+        queue_.pop_front();
+        pending_.store(queue_.size());
+        return true;
+    }
+
+    // コマンドが届いているか（ロックを取らない。カメラスレッドが毎フレーム確かめる）
+    bool has_pending() const { return pending_.load() > 0; }
+
+    // コマンドが届くまで最大timeoutだけ待つ（取り出しはしない）
+    // 届いていればtrueを返す
+    bool wait_for(std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return cv_.wait_for(lock, timeout, [this] { return !queue_.empty(); });
+    }
+
+    // 投入から実行開始までの遅延を記録する
+    // 戻り値は今回の遅延（ミリ秒）
+    double record_latency(const ControlCommand& cmd) {
+        auto elapsed = std::chrono::steady_clock::now() - cmd.enqueued_at;
+        uint64_t us = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+
+        count_.fetch_add(1);
+        total_us_.fetch_add(us);
+        last_us_.store(us);
+        uint64_t prev_max = max_us_.load();
+        while (us > prev_max && !max_us_.compare_exchange_weak(prev_max, us)) {
+        }
+        return us / 1000.0;
+    }
+
+    // 遅延を記録し、処理結果を要求元に通知する
+    double complete(ControlCommand& cmd, bool ok) {
+        double latency_ms = record_latency(cmd);
+        if (cmd.on_complete) {
+            cmd.on_complete(ok);
+        }
+        return latency_ms;
+    }
+
+    ControlLatencyStats stats() const {
+        ControlLatencyStats s;
+        s.count = count_.load();
+        if (s.count > 0) {
+            s.avg_ms = total_us_.load() / 1000.0 / s.count;
+        }
+        s.max_ms = max_us_.load() / 1000.0;
+        s.last_ms = last_us_.load() / 1000.0;
+        return s;
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<ControlCommand> queue_;
+    std::atomic<size_t> pending_{0}; // queue_の長さ
+
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> total_us_{0};
+    std::atomic<uint64_t> max_us_{0};
+    std::atomic<uint64_t> last_us_{0};
+};
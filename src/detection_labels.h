@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+// 顔の正解ラベル（動画と同じ名前の .labels ファイル）
+//
+//   # <フレーム番号>[-<最後のフレーム番号>] <x> <y> <幅> <高さ>（元の解像度のピクセル座標）
+//   120-180 200 150 80 80
+//   181 205 152 78 80
+//
+// - フレーム番号は0から数える。書かれていないフレームには顔が映っていないものとして扱う
+// - detect_tuner の評価と、リプレイの --detections（検出機の代わりにラベルを検出結果として使う）で共有する
+class DetectionLabels {
+public:
+    // 読めない行があればfalseとerrorを返す
+    bool load(const std::string& path, std::string& error) {
+        faces_.clear();
+        std::ifstream ifs(path);
+        if (!ifs) {
+            error = "ラベルを開けません: " + path;
+            return false;
+        }
+        std::string line;
+        int line_no = 0;
+        while (std::getline(ifs, line)) {
+            line_no++;
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+            std::istringstream iss(line);
+            std::string frames;
+            cv::Rect box;
+            int first = 0;
+            int last = 0;
+            if (!(iss >> frames >> box.x >> box.y >> box.width >> box.height) || !parse_range(frames, first, last)) {
+                error = "ラベルを読めません: " + path + ":" + std::to_string(line_no);
+                return false;
+            }
+            for (int f = first; f <= last; f++) {
+                faces_[f].push_back(box);
+            }
+        }
+        return true;
+    }
+
+    // frameの正解の枠（顔がなければ空）
+    const std::vector<cv::Rect>& at(int frame) const {
+        static const std::vector<cv::Rect> no_faces;
+        auto it = faces_.find(frame);
+        return it != faces_.end() ? it->second : no_faces;
+    }
+
+    // 動画のファイル名に対応するラベルのファイル名（拡張子を .labels にする）
+    static std::string path_for(const std::string& video_path) {
+        std::string::size_type dot = video_path.find_last_of('.');
+        std::string::size_type slash = video_path.find_last_of('/');
+        if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+            return video_path + ".labels";
+        }
+        return video_path.substr(0, dot) + ".labels";
+    }
+
+private:
+    // "120" または "120-180"
+    static bool parse_range(const std::string& text, int& first, int& last) {
+        char* end = nullptr;
+        first = static_cast<int>(std::strtol(text.c_str(), &end, 10));
+        if (end == text.c_str() || first < 0) {
+            return false;
+        }
+        last = first;
+        if (*end == '-') {
+            const char* begin = end + 1;
+            last = static_cast<int>(std::strtol(begin, &end, 10));
+            if (end == begin || last < first) {
+                return false;
+            }
+        }
+        return *end == '\0';
+    }
+
+    std::map<int, std::vector<cv::Rect>> faces_; // フレーム番号 → 正解の枠
+};
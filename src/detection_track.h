@@ -0,0 +1,157 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "logger.h"
+#include "nlohmann/json.hpp"
+
+// 録画の検出結果のトラック（動画と同じ名前の .vtt に書くWebVTTのメタデータトラック）
+//
+// - 顔の枠は動画に描き込まず、時刻つきの検出結果としてこのファイルに残す（録画の映像は加工しない）
+// - 1つのキューが「この時間に映っていた顔の枠」で、本文は1行のJSON
+//     00:00:01.200 --> 00:00:01.533
+//     {"faces":[{"x":320,"y":180,"w":96,"h":96,"neighbors":7}]}
+// - 時刻は書き込んだフレーム数 / FPS で決めるので、動画の再生位置とずれない
+// - 顔の枠が変わるまでキューを延ばし、顔が映っていない間はキューを書かない
+// - <track kind="metadata"> でブラウザから読めるほか、/image?overlay=1 の枠の描画にも使う
+// （カメラスレッドからだけ呼ぶ。書き込みは検出を実行したフレームで枠が変わったときだけ）
+class DetectionTrack {
+public:
+    DetectionTrack() = default;
+    ~DetectionTrack() { close(0.0); }
+
+    DetectionTrack(const DetectionTrack&) = delete;
+    DetectionTrack& operator=(const DetectionTrack&) = delete;
+
+    // 動画のファイル名に対応するトラックのファイル名（拡張子を .vtt にする）
+    static std::string path_for(const std::string& video_path) {
+        std::string::size_type dot = video_path.find_last_of('.');
+        std::string::size_type slash = video_path.find_last_of('/');
+        if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+            return video_path + ".vtt";
+        }
+        return video_path.substr(0, dot) + ".vtt";
+    }
+
+    bool open(const std::string& path) {
+        close(0.0);
+        // 前の録画の枠を残すと、新しい録画の最初の枠が同じときにキューが書かれない
+        faces_.clear();
+        neighbors_.clear();
+        start_ = 0.0;
+        file_ = std::fopen(path.c_str(), "w");
+        if (file_ == nullptr) {
+            log_error("[DetectionTrack] ファイルを開けませんでした", {{"path", path}});
+            return false;
+        }
+        std::fputs("WEBVTT\n", file_);
+        return true;
+    }
+
+    // seconds（動画の先頭からの秒数）以降の検出結果を記録する
+    // 前の枠と同じならキューを延ばすだけで、何も書かない
+    void add(double seconds, const std::vector<cv::Rect>& faces, const std::vector<int>& neighbors) {
+        if (file_ == nullptr || (faces == faces_ && neighbors == neighbors_)) {
+            return;
+        }
+        flush(seconds);
+        faces_ = faces; // 容量が足りていれば確保しない
+        neighbors_ = neighbors;
+        start_ = seconds;
+    }
+
+    // 最後のキューをseconds（録画の長さ）で閉じて、ファイルを閉じる
+    void close(double seconds) {
+        if (file_ == nullptr) {
+            return;
+        }
+        flush(seconds);
+        std::fclose(file_);
+        file_ = nullptr;
+    }
+
+    bool is_open() const { return file_ != nullptr; }
+
+    // トラックからseconds時点のキューの顔の枠を読む（Webサーバーから呼ぶ）
+    // キューがなければ（顔が映っていなければ）facesは空のまま。ファイルが読めなければfalse
+    static bool read_at(const std::string& path, double seconds, std::vector<cv::Rect>& faces) {
+        faces.clear();
+        std::ifstream ifs(path);
+        if (!ifs) {
+            return false;
+        }
+        std::string line;
+        while (std::getline(ifs, line)) {
+            double start = 0.0;
+            double end = 0.0;
+            if (!parse_timing(line, start, end)) {
+                continue;
+            }
+            if (!std::getline(ifs, line)) {
+                break;
+            }
+            if (seconds < start || seconds >= end) {
+                continue;
+            }
+            nlohmann::json cue = nlohmann::json::parse(line, nullptr, false);
+            if (cue.is_discarded() || !cue.contains("faces") || !cue["faces"].is_array()) {
+                return true;
+            }
+            for (const auto& face : cue["faces"]) {
+                faces.emplace_back(face.value("x", 0), face.value("y", 0), face.value("w", 0), face.value("h", 0));
+            }
+            return true;
+        }
+        return true;
+    }
+
+private:
+    // 保留中のキュー（[start_, end)に映っていた枠）を書き出す
+    void flush(double end) {
+        if (faces_.empty() || end <= start_) {
+            return;
+        }
+        std::fputc('\n', file_);
+        write_time(start_);
+        std::fputs(" --> ", file_);
+        write_time(end);
+        std::fputs("\n{\"faces\":[", file_);
+        for (size_t i = 0; i < faces_.size(); i++) {
+            const cv::Rect& face = faces_[i];
+            int n = i < neighbors_.size() ? neighbors_[i] : 0;
+            std::fprintf(file_, "%s{\"x\":%d,\"y\":%d,\"w\":%d,\"h\":%d,\"neighbors\":%d}",
+                         i > 0 ? "," : "", face.x, face.y, face.width, face.height, n);
+        }
+        std::fputs("]}\n", file_);
+    }
+
+    // HH:MM:SS.mmm
+    void write_time(double seconds) {
+        int64_t ms = static_cast<int64_t>(seconds * 1000.0 + 0.5);
+        std::fprintf(file_, "%02lld:%02lld:%02lld.%03lld",
+                     static_cast<long long>(ms / 3600000), static_cast<long long>(ms / 60000 % 60),
+                     static_cast<long long>(ms / 1000 % 60), static_cast<long long>(ms % 1000));
+    }
+
+    // "HH:MM:SS.mmm --> HH:MM:SS.mmm" の行なら時刻を秒で返す
+    static bool parse_timing(const std::string& line, double& start, double& end) {
+        unsigned h1, m1, s1, ms1, h2, m2, s2, ms2;
+        if (std::sscanf(line.c_str(), "%u:%u:%u.%u --> %u:%u:%u.%u", &h1, &m1, &s1, &ms1, &h2, &m2, &s2, &ms2) != 8) {
+            return false;
+        }
+        start = h1 * 3600.0 + m1 * 60.0 + s1 + ms1 / 1000.0;
+        end = h2 * 3600.0 + m2 * 60.0 + s2 + ms2 / 1000.0;
+        return true;
+    }
+
+    std::FILE* file_ = nullptr;
+    std::vector<cv::Rect> faces_;   // 保留中のキューの枠
+    std::vector<int> neighbors_;
+    double start_ = 0.0;            // 保留中のキューの開始時刻
+};
@@ -0,0 +1,325 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef> // offsetof
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h> // truncate
+
+#include "logger.h"
+
+// 録画1件（イベント）の情報
+struct EventRecord {
+    uint64_t id = 0;          // 1から始まる通し番号
+    uint64_t incident = 0;    // 属するインシデントの番号（同じインシデントの録画は同じ値）
+    int64_t start_ms = 0;     // 録画開始（UNIX時間、ミリ秒）
+    int64_t end_ms = 0;       // 録画終了（録画中は0）
+    uint32_t max_faces = 0;   // 1フレームに映った顔の最大数
+    uint32_t face_frames = 0; // 顔を検出したフレーム数（検出を実行したフレームのみ）
+    float peak_confidence = 0.0f; // 検出の確からしさの最大値（detectMultiScaleの近傍矩形の数）
+    uint64_t video_bytes = 0;
+    uint64_t photo_bytes = 0;
+    std::string video_file;   // 動画のファイル名（/video?file=。保存ファイルの整理で削除されたら空）
+    std::string photo_file;   // サムネイルのファイル名（/image?file=。同上）
+
+    bool open() const { return end_ms == 0; }
+    int64_t duration_ms() const { return open() ? 0 : end_ms - start_ms; }
+};
+
+// ページングの位置（このイベントより前から続きを返す）
+struct EventCursor {
+    int64_t start_ms = std::numeric_limits<int64_t>::max();
+    uint64_t id = std::numeric_limits<uint64_t>::max();
+};
+
+// 録画イベントの索引（追記専用のバイナリファイル + メモリ上の配列）
+//
+// - 1レコードは固定長（160バイト）でCRC32つき。録画の開始時と終了時に同じidのレコードを追記し、
+//   読み込み時は後のレコードで上書きする（録画中に電源が落ちても開始時点の情報は残る）
+// - 書き込み途中で途切れた末尾のレコードは、起動時にCRCで検出して切り捨てる
+// - 起動時に全件をメモリに読み込み、検索は開始時刻の二分探索だけで行う（動画・画像ファイルには触れない）
+// - 並び順は（開始時刻, id）。ページングのカーソルもこの組で表す
+class EventIndex {
+public:
+    explicit EventIndex(std::string path) : path_(std::move(path)) {}
+
+    ~EventIndex() { close(); }
+
+    EventIndex(const EventIndex&) = delete;
+    EventIndex& operator=(const EventIndex&) = delete;
+
+    // ファイルを読み込み、追記用に開く
+    bool open() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        load();
+        file_ = std::fopen(path_.c_str(), "ab");
+        if (file_ == nullptr) {
+            log_error("[EventIndex] ファイルを開けませんでした", {{"path", path_}});
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (file_) {
+            std::fclose(file_);
+            file_ = nullptr;
+        }
+    }
+
+    // 新しいイベントを登録し、idを返す
+    uint64_t begin_event(EventRecord record) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        record.id = ++last_id_;
+        record.end_ms = 0;
+        store(record);
+        return record.id;
+    }
+
+    // 既存のイベントを更新する（録画終了時など）
+    bool update_event(const EventRecord& record) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (by_id_.count(record.id) == 0) {
+            return false;
+        }
+        store(record);
+        return true;
+    }
+
+    // 保存ファイルの整理で削除されたファイルをイベントから外す（ファイル名とサイズを空にしたレコードを追記する）
+    // 削除されるのは古いファイルなので、古いイベントから探す
+    bool file_deleted(const std::string& file_name) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        bool found = false;
+        for (size_t i = 0; i < records_.size(); i++) {
+            if (records_[i].video_file != file_name && records_[i].photo_file != file_name) {
+                continue;
+            }
+            EventRecord record = records_[i];
+            if (record.video_file == file_name) {
+                record.video_file.clear();
+                record.video_bytes = 0;
+            }
+            if (record.photo_file == file_name) {
+                record.photo_file.clear();
+                record.photo_bytes = 0;
+            }
+            store(record); // 同じidなので並び順は変わらない
+            found = true;
+        }
+        return found;
+    }
+
+    bool get(uint64_t id, EventRecord& out) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = by_id_.find(id);
+        if (it == by_id_.end()) {
+            return false;
+        }
+        out = records_[it->second];
+        return true;
+    }
+
+    // 開始時刻が [from_ms, to_ms) で、beforeより前のイベントを新しい順に最大limit件返す
+    // 続きがあればhas_moreをtrueにする（次のページは最後のイベントをbeforeに指定する）
+    std::vector<EventRecord> query(int64_t from_ms, int64_t to_ms, size_t limit,
+                                   const EventCursor& before = EventCursor(), bool* has_more = nullptr) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<EventRecord> result;
+        auto by_start = [](const EventRecord& r, int64_t t) { return r.start_ms < t; };
+        auto first = std::lower_bound(records_.begin(), records_.end(), from_ms, by_start);
+        auto last = std::lower_bound(first, records_.end(), to_ms, by_start);
+        auto cursor = std::lower_bound(first, last, before, [](const EventRecord& r, const EventCursor& c) {
+            return r.start_ms < c.start_ms || (r.start_ms == c.start_ms && r.id < c.id);
+        });
+        auto it = cursor;
+        for (; it != first && result.size() < limit;) {
+            --it;
+            result.push_back(*it);
+        }
+        if (has_more) {
+            *has_more = (it != first);
+        }
+        return result;
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return records_.size();
+    }
+
+    // 書き込みのたびに増える（応答のキャッシュの無効化に使う）
+    uint64_t version() const { return version_.load(); }
+
+    static constexpr size_t NAME_MAX_LEN = 39; // ファイル名の最大長（"YYYY_MM_DD--HH_MM_SS.mp4" は24文字）
+
+private:
+    static constexpr uint32_t MAGIC = 0x31564550; // "PEV1"
+
+    // ファイル上のレコード
+    struct DiskRecord {
+        uint32_t magic;
+        uint32_t reserved;
+        uint64_t id;
+        uint64_t incident;
+        int64_t start_ms;
+        int64_t end_ms;
+        uint32_t max_faces;
+        uint32_t face_frames;
+        float peak_confidence;
+        uint32_t reserved2;
+        uint64_t video_bytes;
+        uint64_t photo_bytes;
+        char video_file[NAME_MAX_LEN + 1];
+        char photo_file[NAME_MAX_LEN + 1];
+        uint32_t crc; // crcより前の全バイトのCRC32
+        uint32_t reserved3;
+    };
+    static_assert(sizeof(DiskRecord) == 160, "DiskRecordは固定長");
+    static_assert(std::is_trivially_copyable<DiskRecord>::value, "DiskRecordはmemcpyで読み書きする");
+
+    // 以下はmutex_を持った状態で呼ぶ
+
+    void load() {
+        records_.clear();
+        by_id_.clear();
+        FILE* in = std::fopen(path_.c_str(), "rb");
+        if (in == nullptr) {
+            return; // 初回起動
+        }
+        DiskRecord disk;
+        long valid_bytes = 0;
+        size_t loaded = 0;
+        while (std::fread(&disk, sizeof(disk), 1, in) == 1) {
+            if (disk.magic != MAGIC || disk.crc != crc32(&disk, offsetof(DiskRecord, crc))) {
+                break; // 壊れたレコード以降は捨てる
+            }
+            apply(from_disk(disk));
+            valid_bytes += static_cast<long>(sizeof(disk));
+            loaded++;
+        }
+        std::fclose(in);
+
+        struct stat st;
+        if (stat(path_.c_str(), &st) == 0 && st.st_size > valid_bytes) {
+            log_warn("[EventIndex] 末尾の壊れたレコードを切り捨てます", {{"bytes", st.st_size - valid_bytes}});
+            if (truncate(path_.c_str(), valid_bytes) != 0) {
+                log_error("[EventIndex] 切り捨てに失敗しました", {{"path", path_}});
+            }
+        }
+        log_info("[EventIndex] イベントを読み込みました", {{"events", records_.size()}, {"records", loaded}});
+    }
+
+    // ファイルに追記してからメモリに反映する
+    // （fdatasyncはしない。電源断で失うのは直近のレコードだけで、CRCで検出できる）
+    void store(const EventRecord& record) {
+        if (file_) {
+            DiskRecord disk = to_disk(record);
+            std::fwrite(&disk, sizeof(disk), 1, file_);
+            std::fflush(file_);
+        }
+        apply(record);
+        version_.fetch_add(1);
+    }
+
+    void apply(const EventRecord& record) {
+        last_id_ = std::max(last_id_, record.id);
+        auto it = by_id_.find(record.id);
+        if (it != by_id_.end()) {
+            records_[it->second] = record;
+            return;
+        }
+        // 通常は開始時刻の順に追記されるので末尾に入る（時計が戻った場合だけ挿入位置を探す）
+        auto before = [](const EventRecord& a, const EventRecord& b) {
+            return a.start_ms < b.start_ms || (a.start_ms == b.start_ms && a.id < b.id);
+        };
+        if (!records_.empty() && before(record, records_.back())) {
+            auto pos = std::upper_bound(records_.begin(), records_.end(), record, before);
+            records_.insert(pos, record);
+            by_id_.clear();
+            for (size_t i = 0; i < records_.size(); i++) {
+                by_id_[records_[i].id] = i;
+            }
+            return;
+        }
+        by_id_[record.id] = records_.size();
+        records_.push_back(record);
+    }
+
+    static DiskRecord to_disk(const EventRecord& r) {
+        DiskRecord d;
+        std::memset(&d, 0, sizeof(d));
+        d.magic = MAGIC;
+        d.id = r.id;
+        d.incident = r.incident;
+        d.start_ms = r.start_ms;
+        d.end_ms = r.end_ms;
+        d.max_faces = r.max_faces;
+        d.face_frames = r.face_frames;
+        d.peak_confidence = r.peak_confidence;
+        d.video_bytes = r.video_bytes;
+        d.photo_bytes = r.photo_bytes;
+        std::strncpy(d.video_file, r.video_file.c_str(), NAME_MAX_LEN);
+        std::strncpy(d.photo_file, r.photo_file.c_str(), NAME_MAX_LEN);
+        d.crc = crc32(&d, offsetof(DiskRecord, crc));
+        return d;
+    }
+
+    static EventRecord from_disk(const DiskRecord& d) {
+        EventRecord r;
+        r.id = d.id;
+        r.incident = d.incident;
+        r.start_ms = d.start_ms;
+        r.end_ms = d.end_ms;
+        r.max_faces = d.max_faces;
+        r.face_frames = d.face_frames;
+        r.peak_confidence = d.peak_confidence;
+        r.video_bytes = d.video_bytes;
+        r.photo_bytes = d.photo_bytes;
+        r.video_file.assign(d.video_file, strnlen(d.video_file, sizeof(d.video_file)));
+        r.photo_file.assign(d.photo_file, strnlen(d.photo_file, sizeof(d.photo_file)));
+        return r;
+    }
+
+    // CRC32（IEEE 802.3）
+    static uint32_t crc32(const void* data, size_t len) {
+        static const auto table = [] {
+            std::array<uint32_t, 256> t{};
+            for (uint32_t i = 0; i < 256; i++) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; k++) {
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                }
+                t[i] = c;
+            }
+            return t;
+        }();
+        uint32_t crc = 0xFFFFFFFFu;
+        const auto* p = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < len; i++) {
+            crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+        }
+        return crc ^ 0xFFFFFFFFu;
+    }
+
+    std::string path_;
+    FILE* file_ = nullptr;
+
+    mutable std::mutex mutex_;
+    std::vector<EventRecord> records_; // 開始時刻の順
+    std::unordered_map<uint64_t, size_t> by_id_; // id → records_の位置
+    uint64_t last_id_ = 0;
+    std::atomic<uint64_t> version_{0};
+};
@@ -0,0 +1,31 @@
+#include "face_detector.h"
+
+#include "metrics.h"
+
+void FaceDetector::detect(const cv::Mat& frame, const DetectionParams& params, std::vector<cv::Rect>& faces,
+                          std::vector<int>& neighbors) {
+
+    // 解像度を縮小（デフォルトは半分）
+    const double downscale = params.downscale;
+    {
+        ScopedTimer timer(metrics_.preprocess_seconds, "preprocess");
+        cv::resize(frame, small_frame_, cv::Size(), downscale, downscale);
+        cv::cvtColor(small_frame_, gray_frame_, cv::COLOR_BGR2GRAY);
+    }
+
+    // 検出のパラメータを厳しめに設定（デフォルト：minNeighbors=7, minSize=30x30）
+    {
+        ScopedTimer timer(metrics_.detect_seconds, "detect");
+        classifier_.detectMultiScale(gray_frame_, faces, neighbors, params.scale_factor, params.min_neighbors, 0,
+                                     cv::Size(params.min_size, params.min_size));
+    }
+    metrics_.detections_total.add();
+
+    // 検出結果の座標を元画像サイズに戻す
+    for (auto& face : faces) {
+        face.x = static_cast<int>(face.x / downscale);
+        face.y = static_cast<int>(face.y / downscale);
+        face.width = static_cast<int>(face.width / downscale);
+        face.height = static_cast<int>(face.height / downscale);
+    }
+}
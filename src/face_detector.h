@@ -0,0 +1,46 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "app_config.h"
+#include "pipeline_metrics.h"
+
+// 顔検出のパラメーター（設定ファイルのDETECTION_*）
+struct DetectionParams {
+    double downscale = 0.5;    // 検出前の縮小率
+    double scale_factor = 1.1;
+    int min_neighbors = 7;
+    int min_size = 30;         // 縮小後の画像での最小サイズ（ピクセル）
+
+    static DetectionParams from_config(const AppConfig& config) {
+        DetectionParams params;
+        params.downscale = config.detection_downscale;
+        params.scale_factor = config.detection_scale_factor;
+        params.min_neighbors = config.detection_min_neighbors;
+        params.min_size = config.detection_min_size;
+        return params;
+    }
+};
+
+// Haarカスケードによる顔検出
+// 縮小・グレースケール変換してから検出し、結果の座標を元の画像サイズに戻す
+// （作業用の画像は使い回すので、1つのスレッドからだけ呼ぶ）
+class FaceDetector {
+public:
+    explicit FaceDetector(PipelineMetrics& metrics) : metrics_(metrics) {}
+
+    bool load(const std::string& cascade_path) { return classifier_.load(cascade_path); }
+
+    // 顔の矩形と、顔ごとの近傍矩形の数（検出の確からしさ）を返す
+    void detect(const cv::Mat& frame, const DetectionParams& params, std::vector<cv::Rect>& faces,
+                std::vector<int>& neighbors);
+
+private:
+    PipelineMetrics& metrics_;
+    cv::CascadeClassifier classifier_;
+    cv::Mat small_frame_;
+    cv::Mat gray_frame_;
+};
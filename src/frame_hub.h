@@ -0,0 +1,232 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "frame_pool.h"
+
+// ライブ映像の統計
+struct FrameHubStats {
+    int viewers = 0;
+    uint64_t published = 0;  // カメラスレッドから受け取ったフレーム数
+    uint64_t encoded = 0;    // JPEGに変換したフレーム数（視聴者数によらない）
+    uint64_t dropped = 0;    // 変換が追いつかず上書きされたフレーム数
+    double avg_encode_ms = 0.0;
+};
+
+// カメラのフレームをライブ映像の視聴者に配るクラス
+//
+// - 視聴者がいるときだけ、max_fpsを超えない間隔でカメラスレッドからフレームを受け取る
+// - JPEGへの変換は専用スレッドで1フレームにつき1回だけ行い、全視聴者が同じデータを共有する
+//   （視聴者が1人でも10人でも変換の負荷は変わらない）
+// - 変換が追いつかない場合は古いフレームを捨て、常に最新のフレームを変換する
+// - フレームはコピーせずにプールのRefで受け取り、JPEGのバッファも視聴者が手放したものを使い回す
+// - 顔の枠はカメラのフレームには描かず、変換スレッドが配信用の画像にだけ描く
+class FrameHub {
+public:
+    struct Params {
+        int max_fps = 5;
+        int width = 640;   // 配信する幅（0ならカメラの解像度のまま）
+        int jpeg_quality = 70;
+    };
+
+    // 変換済みの1フレーム
+    struct Frame {
+        uint64_t seq = 0;
+        std::shared_ptr<const std::vector<unsigned char>> jpeg;
+    };
+
+    // 視聴者の登録（破棄されると登録が外れる）
+    class Viewer {
+    public:
+        explicit Viewer(FrameHub* hub) : hub_(hub) {}
+        ~Viewer() { hub_->viewers_.fetch_sub(1); }
+        Viewer(const Viewer&) = delete;
+        Viewer& operator=(const Viewer&) = delete;
+
+    private:
+        FrameHub* hub_;
+    };
+
+    explicit FrameHub(const Params& params) : params_(params) {}
+
+    ~FrameHub() { stop(); }
+
+    FrameHub(const FrameHub&) = delete;
+    FrameHub& operator=(const FrameHub&) = delete;
+
+    void start() {
+        running_ = true;
+        encoder_ = std::thread(&FrameHub::run, this);
+    }
+
+    // 変換スレッドを終了し、待っている視聴者を起こす
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            running_ = false;
+            input_.reset(); // プールより先にFrameHubが破棄されてもよいよう、フレームを返しておく
+            has_input_ = false;
+        }
+        input_cv_.notify_all();
+        output_cv_.notify_all();
+        if (encoder_.joinable()) {
+            encoder_.join();
+        }
+    }
+
+    // 視聴者として登録する（視聴者数の上限はHTTP側のConcurrencyLimiterで管理する）
+    std::shared_ptr<Viewer> add_viewer() {
+        viewers_.fetch_add(1);
+        return std::make_shared<Viewer>(this);
+    }
+
+    // このフレームを渡すべきか（視聴者がいて、前回から1/max_fps秒以上経っている）
+    // カメラスレッドはtrueのときだけpublish()を呼ぶ
+    bool wanted(std::chrono::steady_clock::time_point now) const {
+        return viewers_.load() > 0 && now >= next_publish_;
+    }
+
+    // カメラスレッドからフレームと顔の枠を受け取る（Refを預かるだけで、コピーも変換の待ちもしない）
+    // 受け取ったフレームは変換が終わるまで書き換えないこと
+    void publish(FramePool::Ref frame, const std::vector<cv::Rect>& faces, std::chrono::steady_clock::time_point now) {
+        next_publish_ = now + std::chrono::milliseconds(1000 / std::max(1, params_.max_fps));
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (has_input_) {
+                dropped_++;
+            }
+            input_ = std::move(frame); // 変換されなかった前のフレームはここでプールに戻る
+            input_faces_ = faces;      // 容量が足りていれば確保しない
+            has_input_ = true;
+            published_++;
+        }
+        input_cv_.notify_one();
+    }
+
+    // after_seqより新しいフレームを最大timeoutだけ待つ
+    bool wait_next(uint64_t after_seq, std::chrono::milliseconds timeout, Frame& out) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!output_cv_.wait_for(lock, timeout, [&] { return !running_ || latest_.seq > after_seq; })) {
+            return false;
+        }
+        if (latest_.seq <= after_seq) {
+            return false; // 停止
+        }
+        out = latest_;
+        return true;
+    }
+
+    FrameHubStats stats() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        FrameHubStats s;
+        s.viewers = viewers_.load();
+        s.published = published_;
+        s.encoded = encoded_;
+        s.dropped = dropped_;
+        if (encoded_ > 0) {
+            s.avg_encode_ms = total_encode_ms_ / encoded_;
+        }
+        return s;
+    }
+
+private:
+    void run() {
+        FramePool::Ref work;
+        std::vector<cv::Rect> faces;
+        cv::Mat scaled;
+        const std::vector<int> encode_params = {cv::IMWRITE_JPEG_QUALITY, params_.jpeg_quality};
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            input_cv_.wait(lock, [this] { return has_input_ || !running_; });
+            if (!running_) {
+                return;
+            }
+            // 入力を取り出してロックを手放す（カメラスレッドは次のフレームを書き込める）
+            work = std::move(input_);
+            faces.swap(input_faces_);
+            has_input_ = false;
+            lock.unlock();
+
+            auto begin = std::chrono::steady_clock::now();
+            const cv::Mat* source = &work.mat();
+            double scale = 1.0;
+            if (params_.width > 0 && source->cols > params_.width) {
+                scale = static_cast<double>(params_.width) / source->cols;
+                cv::resize(*source, scaled, cv::Size(), scale, scale, cv::INTER_AREA);
+                source = &scaled;
+            }
+
+            // 顔を赤枠で囲む（プールのフレームは共有なので、縮小していなければコピーに描く）
+            if (!faces.empty()) {
+                if (source != &scaled) {
+                    source->copyTo(scaled);
+                    source = &scaled;
+                }
+                for (const cv::Rect& face : faces) {
+                    cv::Rect box(cvRound(face.x * scale), cvRound(face.y * scale),
+                                 cvRound(face.width * scale), cvRound(face.height * scale));
+                    cv::rectangle(scaled, box, cv::Scalar(0, 0, 255), 2);
+                }
+            }
+
+            // 前のフレームのバッファを誰も持っていなければ使い回す（容量が足りていれば確保しない）
+            // latest_から外したバッファは新たにコピーされないので、use_count() == 1 なら変換スレッドだけが持っている
+            // use_count()はrelaxedで読まれるため、視聴者が参照を手放す前の読み出しが書き換えより先に終わるよう
+            // acquireのフェンスを置く（参照カウントの減算はacq_relなので、このフェンスと同期する）
+            std::shared_ptr<std::vector<unsigned char>> jpeg;
+            if (spare_jpeg_ && spare_jpeg_.use_count() == 1) {
+                std::atomic_thread_fence(std::memory_order_acquire);
+                jpeg = std::move(spare_jpeg_);
+            } else {
+                jpeg = std::make_shared<std::vector<unsigned char>>();
+            }
+            bool ok = cv::imencode(".jpg", *source, *jpeg, encode_params);
+            work.reset(); // 変換が終わったらすぐにプールに戻す
+            double elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+
+            lock.lock();
+            if (ok) {
+                latest_.seq++;
+                spare_jpeg_ = std::move(latest_buffer_);
+                latest_buffer_ = jpeg;
+                latest_.jpeg = std::move(jpeg);
+                encoded_++;
+                total_encode_ms_ += elapsed_ms;
+            }
+            output_cv_.notify_all();
+        }
+    }
+
+    Params params_;
+    std::atomic<int> viewers_{0};
+    std::chrono::steady_clock::time_point next_publish_; // カメラスレッドのみが触る
+
+    mutable std::mutex mutex_;
+    std::condition_variable input_cv_;
+    std::condition_variable output_cv_;
+    bool running_ = false;
+    std::thread encoder_;
+
+    FramePool::Ref input_;
+    std::vector<cv::Rect> input_faces_;
+    bool has_input_ = false;
+    Frame latest_;
+    std::shared_ptr<std::vector<unsigned char>> latest_buffer_; // latest_.jpegと同じバッファ（書き込める型で持つ）
+    std::shared_ptr<std::vector<unsigned char>> spare_jpeg_;    // 1つ前のバッファ（視聴者が手放せば使い回す）
+
+    uint64_t published_ = 0;
+    uint64_t encoded_ = 0;
+    uint64_t dropped_ = 0;
+    double total_encode_ms_ = 0.0;
+};
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+// フレームバッファのプールの統計
+struct FramePoolStats {
+    size_t slots = 0;         // 確保済みのスロット数
+    size_t in_use = 0;        // 使用中のスロット数
+    uint64_t acquired = 0;    // acquire()の回数
+    uint64_t grown = 0;       // 空きがなく、スロットを追加した回数
+    uint64_t reallocated = 0; // 返却時にバッファが作り直されていた回数（解像度や型が変わった）
+};
+
+// カメラのフレームを入れるバッファのプール
+//
+// - 起動時にカメラの解像度で決まった数のスロットを確保し、以降はフレームごとに使い回す
+//   （24時間動かし続けても、フレームごとのメモリ確保・解放でヒープが断片化しない）
+// - Refは参照カウント付きのハンドルで、最後のRefが破棄されるとスロットがプールに戻る
+//   カメラスレッド・ライブ映像の変換スレッドなど、フレームを受け渡す段階はコピーせずにRefを渡す
+// - 空きがなければスロットを追加する（定常状態では増えない。増えるならスロット数が足りない）
+class FramePool {
+    struct Slot {
+        cv::Mat mat;
+        const unsigned char* data = nullptr; // 確保したときのバッファ（作り直しの検出用）
+        std::atomic<int> refs{0};
+    };
+
+public:
+    class Ref {
+    public:
+        Ref() = default;
+        Ref(const Ref& other) : pool_(other.pool_), slot_(other.slot_) {
+            if (slot_) {
+                slot_->refs.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        Ref(Ref&& other) noexcept : pool_(other.pool_), slot_(other.slot_) {
+            other.pool_ = nullptr;
+            other.slot_ = nullptr;
+        }
+        Ref& operator=(Ref other) noexcept {
+            std::swap(pool_, other.pool_);
+            std::swap(slot_, other.slot_);
+            return *this;
+        }
+        ~Ref() { reset(); }
+
+        void reset() {
+            if (slot_ && slot_->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                pool_->release(slot_);
+            }
+            pool_ = nullptr;
+            slot_ = nullptr;
+        }
+
+        explicit operator bool() const { return slot_ != nullptr; }
+
+        // フレームの画像（書き込むのは最初に受け取った段階だけにし、他の段階に渡した後は読むだけにする）
+        cv::Mat& mat() const { return slot_->mat; }
+
+    private:
+        friend class FramePool;
+        Ref(FramePool* pool, Slot* slot) : pool_(pool), slot_(slot) {}
+
+        FramePool* pool_ = nullptr;
+        Slot* slot_ = nullptr;
+    };
+
+    explicit FramePool(size_t slots) {
+        for (size_t i = 0; i < slots; i++) {
+            add_slot();
+        }
+    }
+
+    FramePool(const FramePool&) = delete;
+    FramePool& operator=(const FramePool&) = delete;
+
+    // 空いているスロットにこの解像度・型のバッファを確保する（カメラを開いたときに1回だけ呼ぶ）
+    void reserve(cv::Size size, int type) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_ = size;
+        type_ = type;
+        for (Slot* slot : free_) {
+            slot->mat.create(size, type);
+            slot->data = slot->mat.data;
+        }
+    }
+
+    // 空いているスロットを取り出す（空きがなければ追加する）
+    Ref acquire() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (free_.empty()) {
+            add_slot();
+            grown_++;
+        }
+        Slot* slot = free_.back();
+        free_.pop_back();
+        slot->refs.store(1, std::memory_order_relaxed);
+        acquired_++;
+        return Ref(this, slot);
+    }
+
+    FramePoolStats stats() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        FramePoolStats s;
+        s.slots = slots_.size();
+        s.in_use = slots_.size() - free_.size();
+        s.acquired = acquired_;
+        s.grown = grown_;
+        s.reallocated = reallocated_;
+        return s;
+    }
+
+private:
+    // mutex_を取った状態で呼ぶ（コンストラクタは除く）
+    void add_slot() {
+        auto slot = std::make_unique<Slot>();
+        if (!size_.empty()) {
+            slot->mat.create(size_, type_);
+            slot->data = slot->mat.data;
+        }
+        free_.reserve(slots_.size() + 1); // release()でメモリを確保しないよう、全スロット分を確保しておく
+        free_.push_back(slot.get());
+        slots_.push_back(std::move(slot));
+    }
+
+    void release(Slot* slot) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (slot->mat.data != slot->data) {
+            // 書き込んだ段階がcreate()で作り直した（以降は新しいバッファを使い回す）
+            reallocated_++;
+            slot->data = slot->mat.data;
+        }
+        free_.push_back(slot);
+    }
+
+    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<Slot>> slots_;
+    std::vector<Slot*> free_;
+    cv::Size size_;
+    int type_ = 0;
+    uint64_t acquired_ = 0;
+    uint64_t grown_ = 0;
+    uint64_t reallocated_ = 0;
+};
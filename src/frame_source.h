@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+
+#include <opencv2/opencv.hpp>
+
+// カメラスレッドが読むフレームの入力元
+// 実機はカメラのGStreamerパイプライン、リプレイは動画ファイルや連番画像から読む
+// （テストではファイルから読み込んだフレームを渡す入力元に差し替える）
+class FrameSource {
+public:
+    virtual ~FrameSource() = default;
+
+    virtual bool open() = 0;
+
+    // frameのバッファに次のフレームを読み込む（映像の終わりや失敗ならfalse）
+    virtual bool read(cv::Mat& frame) = 0;
+
+    // 解像度とFPS（取れなければ空 / 0）
+    virtual cv::Size frame_size() = 0;
+    virtual double fps() = 0;
+
+    virtual void release() = 0;
+};
+
+// cv::VideoCaptureで読む入力元
+class VideoCaptureSource : public FrameSource {
+public:
+    // sourceはGStreamerのパイプライン、動画ファイル、連番画像のパターン（frames/%04d.jpg）
+    explicit VideoCaptureSource(std::string source, int api_preference = cv::CAP_ANY)
+        : source_(std::move(source)), api_preference_(api_preference) {}
+
+    bool open() override { return cap_.open(source_, api_preference_) && cap_.isOpened(); }
+
+    bool read(cv::Mat& frame) override { return cap_.read(frame); }
+
+    cv::Size frame_size() override {
+        return cv::Size(static_cast<int>(cap_.get(cv::CAP_PROP_FRAME_WIDTH)),
+                        static_cast<int>(cap_.get(cv::CAP_PROP_FRAME_HEIGHT)));
+    }
+
+    double fps() override { return cap_.get(cv::CAP_PROP_FPS); }
+
+    void release() override { cap_.release(); }
+
+private:
+    std::string source_;
+    int api_preference_;
+    cv::VideoCapture cap_;
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <mutex>
+
+// GPIOピン番号の定義（BCM番号）
+#define LED_BLUE  17
+#define LED_RED   27
+#define BTN_GREEN 23
+#define BTN_RED   24
+
+// ピンのレベルとモード（pigpioの PI_LOW / PI_HIGH / PI_INPUT / PI_OUTPUT と同じ値）
+// pigpio.hに依存しないよう自前で定義する（pigpioがない環境でもリプレイとテストをビルドできる）
+constexpr unsigned GPIO_LOW = 0;
+constexpr unsigned GPIO_HIGH = 1;
+constexpr unsigned GPIO_INPUT = 0;
+constexpr unsigned GPIO_OUTPUT = 1;
+
+// GPIOの操作（LEDの点灯とボタンの読み取り）
+// 実機ではpigpioを使い（pigpio_backend.h）、リプレイでは記録するだけのモックに差し替える
+class GpioBackend {
+public:
+    virtual ~GpioBackend() = default;
+
+    virtual int initialise() = 0; // 失敗したら0未満
+    virtual void set_mode(unsigned pin, unsigned mode) = 0;
+    virtual int read(unsigned pin) = 0;
+    virtual void write(unsigned pin, unsigned level) = 0;
+    virtual void terminate() = 0;
+};
+
+// ハードウェアなしで動かすためのモック
+// - 入力ピンは常にGPIO_HIGH（ボタンはプルアップなので、押されていない状態）
+// - 出力ピンはレベルが変わったときだけon_changeを呼ぶ（毎フレームの同じ値の書き込みは無視）
+class MockGpio : public GpioBackend {
+public:
+    explicit MockGpio(std::function<void(unsigned pin, unsigned level)> on_change = nullptr)
+        : on_change_(std::move(on_change)) {}
+
+    int initialise() override { return 0; }
+    void set_mode(unsigned, unsigned) override {}
+    int read(unsigned) override { return GPIO_HIGH; }
+
+    void write(unsigned pin, unsigned level) override {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = levels_.find(pin);
+            if (it != levels_.end() && it->second == level) {
+                return;
+            }
+            levels_[pin] = level;
+        }
+        if (on_change_) {
+            on_change_(pin, level);
+        }
+    }
+
+    void terminate() override {}
+
+private:
+    std::function<void(unsigned, unsigned)> on_change_;
+    std::mutex mutex_;
+    std::map<unsigned, unsigned> levels_;
+};
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <string>
+#include <system_error>
+
+// 録画中の映像をHLSでライブ配信するための設定とファイル管理
+//
+// 録画用のcv::VideoWriterをGStreamerのパイプラインで開き、エンコーダーの出力をteeで
+// mp4（録画ファイル）とhlssink2（HLSのセグメントとプレイリスト）に分ける。
+// エンコードは1回だけで、セグメントとプレイリストはtmpfs（/dev/shm）に置くのでSDカードに書き込まない
+class HlsStream {
+public:
+    struct Params {
+        std::string dir = "/dev/shm/picam_hls";
+        std::chrono::milliseconds segment{1000}; // セグメントの長さ（キーフレーム間隔もこれに合わせる）
+        int playlist_length = 4;                  // プレイリストに載せるセグメント数
+        std::string encoder = "v4l2h264enc";      // H.264エンコーダーの要素名（ソフトウェアならx264enc）
+    };
+
+    static constexpr const char* PLAYLIST_NAME = "live.m3u8";
+
+    explicit HlsStream(const Params& params) : params_(params) {}
+
+    // 録画開始前に、前回の録画のセグメントを消してディレクトリを用意する
+    bool prepare() const {
+        std::error_code ec;
+        std::filesystem::create_directories(params_.dir, ec);
+        if (ec) {
+            return false;
+        }
+        for (const auto& entry : std::filesystem::directory_iterator(params_.dir, ec)) {
+            std::error_code rec;
+            std::filesystem::remove(entry.path(), rec);
+        }
+        return !ec;
+    }
+
+    // 録画用のVideoWriterに渡すGStreamerパイプライン（cv::CAP_GSTREAMERで開く）
+    std::string writer_pipeline(const std::string& mp4_path, double fps) const {
+        return "appsrc ! " + encode_pipeline(mp4_path, fps);
+    }
+
+    // 入力元より後ろの部分（テストではappsrcの代わりにvideotestsrcをつなぐ）
+    // teeはエンコーダーの直後に置き、h264parseは分岐ごとに置く
+    // （mp4muxはstream-format=avc、hlssink2のmpegtsmuxはbyte-streamを要求するので、teeの前で1つに決められない）
+    std::string encode_pipeline(const std::string& mp4_path, double fps) const {
+        int segment_sec = std::max(1, static_cast<int>(std::lround(params_.segment.count() / 1000.0)));
+        int keyframe_interval = std::max(1, static_cast<int>(std::lround(fps * segment_sec)));
+
+        std::string encoder;
+        if (params_.encoder == "v4l2h264enc") {
+            // Raspberry PiのハードウェアエンコーダーはSPS/PPSをキーフレームごとに出す設定が必要
+            encoder = "v4l2h264enc extra-controls=\"controls,repeat_sequence_header=1,h264_i_frame_period=" +
+                      std::to_string(keyframe_interval) + "\" ! video/x-h264,level=(string)4";
+        } else if (params_.encoder == "x264enc") {
+            encoder = "x264enc tune=zerolatency speed-preset=ultrafast key-int-max=" + std::to_string(keyframe_interval);
+        } else {
+            encoder = params_.encoder; // そのまま使う（キーフレーム間隔は利用者が設定する）
+        }
+
+        return "videoconvert ! video/x-raw,format=I420 ! " + encoder + " ! tee name=t"
+               " t. ! queue ! h264parse ! mp4mux ! filesink location=" + quote(mp4_path) +
+               " t. ! queue ! h264parse config-interval=-1 ! hls.video"
+               " hlssink2 name=hls"
+               " location=" + quote(params_.dir + "/seg%05d.ts") +
+               " playlist-location=" + quote(params_.dir + "/" + PLAYLIST_NAME) +
+               " target-duration=" + std::to_string(segment_sec) +
+               " playlist-length=" + std::to_string(params_.playlist_length) +
+               " max-files=" + std::to_string(params_.playlist_length + 2);
+    }
+
+    // リクエストされたファイル名を検証し、パスとContent-Typeを返す
+    // （プレイリストと "seg<数字>.ts" 以外は拒否する）
+    bool resolve(const std::string& name, std::string& path, std::string& content_type) const {
+        if (name == PLAYLIST_NAME) {
+            content_type = "application/vnd.apple.mpegurl";
+        } else if (name.size() > 6 && name.compare(0, 3, "seg") == 0 && name.compare(name.size() - 3, 3, ".ts") == 0 &&
+                   std::all_of(name.begin() + 3, name.end() - 3, [](char c) { return c >= '0' && c <= '9'; })) {
+            content_type = "video/mp2t";
+        } else {
+            return false;
+        }
+        path = params_.dir + "/" + name;
+        return true;
+    }
+
+private:
+    // パイプラインの記述で値を引用符で囲む（空白を含むパスでも1つの値として渡す）
+    static std::string quote(const std::string& value) {
+        std::string quoted = "\"";
+        for (char c : value) {
+            if (c == '"' || c == '\\') {
+                quoted.push_back('\\');
+            }
+            quoted.push_back(c);
+        }
+        quoted.push_back('"');
+        return quoted;
+    }
+
+    Params params_;
+};
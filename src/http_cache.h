@@ -0,0 +1,183 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <zlib.h>
+
+// キャッシュしたHTTPレスポンス（作成後は変更しない）
+struct CachedResponse {
+    std::string etag;
+    std::string body;
+    std::string gzip_body; // 圧縮しても小さくならない場合は空
+};
+
+// キャッシュの統計
+struct ResponseCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t not_modified = 0; // 304で返した数
+};
+
+// gzip形式で圧縮する
+inline bool gzip_compress(const std::string& in, std::string& out) {
+    z_stream zs{};
+    // windowBitsに16を足すとgzipヘッダーつきになる
+    if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+    out.resize(deflateBound(&zs, static_cast<uLong>(in.size())));
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+    zs.avail_in = static_cast<uInt>(in.size());
+    zs.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    zs.avail_out = static_cast<uInt>(out.size());
+    int ret = deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return ret == Z_STREAM_END;
+}
+
+// Accept-Encodingでgzipを受け付けているか
+// カンマ区切りの各コーディングの品質値（";q=..."）を読み、q=0（0.0や0.000も）は拒否として扱う
+// gzipの指定がなければ "*" の品質値に従う
+inline bool accepts_gzip(const std::string& accept_encoding) {
+    auto trim = [](const std::string& s) {
+        size_t begin = s.find_first_not_of(" \t");
+        size_t end = s.find_last_not_of(" \t");
+        return begin == std::string::npos ? std::string() : s.substr(begin, end - begin + 1);
+    };
+    int gzip_accepted = -1;     // -1: 指定なし、0: 拒否、1: 受け付ける
+    int wildcard_accepted = -1;
+    size_t pos = 0;
+    while (pos <= accept_encoding.size()) {
+        size_t end = accept_encoding.find(',', pos);
+        if (end == std::string::npos) {
+            end = accept_encoding.size();
+        }
+        std::string item = accept_encoding.substr(pos, end - pos);
+        pos = end + 1;
+
+        size_t semicolon = item.find(';');
+        std::string coding = trim(item.substr(0, semicolon));
+        std::transform(coding.begin(), coding.end(), coding.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        double q = 1.0;
+        while (semicolon != std::string::npos) {
+            size_t next = item.find(';', semicolon + 1);
+            std::string param = trim(item.substr(semicolon + 1, next == std::string::npos ? std::string::npos : next - semicolon - 1));
+            if (param.size() >= 2 && (param[0] == 'q' || param[0] == 'Q') && param[1] == '=') {
+                q = std::strtod(param.c_str() + 2, nullptr);
+            }
+            semicolon = next;
+        }
+
+        if (coding == "gzip" || coding == "x-gzip") {
+            gzip_accepted = q > 0.0 ? 1 : 0;
+        } else if (coding == "*") {
+            wildcard_accepted = q > 0.0 ? 1 : 0;
+        }
+    }
+    if (gzip_accepted >= 0) {
+        return gzip_accepted == 1;
+    }
+    return wildcard_accepted == 1;
+}
+
+// If-None-MatchがETagと一致するか（"*" やカンマ区切りの複数指定にも対応）
+inline bool etag_matches(const std::string& if_none_match, const std::string& etag) {
+    if (if_none_match.empty()) {
+        return false;
+    }
+    if (if_none_match == "*") {
+        return true;
+    }
+    return if_none_match.find(etag) != std::string::npos;
+}
+
+// データのバージョンが変わるまでレスポンスを使い回すキャッシュ
+//
+// - キー（パスとクエリ）ごとに、本文・gzip圧縮した本文・ETagを一度だけ作る
+// - get()に渡したバージョンが前回と違えば全エントリを捨てる（新しいイベントが来るまで有効）
+// - ETagにはプロセスの起動時刻を含めるので、再起動でバージョンが戻っても古いETagとは一致しない
+class ResponseCache {
+public:
+    explicit ResponseCache(size_t max_entries = 64)
+        : max_entries_(max_entries),
+          boot_tag_(std::to_string(std::chrono::duration_cast<std::chrono::seconds>(
+              std::chrono::system_clock::now().time_since_epoch()).count())) {}
+
+    // キャッシュがあれば返し、なければbuildで本文を作って登録する
+    std::shared_ptr<const CachedResponse> get(const std::string& key, uint64_t version,
+                                              const std::function<std::string()>& build) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (version != version_) {
+                entries_.clear();
+                version_ = version;
+            }
+            auto it = entries_.find(key);
+            if (it != entries_.end()) {
+                hits_.fetch_add(1);
+                return it->second;
+            }
+        }
+        misses_.fetch_add(1);
+
+        // 作成はロックの外で行う（同時に作られた場合は後から登録した方が残る）
+        auto response = std::make_shared<CachedResponse>();
+        response->etag = etag_for(version);
+        response->body = build();
+        std::string compressed;
+        if (response->body.size() >= MIN_COMPRESS_BYTES && gzip_compress(response->body, compressed) &&
+            compressed.size() < response->body.size()) {
+            response->gzip_body = std::move(compressed);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (version == version_) {
+            if (entries_.size() >= max_entries_) {
+                entries_.clear();
+            }
+            entries_[key] = response;
+        }
+        return response;
+    }
+
+    // ETagだけを作る（本文をキャッシュしない応答用）
+    std::string etag_for(uint64_t version) const {
+        return "W/\"" + boot_tag_ + "-" + std::to_string(version) + "\"";
+    }
+
+    void count_not_modified() { not_modified_.fetch_add(1); }
+
+    ResponseCacheStats stats() const {
+        ResponseCacheStats s;
+        s.hits = hits_.load();
+        s.misses = misses_.load();
+        s.not_modified = not_modified_.load();
+        return s;
+    }
+
+    // これより小さい本文は圧縮しない
+    static constexpr size_t MIN_COMPRESS_BYTES = 256;
+
+private:
+    size_t max_entries_;
+    std::string boot_tag_;
+
+    std::mutex mutex_;
+    uint64_t version_ = 0;
+    std::map<std::string, std::shared_ptr<const CachedResponse>> entries_;
+
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+    std::atomic<uint64_t> not_modified_{0};
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <chrono>
+
+#include "httplib.h"
+
+// HTTPリクエストの開始時刻（ルーティングの前に記録し、ロガーで送信完了までの時間を求める）
+//
+// httplibのリクエストは受け付けたワーカーが応答の送信まで処理するので、記録はスレッドごとに1つ置く。
+// 413・400のようにルーティングの前に弾かれたリクエストはbegin()を通らないため、
+// 記録がどのリクエストのものかをアドレスで確かめ、応答を書く前（post-routing）に一度だけ照合する。
+// 前のリクエストの記録が残っていても（送信に失敗してロガーが呼ばれなかった場合など）その時刻は使わない
+class HttpRequestTimer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // pre-routingハンドラーで呼ぶ
+    static void begin(const httplib::Request& req) {
+        Slot& slot = thread_slot();
+        slot.request = &req;
+        slot.begin = Clock::now();
+        slot.responding = false;
+    }
+
+    // post-routingハンドラーで呼ぶ（すべての応答で、ヘッダーを書く前に1回だけ呼ばれる）
+    static void respond(const httplib::Request& req) {
+        Slot& slot = thread_slot();
+        if (slot.request == &req && !slot.responding) {
+            slot.responding = true;
+        } else {
+            slot.request = nullptr; // このリクエストはbegin()を通っていない
+        }
+    }
+
+    // ロガーで呼ぶ。このリクエストの開始時刻があればbeginに入れてtrueを返す
+    static bool take(const httplib::Request& req, Clock::time_point& begin) {
+        Slot& slot = thread_slot();
+        bool found = slot.request == &req && slot.responding;
+        if (found) {
+            begin = slot.begin;
+        }
+        slot.request = nullptr;
+        return found;
+    }
+
+private:
+    struct Slot {
+        const httplib::Request* request = nullptr;
+        Clock::time_point begin;
+        bool responding = false; // respond()で照合済み
+    };
+
+    static Slot& thread_slot() {
+        thread_local Slot slot;
+        return slot;
+    }
+};
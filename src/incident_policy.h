@@ -0,0 +1,145 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+
+// フレームごとの判定結果（メインループが実行する処理）
+struct IncidentActions {
+    bool start_clip = false;   // 録画を開始する
+    bool pause_clip = false;   // 動画を閉じずに、フレームの書き込みを止める
+    bool resume_clip = false;  // 一時停止中の動画への書き込みを再開する
+    bool stop_clip = false;    // 録画を終了する
+    bool notify_image = false; // 録画開始時の写真をLINEに送る
+    bool notify_video = false; // 録画終了時に動画URLをLINEに送る
+    bool incident_opened = false;
+    bool incident_closed = false;
+};
+
+// 顔検知のイベントを「インシデント」単位にまとめ、録画と通知を制御するクラス
+//
+// - 録画開始には start_hits 回連続の検出が必要（単発の誤検出で録画しない）
+// - 最後の検出から hold 時間が経ったら書き込みを一時停止し、動画は閉じずにおく。
+//   max_hold までに顔が戻れば同じ動画に続けて書くので、人が出入りしても動画と通知が分かれない
+// - 最後の検出から max_hold 経っても戻らなければ動画を閉じ、動画のURLを通知する
+// - 動画を閉じてから incident_gap 以内の検出は同じインシデントとして扱い、通知数を
+//   インシデントごと・1時間ごとに上限で抑える
+//
+// 検出領域（ゾーン）ごとの上限は持たない（カメラは1台で画面全体を1つの領域として検出し、
+// 領域の設定も顔と領域の対応付けもないため）
+class IncidentPolicy {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Params {
+        int start_hits = 1;
+        std::chrono::milliseconds hold{5000};
+        std::chrono::milliseconds max_hold{30000};
+        std::chrono::milliseconds incident_gap{60000};
+        int max_notifications_per_incident = 2;
+        int max_notifications_per_hour = 20;
+    };
+
+    struct Stats {
+        uint64_t incidents = 0;
+        uint64_t clips = 0;
+        uint64_t notifications = 0;
+        uint64_t suppressed = 0;
+    };
+
+    explicit IncidentPolicy(const Params& params) : params_(params) {}
+
+    // 1フレーム分の状態を更新する
+    // face_detected: このフレームで顔が映っているか
+    // detection_ran: このフレームで検出処理を実行したか（連続検出の数え方に使う）
+    IncidentActions update(Clock::time_point now, bool face_detected, bool detection_ran) {
+        IncidentActions actions;
+
+        if (detection_ran) {
+            consecutive_hits_ = face_detected ? consecutive_hits_ + 1 : 0;
+        }
+        if (face_detected) {
+            last_face_ = now;
+        }
+
+        switch (state_) {
+        case State::Idle:
+            if (face_detected && consecutive_hits_ >= params_.start_hits) {
+                // 新しいインシデントの開始
+                state_ = State::Recording;
+                incident_notifications_ = 0;
+                stats_.incidents++;
+                stats_.clips++;
+                actions.incident_opened = true;
+                actions.start_clip = true;
+                actions.notify_image = allow_notification(now);
+            }
+            break;
+
+        case State::Recording:
+            if (now - last_face_ >= params_.hold) {
+                state_ = State::Paused;
+                actions.pause_clip = true;
+            }
+            break;
+
+        case State::Paused:
+            if (face_detected && consecutive_hits_ >= params_.start_hits) {
+                // 顔が戻ったので同じ動画に続けて書く
+                state_ = State::Recording;
+                actions.resume_clip = true;
+            } else if (now - last_face_ >= params_.max_hold) {
+                state_ = State::Cooldown;
+                clip_stopped_ = now;
+                actions.stop_clip = true;
+                actions.notify_video = allow_notification(now);
+            }
+            break;
+
+        case State::Cooldown:
+            if (face_detected && consecutive_hits_ >= params_.start_hits) {
+                // 同じインシデント内での新しい動画（写真は送らない）
+                state_ = State::Recording;
+                stats_.clips++;
+                actions.start_clip = true;
+            } else if (now - clip_stopped_ >= params_.incident_gap) {
+                state_ = State::Idle;
+                actions.incident_closed = true;
+            }
+            break;
+        }
+        return actions;
+    }
+
+    // 動画を開いているか（一時停止中も含む）
+    bool recording() const { return state_ == State::Recording || state_ == State::Paused; }
+    const Stats& stats() const { return stats_; }
+
+private:
+    enum class State { Idle, Recording, Paused, Cooldown };
+
+    // 通知の上限（インシデントごと・直近1時間）を確認し、送れるなら数える
+    bool allow_notification(Clock::time_point now) {
+        while (!sent_times_.empty() && now - sent_times_.front() >= std::chrono::hours(1)) {
+            sent_times_.pop_front();
+        }
+        if (incident_notifications_ >= params_.max_notifications_per_incident ||
+            static_cast<int>(sent_times_.size()) >= params_.max_notifications_per_hour) {
+            stats_.suppressed++;
+            return false;
+        }
+        incident_notifications_++;
+        sent_times_.push_back(now);
+        stats_.notifications++;
+        return true;
+    }
+
+    Params params_;
+    State state_ = State::Idle;
+    int consecutive_hits_ = 0;
+    int incident_notifications_ = 0;
+    Clock::time_point last_face_;
+    Clock::time_point clip_stopped_;
+    std::deque<Clock::time_point> sent_times_;
+    Stats stats_;
+};
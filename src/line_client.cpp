@@ -0,0 +1,107 @@
+#include "line_client.h"
+
+#include <chrono>
+#include <exception>
+
+#include "httplib.h"
+#include "line_message.h"
+#include "logger.h"
+#include "metrics.h"
+
+OutboxSendResult LineClient::post(const std::string& endpoint, const std::string& body, const AppConfig& config,
+                                  const std::string& retry_key) {
+    PipelineMetrics& metrics = context_.metrics;
+    ScopedTimer timer(metrics.line_api_seconds, "line_api");
+    httplib::Client cli(api_base_); // Clientオブジェクト作成、"https://"で始まるのでHTTPSで接続する
+
+    // ネットワーク不安定な場合のフリーズ防止
+    cli.set_connection_timeout(std::chrono::seconds(5)); // 接続タイムアウト (5秒)
+    cli.set_read_timeout(std::chrono::seconds(10));      // 読み込みタイムアウト (10秒)
+
+    httplib::Headers headers = {
+        {"Authorization", "Bearer " + config.channel_access_token}
+    };
+    if (!retry_key.empty()) {
+        headers.emplace("X-Line-Retry-Key", retry_key);
+    }
+
+    // LINE APIへPOSTリクエストを送信
+    auto res = cli.Post(endpoint.c_str(), headers, body, "application/json");
+
+    OutboxSendResult result;
+
+    // レスポンスの確認
+    if (!res) {
+        // 接続エラー・タイムアウトは再送する
+        log_warn("LINE APIへの接続エラーが発生しました", {{"error", httplib::to_string(res.error())}});
+        result.retryable = true;
+        metrics.line_api_retry_total.add();
+        return result;
+    }
+
+    if (res->status == 200) {
+        log_info("LINE APIへの送信に成功しました", {{"response", res->body}});
+        result.ok = true;
+    } else if (res->status == 409 && !retry_key.empty()) {
+        // 同じリトライキーのリクエストはすでに受け付けられている
+        log_info("LINE APIはこのリクエストを受付済みです");
+        result.ok = true;
+    } else {
+        log_error("LINE APIエラーが発生しました", {{"status", res->status}, {"response", res->body}});
+        // 429（レート制限）と5xxは再送、それ以外（400など）は送り直しても失敗する
+        result.retryable = (res->status == 429 || res->status >= 500);
+        if (res->status == 429 && res->has_header("Retry-After")) {
+            try {
+                result.retry_after_sec = std::stoi(res->get_header_value("Retry-After"));
+            } catch (const std::exception&) {
+                result.retry_after_sec = -1;
+            }
+        }
+    }
+    (result.ok ? metrics.line_api_ok_total : result.retryable ? metrics.line_api_retry_total : metrics.line_api_error_total).add();
+    return result;
+}
+
+bool LineClient::reply(const std::string& reply_token, const std::string& text, const AppConfig& config) {
+
+    thread_local LineMessageBuilder builder;
+    builder.begin_reply(reply_token);
+    if (!builder.add_text(text)) {
+        log_error("リプライメッセージを作成できませんでした");
+        return false;
+    }
+
+    // LINE APIのリプライエンドポイントに返信を送信
+    return post(LINE_REPLY_MESSAGE_ENDPOINT, builder.finish(), config).ok;
+}
+
+void LineClient::notify_image(const std::string& to_user_id, const AppConfig& config, const std::string& image_file,
+                              std::function<void(bool)> on_done) {
+    std::string originalUrl = "https://" + config.ngrok_url_base + "/image?file=" + image_file;
+    std::string previewUrl = originalUrl; // 簡略化のため同じURL
+
+    context_.replay_event("notify_image");
+    LineNotification notification = LineNotification::make_image(to_user_id, originalUrl, previewUrl);
+    notification.on_done = std::move(on_done);
+    context_.line_notifier->notify(std::move(notification));
+}
+
+void LineClient::notify_text(const std::string& to_user_id, const std::string& text, const std::string& video_name,
+                             const AppConfig& config) {
+    std::string videoUrl = "https://" + config.ngrok_url_base + "/video?file=" + video_name;
+    // video_nameが空ならURLを空にする
+    if (video_name == "") {
+        videoUrl = "";
+    }
+
+    context_.replay_event("notify_text", {{"text", text}, {"video", !video_name.empty()}});
+    LineNotification notification = LineNotification::make_text(to_user_id, text + videoUrl);
+    notification.on_done = [](bool ok) {
+        if (ok) {
+            log_info("メッセージの送信が完了しました");
+        } else {
+            log_error("メッセージの送信に失敗しました");
+        }
+    };
+    context_.line_notifier->notify(std::move(notification));
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <functional>
+#include <string>
+
+#include "app_config.h"
+#include "line_outbox.h"
+#include "picam_context.h"
+
+// LINEに送るエンドポイント
+inline const std::string LINE_API_BASE = "https://api.line.me";
+inline const std::string LINE_PUSH_MESSAGE_ENDPOINT = "/v2/bot/message/push";
+inline const std::string LINE_REPLY_MESSAGE_ENDPOINT = "/v2/bot/message/reply";
+
+// LINE Messaging APIの呼び出しと通知の登録
+// - post / reply は呼び出したスレッドでHTTPSリクエストを送る
+// - notify_image / notify_text は通知スレッド（LineNotifier）に積むだけで、送信を待たない
+class LineClient {
+public:
+    // api_baseは送信先（テストではローカルのスタブサーバーに向ける）
+    explicit LineClient(PicamContext& context, std::string api_base = LINE_API_BASE)
+        : context_(context), api_base_(std::move(api_base)) {}
+
+    // LINE APIにHTTP POSTリクエストを送信する
+    // retry_keyを指定するとX-Line-Retry-Keyヘッダーを付ける（同じキーの再送はLINE側で重複排除される）
+    OutboxSendResult post(const std::string& endpoint, const std::string& body, const AppConfig& config,
+                          const std::string& retry_key = "");
+
+    // リプライメッセージを送信し、成功したかどうかを返す
+    // リプライトークンは短時間で失効するため、送信箱での再送は行わない
+    bool reply(const std::string& reply_token, const std::string& text, const AppConfig& config);
+
+    // 画像メッセージの通知を登録する（on_doneで送信結果を受け取れる）
+    void notify_image(const std::string& to_user_id, const AppConfig& config, const std::string& image_file,
+                      std::function<void(bool)> on_done = nullptr);
+
+    // テキストメッセージの通知を登録する（video_nameが空でなければ動画のURLを付ける）
+    void notify_text(const std::string& to_user_id, const std::string& text, const std::string& video_name,
+                     const AppConfig& config);
+
+private:
+    PicamContext& context_;
+    std::string api_base_; // "https://api.line.me"
+};
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+// LINE Messaging APIのリクエストボディ（push / reply）を組み立てるクラス
+// 文字列は必ずJSONエスケープされ、バッファは使い回すので送信ごとの再確保が起きにくい
+//
+// 使い方:
+//   builder.begin_push(user_id);
+//   builder.add_text("動画を撮影しました。");
+//   builder.add_image(url, url);
+//   send(builder.finish());
+class LineMessageBuilder {
+public:
+    // 1回のpush / replyで送れるメッセージの最大数（LINEの仕様）
+    static constexpr size_t MAX_MESSAGES = 5;
+    // テキストメッセージの最大文字数（LINEの仕様）
+    static constexpr size_t MAX_TEXT_LENGTH = 5000;
+    // URLの最大文字数（LINEの仕様）
+    static constexpr size_t MAX_URL_LENGTH = 2000;
+
+    LineMessageBuilder() { buffer_.reserve(1024); }
+
+    // プッシュメッセージ {"to": ..., "messages": [...]} を開始
+    void begin_push(std::string_view to) {
+        begin();
+        buffer_ += R"({"to":")";
+        append_escaped(to);
+        buffer_ += R"(","messages":[)";
+    }
+
+    // リプライメッセージ {"replyToken": ..., "messages": [...]} を開始
+    void begin_reply(std::string_view reply_token) {
+        begin();
+        buffer_ += R"({"replyToken":")";
+        append_escaped(reply_token);
+        buffer_ += R"(","messages":[)";
+    }
+
+    // テキストメッセージを追加
+    bool add_text(std::string_view text) {
+        if (text.empty() || utf8_length(text) > MAX_TEXT_LENGTH || !begin_message()) {
+            return false;
+        }
+        buffer_ += R"({"type":"text","text":")";
+        append_escaped(text);
+        buffer_ += R"("})";
+        return true;
+    }
+
+    // 画像メッセージを追加（URLはHTTPSのみ）
+    bool add_image(std::string_view original_url, std::string_view preview_url) {
+        if (!valid_url(original_url) || !valid_url(preview_url) || !begin_message()) {
+            return false;
+        }
+        buffer_ += R"({"type":"image","originalContentUrl":")";
+        append_escaped(original_url);
+        buffer_ += R"(","previewImageUrl":")";
+        append_escaped(preview_url);
+        buffer_ += R"("})";
+        return true;
+    }
+
+    // 動画メッセージを追加（previewはサムネイル画像のURL）
+    bool add_video(std::string_view original_url, std::string_view preview_url) {
+        if (!valid_url(original_url) || !valid_url(preview_url) || !begin_message()) {
+            return false;
+        }
+        buffer_ += R"({"type":"video","originalContentUrl":")";
+        append_escaped(original_url);
+        buffer_ += R"(","previewImageUrl":")";
+        append_escaped(preview_url);
+        buffer_ += R"("})";
+        return true;
+    }
+
+    // Flexメッセージを追加
+    // contents_jsonはシリアライズ済みのバブル/カルーセル（JSONオブジェクト）をそのまま埋め込む
+    bool add_flex(std::string_view alt_text, std::string_view contents_json) {
+        if (alt_text.empty() || utf8_length(alt_text) > 400 ||
+            contents_json.empty() || contents_json.front() != '{' || !begin_message()) {
+            return false;
+        }
+        buffer_ += R"({"type":"flex","altText":")";
+        append_escaped(alt_text);
+        buffer_ += R"(","contents":)";
+        buffer_.append(contents_json.data(), contents_json.size());
+        buffer_ += '}';
+        return true;
+    }
+
+    // ボディを閉じて返す（次のbegin_*まで有効）
+    const std::string& finish() {
+        if (!finished_) {
+            buffer_ += "]}";
+            finished_ = true;
+        }
+        return buffer_;
+    }
+
+    size_t message_count() const { return count_; }
+    bool full() const { return count_ >= MAX_MESSAGES; }
+
+    // JSON文字列として必要なエスケープを行って追加する
+    static void append_escaped(std::string& out, std::string_view s) {
+        for (char c : s) {
+            switch (c) {
+            case '"':  out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char hex[8];
+                    std::snprintf(hex, sizeof(hex), "\\u%04x", static_cast<unsigned char>(c));
+                    out += hex;
+                } else {
+                    out += c; // UTF-8のマルチバイト文字はそのまま
+                }
+            }
+        }
+    }
+
+private:
+    void begin() {
+        buffer_.clear(); // 容量は保持される
+        count_ = 0;
+        finished_ = false;
+    }
+
+    // メッセージ配列の区切りを入れる（上限を超える場合はfalse）
+    bool begin_message() {
+        if (finished_ || count_ >= MAX_MESSAGES) {
+            return false;
+        }
+        if (count_ > 0) {
+            buffer_ += ',';
+        }
+        count_++;
+        return true;
+    }
+
+    void append_escaped(std::string_view s) { append_escaped(buffer_, s); }
+
+    static bool valid_url(std::string_view url) {
+        return url.size() <= MAX_URL_LENGTH && url.substr(0, 8) == "https://";
+    }
+
+    // UTF-8の文字数（継続バイトを除いたバイト数）
+    static size_t utf8_length(std::string_view s) {
+        size_t n = 0;
+        for (char c : s) {
+            if ((static_cast<unsigned char>(c) & 0xC0) != 0x80) {
+                n++;
+            }
+        }
+        return n;
+    }
+
+    std::string buffer_;
+    size_t count_ = 0;
+    bool finished_ = false;
+};
@@ -0,0 +1,231 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "line_message.h"
+
+// LINEへ送る通知1件
+struct LineNotification {
+    enum class Type { Text, Image, Video };
+
+    Type type = Type::Text;
+    std::string to;          // 送信先のユーザーID
+    std::string text;        // Text用
+    std::string url;         // Image / Video用
+    std::string preview_url; // Image / Video用
+    std::function<void(bool)> on_done; // 送信結果の通知先（省略可）
+    std::chrono::steady_clock::time_point enqueued_at;
+
+    static LineNotification make_text(const std::string& to, const std::string& text) {
+        LineNotification n;
+        n.type = Type::Text;
+        n.to = to;
+        n.text = text;
+        return n;
+    }
+
+    static LineNotification make_image(const std::string& to, const std::string& url, const std::string& preview_url) {
+        LineNotification n;
+        n.type = Type::Image;
+        n.to = to;
+        n.url = url;
+        n.preview_url = preview_url;
+        return n;
+    }
+};
+
+// 通知の統計
+struct LineNotifierStats {
+    uint64_t events = 0;    // 受け付けた通知の数
+    uint64_t api_calls = 0; // pushの呼び出し回数
+    uint64_t failures = 0;  // 送信に失敗した通知の数
+    double calls_per_event = 0.0;
+    double avg_latency_ms = 0.0; // 通知の受付から送信完了まで
+    double max_latency_ms = 0.0;
+};
+
+// 通知をまとめて送るクラス
+// 一定時間（coalesce_window）だけ通知をため、同じユーザー宛ての最大5件を1回のpushで送る
+// ユーザーごとにpushの最小間隔を守り、通信は専用スレッドで行うのでカメラスレッドは待たされない
+// （push_の結果通知はnotifierより先に破棄されないこと）
+class LineNotifier {
+public:
+    // 組み立て済みのpushボディを送信する関数
+    // 送信結果はon_resultで通知する（再送などで後から呼ばれてもよい）
+    using PushFunction = std::function<void(const std::string& body, std::function<void(bool)> on_result)>;
+
+    LineNotifier(PushFunction push, std::chrono::milliseconds coalesce_window, std::chrono::milliseconds min_interval)
+        : push_(std::move(push)), coalesce_window_(coalesce_window), min_interval_(min_interval) {}
+
+    ~LineNotifier() { stop(); }
+
+    void start() {
+        running_ = true;
+        worker_ = std::thread(&LineNotifier::run, this);
+    }
+
+    // たまっている通知を送り切ってからスレッドを終了する
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            running_ = false;
+        }
+        cv_.notify_all();
+        if (worker_.joinable()) {
+            worker_.join();
+        }
+    }
+
+    void notify(LineNotification notification) {
+        notification.enqueued_at = std::chrono::steady_clock::now();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_.push_back(std::move(notification));
+        }
+        events_.fetch_add(1);
+        cv_.notify_all();
+    }
+
+    LineNotifierStats stats() const {
+        LineNotifierStats s;
+        s.events = events_.load();
+        s.api_calls = api_calls_.load();
+        s.failures = failures_.load();
+        uint64_t sent = sent_.load();
+        if (s.events > 0) {
+            s.calls_per_event = static_cast<double>(s.api_calls) / s.events;
+        }
+        if (sent > 0) {
+            s.avg_latency_ms = total_latency_us_.load() / 1000.0 / sent;
+        }
+        s.max_latency_ms = max_latency_us_.load() / 1000.0;
+        return s;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            cv_.wait(lock, [this] { return !pending_.empty() || !running_; });
+            if (pending_.empty()) {
+                return; // 停止要求があり、送るものもない
+            }
+
+            // 先頭の通知からcoalesce_windowが経つか、5件たまるまで待つ
+            // （停止要求があればすぐに送る）
+            auto deadline = pending_.front().enqueued_at + coalesce_window_;
+            cv_.wait_until(lock, deadline, [this] {
+                return !running_ || count_for(pending_.front().to) >= LineMessageBuilder::MAX_MESSAGES;
+            });
+
+            // 同じユーザー宛ての通知を先頭から最大5件取り出す
+            std::string to = pending_.front().to;
+            std::vector<LineNotification> batch;
+            for (auto it = pending_.begin(); it != pending_.end() && batch.size() < LineMessageBuilder::MAX_MESSAGES;) {
+                if (it->to == to) {
+                    batch.push_back(std::move(*it));
+                    it = pending_.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+
+            // ユーザーごとの送信間隔を守る
+            auto& next_allowed = next_allowed_[to];
+            if (running_ && Clock::now() < next_allowed) {
+                cv_.wait_until(lock, next_allowed, [this] { return !running_; });
+            }
+
+            lock.unlock();
+            send_batch(to, batch);
+            lock.lock();
+
+            next_allowed_[to] = Clock::now() + min_interval_;
+        }
+    }
+
+    size_t count_for(const std::string& to) const {
+        return static_cast<size_t>(std::count_if(pending_.begin(), pending_.end(),
+            [&to](const LineNotification& n) { return n.to == to; }));
+    }
+
+    void send_batch(const std::string& to, std::vector<LineNotification>& batch) {
+        builder_.begin_push(to);
+        std::vector<LineNotification*> included;
+        for (auto& n : batch) {
+            bool added = false;
+            switch (n.type) {
+            case LineNotification::Type::Text:  added = builder_.add_text(n.text); break;
+            case LineNotification::Type::Image: added = builder_.add_image(n.url, n.preview_url); break;
+            case LineNotification::Type::Video: added = builder_.add_video(n.url, n.preview_url); break;
+            }
+            if (added) {
+                included.push_back(&n);
+            } else {
+                // 作成できないメッセージはその場で失敗扱い
+                failures_.fetch_add(1);
+                if (n.on_done) n.on_done(false);
+            }
+        }
+        if (included.empty()) {
+            return;
+        }
+
+        // 送信結果が出たら、含めた通知それぞれに結果と遅延を記録する
+        auto callbacks = std::make_shared<std::vector<std::pair<Clock::time_point, std::function<void(bool)>>>>();
+        for (auto* n : included) {
+            callbacks->emplace_back(n->enqueued_at, std::move(n->on_done));
+        }
+        api_calls_.fetch_add(1);
+        push_(builder_.finish(), [this, callbacks](bool ok) {
+            auto now = Clock::now();
+            for (auto& cb : *callbacks) {
+                record_latency(now - cb.first);
+                if (!ok) {
+                    failures_.fetch_add(1);
+                }
+                if (cb.second) cb.second(ok);
+            }
+        });
+    }
+
+    void record_latency(Clock::duration elapsed) {
+        uint64_t us = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+        sent_.fetch_add(1);
+        total_latency_us_.fetch_add(us);
+        uint64_t prev_max = max_latency_us_.load();
+        while (us > prev_max && !max_latency_us_.compare_exchange_weak(prev_max, us)) {
+        }
+    }
+
+    PushFunction push_;
+    std::chrono::milliseconds coalesce_window_;
+    std::chrono::milliseconds min_interval_;
+
+    bool running_ = false;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<LineNotification> pending_;
+    std::map<std::string, Clock::time_point> next_allowed_;
+    std::thread worker_;
+    LineMessageBuilder builder_; // 送信スレッド専用
+
+    std::atomic<uint64_t> events_{0};
+    std::atomic<uint64_t> api_calls_{0};
+    std::atomic<uint64_t> failures_{0};
+    std::atomic<uint64_t> sent_{0};
+    std::atomic<uint64_t> total_latency_us_{0};
+    std::atomic<uint64_t> max_latency_us_{0};
+};
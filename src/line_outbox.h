@@ -0,0 +1,318 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h> // fdatasync
+
+#include "logger.h"
+#include "nlohmann/json.hpp"
+
+// 1回の送信結果
+struct OutboxSendResult {
+    bool ok = false;        // 送信成功
+    bool retryable = false; // 再送すれば成功する見込みがある（タイムアウト、429、5xx）
+    int retry_after_sec = -1; // 429のRetry-Afterヘッダー（なければ-1）
+};
+
+// 送信に失敗したLINEへのpushを再送するための送信箱
+//
+// - 送信前にリクエストを追記型のファイルへ書き込み、成功（または再送不可）で完了の記録を追記する
+// - 起動時にファイルを読み直し、完了していないリクエストを再送する
+// - 再送はジッター付きの指数バックオフ。429はRetry-Afterに従う
+// - 同じリクエストには同じX-Line-Retry-Keyを付けるので、LINE側で二重に配信されない
+class LineOutbox {
+public:
+    // endpoint, body, retry_keyを受け取って1回だけ送信する関数
+    using SendFunction = std::function<OutboxSendResult(const std::string& endpoint, const std::string& body, const std::string& retry_key)>;
+    using DoneCallback = std::function<void(bool)>;
+
+    LineOutbox(std::string path, SendFunction send)
+        : path_(std::move(path)), send_(std::move(send)), rng_(std::random_device{}()) {}
+
+    ~LineOutbox() { stop(); }
+
+    LineOutbox(const LineOutbox&) = delete;
+    LineOutbox& operator=(const LineOutbox&) = delete;
+
+    // ファイルから未完了のリクエストを読み込み、送信スレッドを起動する
+    void start() {
+        replay();
+        running_ = true;
+        worker_ = std::thread(&LineOutbox::run, this);
+    }
+
+    // 送信スレッドを終了する（未完了のリクエストはファイルに残り、次回起動時に再送される）
+    // 結果を待っている呼び出し元が待ち続けないように、未完了のリクエストのon_doneはfalseで呼ぶ
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            running_ = false;
+        }
+        cv_.notify_all();
+        if (worker_.joinable()) {
+            worker_.join();
+        }
+        std::vector<DoneCallback> abandoned;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto& entry : pending_) {
+                if (entry.on_done) {
+                    abandoned.push_back(std::move(entry.on_done));
+                    entry.on_done = nullptr;
+                }
+            }
+        }
+        for (auto& on_done : abandoned) {
+            on_done(false);
+        }
+        if (file_) {
+            std::fclose(file_);
+            file_ = nullptr;
+        }
+    }
+
+    // リクエストを登録する。on_doneは最終的な結果（配信成功 / 諦めた）で1回だけ呼ばれる
+    void submit(const std::string& endpoint, const std::string& body, DoneCallback on_done = nullptr) {
+        Entry entry;
+        entry.endpoint = endpoint;
+        entry.body = body;
+        entry.created = std::chrono::system_clock::now();
+        entry.next_attempt = std::chrono::steady_clock::now();
+        entry.on_done = std::move(on_done);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            entry.id = make_retry_key();
+            append({{"op", "add"}, {"id", entry.id}, {"endpoint", entry.endpoint}, {"body", entry.body},
+                    {"created", std::chrono::duration_cast<std::chrono::seconds>(entry.created.time_since_epoch()).count()}});
+            pending_.push_back(std::move(entry));
+        }
+        cv_.notify_all();
+    }
+
+    // 送信待ちのリクエストがなくなるまで最大timeoutだけ待つ（終了前の送り切り用）
+    bool wait_idle(std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return idle_cv_.wait_for(lock, timeout, [this] { return pending_.empty() && !in_flight_; });
+    }
+
+    size_t pending_count() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return pending_.size();
+    }
+
+    // バックオフの設定
+    std::chrono::milliseconds base_delay{1000};
+    std::chrono::milliseconds max_delay{5 * 60 * 1000};
+    // これより古いリクエストは諦める（通知として意味がなくなるため）
+    std::chrono::hours max_age{24};
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry {
+        std::string id; // X-Line-Retry-Key（UUID）
+        std::string endpoint;
+        std::string body;
+        std::chrono::system_clock::time_point created;
+        Clock::time_point next_attempt;
+        int attempts = 0;
+        DoneCallback on_done;
+    };
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (running_) {
+            if (pending_.empty()) {
+                cv_.wait(lock, [this] { return !pending_.empty() || !running_; });
+                continue;
+            }
+
+            // 次に送信時刻を迎えるリクエスト
+            auto next = std::min_element(pending_.begin(), pending_.end(),
+                [](const Entry& a, const Entry& b) { return a.next_attempt < b.next_attempt; });
+            if (next->next_attempt > Clock::now()) {
+                cv_.wait_until(lock, next->next_attempt);
+                continue; // 新しいリクエストが来たかもしれないので選び直す
+            }
+
+            Entry entry = std::move(*next);
+            pending_.erase(next);
+            in_flight_ = true;
+
+            lock.unlock();
+            OutboxSendResult result = send_(entry.endpoint, entry.body, entry.id);
+            lock.lock();
+            in_flight_ = false;
+
+            entry.attempts++;
+            bool expired = std::chrono::system_clock::now() - entry.created > max_age;
+
+            if (result.ok || !result.retryable || expired) {
+                // 完了を記録（成功、再送不可、期限切れ）
+                append({{"op", "done"}, {"id", entry.id}, {"ok", result.ok}});
+                if (!result.ok) {
+                    log_error("[Outbox] 送信を諦めました", {{"id", entry.id}, {"attempts", entry.attempts}});
+                }
+                compact_if_idle();
+                if (entry.on_done) {
+                    auto on_done = std::move(entry.on_done);
+                    lock.unlock();
+                    on_done(result.ok);
+                    lock.lock();
+                }
+                if (pending_.empty()) {
+                    idle_cv_.notify_all();
+                }
+                continue;
+            }
+
+            // 再送を予約
+            auto delay = backoff(entry.attempts, result.retry_after_sec);
+            log_warn("[Outbox] 送信に失敗したため再送します", {{"id", entry.id}, {"delay_ms", delay.count()}});
+            entry.next_attempt = Clock::now() + delay;
+            pending_.push_back(std::move(entry));
+        }
+    }
+
+    // attempts回失敗した後の待ち時間
+    // Retry-Afterがあればそれに従い、なければ [base/2, base * 2^attempts] の一様乱数（ジッター）
+    std::chrono::milliseconds backoff(int attempts, int retry_after_sec) {
+        if (retry_after_sec >= 0) {
+            return std::chrono::milliseconds(static_cast<int64_t>(retry_after_sec) * 1000);
+        }
+        int64_t ceiling = base_delay.count() << std::min(attempts, 16);
+        ceiling = std::min<int64_t>(ceiling, max_delay.count());
+        std::uniform_int_distribution<int64_t> dist(base_delay.count() / 2, std::max<int64_t>(ceiling, base_delay.count() / 2));
+        return std::chrono::milliseconds(dist(rng_));
+    }
+
+    // 起動時にファイルを読み込み、未完了のリクエストを復元する
+    void replay() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::ifstream ifs(path_);
+        std::map<std::string, Entry> added;
+        std::vector<std::string> order;
+        std::string line;
+        while (std::getline(ifs, line)) {
+            // 書き込み途中で電源が落ちた行などは読み飛ばす
+            nlohmann::json record = nlohmann::json::parse(line, nullptr, false);
+            if (record.is_discarded() || !record.is_object()) {
+                continue;
+            }
+            std::string op = record.value("op", "");
+            std::string id = record.value("id", "");
+            if (op == "add") {
+                Entry entry;
+                entry.id = id;
+                entry.endpoint = record.value("endpoint", "");
+                entry.body = record.value("body", "");
+                entry.created = std::chrono::system_clock::time_point(std::chrono::seconds(record.value("created", int64_t(0))));
+                entry.next_attempt = Clock::now();
+                if (added.emplace(id, std::move(entry)).second) {
+                    order.push_back(id);
+                }
+            } else if (op == "done") {
+                added.erase(id);
+            }
+        }
+        for (const auto& id : order) {
+            auto it = added.find(id);
+            if (it != added.end()) {
+                pending_.push_back(std::move(it->second));
+            }
+        }
+        if (!pending_.empty()) {
+            log_info("[Outbox] 未送信の通知を再送します", {{"count", pending_.size()}});
+        }
+        // 完了済みの記録を捨てて書き直す
+        rewrite();
+    }
+
+    // 未完了のリクエストがなければファイルを空にする（ファイルが際限なく伸びないように）
+    void compact_if_idle() {
+        if (pending_.empty() && ++done_since_compact_ >= 32) {
+            rewrite();
+        }
+    }
+
+    // 未完了のリクエストだけを書き出したファイルで置き換える
+    void rewrite() {
+        if (file_) {
+            std::fclose(file_);
+            file_ = nullptr;
+        }
+        std::string tmp_path = path_ + ".tmp";
+        FILE* tmp = std::fopen(tmp_path.c_str(), "w");
+        if (tmp == nullptr) {
+            log_error("[Outbox] ファイルを作成できませんでした", {{"path", tmp_path}});
+            return;
+        }
+        for (const auto& entry : pending_) {
+            std::string line = nlohmann::json({{"op", "add"}, {"id", entry.id}, {"endpoint", entry.endpoint}, {"body", entry.body},
+                {"created", std::chrono::duration_cast<std::chrono::seconds>(entry.created.time_since_epoch()).count()}}).dump();
+            line += '\n';
+            std::fwrite(line.data(), 1, line.size(), tmp);
+        }
+        std::fflush(tmp);
+        fdatasync(fileno(tmp));
+        std::fclose(tmp);
+        std::rename(tmp_path.c_str(), path_.c_str());
+        done_since_compact_ = 0;
+    }
+
+    // 1レコードを追記し、ディスクに書き出す
+    void append(const nlohmann::json& record) {
+        if (file_ == nullptr) {
+            file_ = std::fopen(path_.c_str(), "a");
+            if (file_ == nullptr) {
+                log_error("[Outbox] ファイルを開けませんでした", {{"path", path_}});
+                return;
+            }
+        }
+        std::string line = record.dump();
+        line += '\n';
+        std::fwrite(line.data(), 1, line.size(), file_);
+        std::fflush(file_);
+        fdatasync(fileno(file_));
+    }
+
+    // X-Line-Retry-Keyに使うUUID（バージョン4）
+    std::string make_retry_key() {
+        std::uniform_int_distribution<uint32_t> dist(0, 0xFFFF);
+        uint16_t w[8];
+        for (auto& v : w) {
+            v = static_cast<uint16_t>(dist(rng_));
+        }
+        w[3] = static_cast<uint16_t>((w[3] & 0x0FFF) | 0x4000); // バージョン4
+        w[4] = static_cast<uint16_t>((w[4] & 0x3FFF) | 0x8000); // バリアント
+        char buf[40];
+        std::snprintf(buf, sizeof(buf), "%04x%04x-%04x-%04x-%04x-%04x%04x%04x",
+                      w[0], w[1], w[2], w[3], w[4], w[5], w[6], w[7]);
+        return buf;
+    }
+
+    std::string path_;
+    SendFunction send_;
+    std::mt19937_64 rng_;
+
+    bool running_ = false;
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::condition_variable idle_cv_;
+    std::vector<Entry> pending_;
+    bool in_flight_ = false;
+    std::thread worker_;
+    FILE* file_ = nullptr;
+    int done_since_compact_ = 0;
+};
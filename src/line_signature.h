@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include <openssl/core_names.h>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+
+// LINE Webhookの署名（X-Line-Signature）を検証するクラス
+// 署名 = Base64(HMAC-SHA256(チャネルシークレット, リクエストボディ))
+//
+// 鍵を設定済みのHMACコンテキストをスレッドごとに使い回すため、
+// リクエストごとの鍵のセットアップやメモリ確保は発生しない
+class LineSignatureVerifier {
+public:
+    explicit LineSignatureVerifier(const std::string& channel_secret)
+        : secret_(channel_secret), generation_(next_generation()) {}
+
+    LineSignatureVerifier(const LineSignatureVerifier&) = delete;
+    LineSignatureVerifier& operator=(const LineSignatureVerifier&) = delete;
+
+    // チャネルシークレットが設定されているか
+    bool has_secret() const { return !secret_.empty(); }
+
+    // ボディと署名ヘッダーの値を照合する（比較は一定時間で行う）
+    bool verify(const std::string& body, const std::string& signature) const {
+        // HMAC-SHA256(32バイト)のBase64は必ず44文字
+        if (secret_.empty() || signature.size() != BASE64_SIGNATURE_LENGTH) {
+            return false;
+        }
+
+        EVP_MAC_CTX* ctx = thread_context();
+        if (ctx == nullptr) {
+            return false;
+        }
+
+        // 鍵にnullptrを渡すと、前回設定した鍵のまま再初期化される
+        unsigned char mac[EVP_MAX_MD_SIZE];
+        size_t mac_len = 0;
+        if (EVP_MAC_init(ctx, nullptr, 0, nullptr) != 1 ||
+            EVP_MAC_update(ctx, reinterpret_cast<const unsigned char*>(body.data()), body.size()) != 1 ||
+            EVP_MAC_final(ctx, mac, &mac_len, sizeof(mac)) != 1 ||
+            mac_len != MAC_LENGTH) {
+            return false;
+        }
+
+        // 受け取った署名をデコードするのではなく、計算結果をエンコードして比較する
+        unsigned char expected[BASE64_SIGNATURE_LENGTH + 1];
+        EVP_EncodeBlock(expected, mac, static_cast<int>(mac_len));
+
+        return CRYPTO_memcmp(expected, signature.data(), BASE64_SIGNATURE_LENGTH) == 0;
+    }
+
+private:
+    static constexpr size_t MAC_LENGTH = 32;
+    static constexpr size_t BASE64_SIGNATURE_LENGTH = 44;
+
+    // スレッドごとに保持するHMACコンテキスト
+    struct ThreadContext {
+        uint64_t generation = 0;
+        EVP_MAC_CTX* ctx = nullptr;
+
+        ~ThreadContext() { EVP_MAC_CTX_free(ctx); }
+    };
+
+    static uint64_t next_generation() {
+        static std::atomic<uint64_t> counter{0};
+        return ++counter;
+    }
+
+    // このスレッド用のコンテキストを返す（初回、または別の検証器用だった場合は鍵を設定し直す）
+    EVP_MAC_CTX* thread_context() const {
+        thread_local ThreadContext tc;
+        if (tc.ctx != nullptr && tc.generation == generation_) {
+            return tc.ctx;
+        }
+
+        EVP_MAC_CTX_free(tc.ctx);
+        tc.ctx = nullptr;
+        tc.generation = 0;
+
+        EVP_MAC* mac = EVP_MAC_fetch(nullptr, "HMAC", nullptr);
+        if (mac == nullptr) {
+            return nullptr;
+        }
+        EVP_MAC_CTX* ctx = EVP_MAC_CTX_new(mac);
+        EVP_MAC_free(mac); // ctxが参照を保持する
+
+        char digest[] = "SHA256";
+        OSSL_PARAM params[] = {
+            OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, digest, 0),
+            OSSL_PARAM_construct_end()
+        };
+        if (ctx == nullptr ||
+            EVP_MAC_init(ctx, reinterpret_cast<const unsigned char*>(secret_.data()), secret_.size(), params) != 1) {
+            EVP_MAC_CTX_free(ctx);
+            return nullptr;
+        }
+
+        tc.ctx = ctx;
+        tc.generation = generation_;
+        return tc.ctx;
+    }
+
+    std::string secret_;
+    uint64_t generation_;
+};
@@ -0,0 +1,400 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+
+// ログのレベル
+enum class LogLevel : uint8_t { Debug, Info, Warn, Error };
+
+inline const char* log_level_name(LogLevel level) {
+    switch (level) {
+    case LogLevel::Debug: return "DEBUG";
+    case LogLevel::Info:  return "INFO";
+    case LogLevel::Warn:  return "WARN";
+    case LogLevel::Error: return "ERROR";
+    }
+    return "INFO";
+}
+
+// "debug" / "info" / "warn" / "error" を読み取る
+inline bool parse_log_level(const std::string& text, LogLevel& level) {
+    if (text == "debug") level = LogLevel::Debug;
+    else if (text == "info") level = LogLevel::Info;
+    else if (text == "warn") level = LogLevel::Warn;
+    else if (text == "error") level = LogLevel::Error;
+    else return false;
+    return true;
+}
+
+// ログに付けるキーと値（呼び出しの間だけ有効。値はその場でリングバッファにコピーされる）
+class LogField {
+public:
+    LogField(const char* key, std::string_view value) : key_(key), value_(value) {}
+    LogField(const char* key, const std::string& value) : key_(key), value_(value) {}
+    LogField(const char* key, const char* value) : key_(key), value_(value ? value : "") {}
+
+    template <typename T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value, int>::type = 0>
+    LogField(const char* key, T value) : key_(key) {
+        auto result = std::to_chars(number_, number_ + sizeof(number_), value);
+        value_ = std::string_view(number_, static_cast<size_t>(result.ptr - number_));
+    }
+
+    LogField(const char* key, bool value) : key_(key), value_(value ? "true" : "false") {}
+
+    LogField(const char* key, double value) : key_(key) {
+        int n = std::snprintf(number_, sizeof(number_), "%.3f", value);
+        value_ = std::string_view(number_, static_cast<size_t>(std::max(0, std::min<int>(n, sizeof(number_) - 1))));
+    }
+
+    // 数値のフィールドはnumber_を指すので、コピーしたら指し直す
+    LogField(const LogField& other) : key_(other.key_), value_(other.value_) {
+        if (other.value_.data() == other.number_) {
+            std::memcpy(number_, other.number_, sizeof(number_));
+            value_ = std::string_view(number_, other.value_.size());
+        }
+    }
+    LogField& operator=(const LogField&) = delete;
+
+    const char* key() const { return key_; }
+    std::string_view value() const { return value_; }
+
+private:
+    const char* key_;
+    std::string_view value_;
+    char number_[32] = {};
+};
+
+// 非同期のロガー
+//
+// - 呼び出し側はロックを取らず、固定長のリングバッファのスロットを1つ確保して
+//   時刻・レベル・文字列をコピーするだけ（std::endlのような同期的な書き出しをしない）
+// - 書き出しは専用スレッドが行い、ファイルはmax_bytesを超えるとローテーションする
+// - バッファが一杯のときは待たずに捨て、捨てた件数を後でログに残す
+// - start()の前（設定の読み込み前など）は、その場で標準エラー出力に書く
+class Logger {
+public:
+    struct Params {
+        std::string path;                   // 空ならファイルに書かない
+        uint64_t max_bytes = 10 * 1024 * 1024;
+        int max_files = 3;                  // ローテーションで残す古いファイルの数
+        LogLevel file_level = LogLevel::Info;
+        LogLevel console_level = LogLevel::Warn;
+        // 各行の時刻を読む関数（テストで時計を動かすため）
+        std::chrono::system_clock::time_point (*wall_clock)() = [] { return std::chrono::system_clock::now(); };
+    };
+
+    static constexpr size_t CAPACITY = 1024; // スロット数（2のべき乗）
+    static constexpr size_t TEXT_SIZE = 232; // 1件の本文の最大バイト数（超えた分は切り捨て）
+
+    Logger() : slots_(new Slot[CAPACITY]), mono_origin_(std::chrono::steady_clock::now()) {
+        for (size_t i = 0; i < CAPACITY; i++) {
+            slots_[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    ~Logger() { stop(); }
+
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
+    void start(const Params& params) {
+        params_ = params;
+        min_level_.store(std::min(params_.file_level, params_.console_level));
+        if (!params_.path.empty()) {
+            open_file();
+        }
+        running_.store(true);
+        writer_ = std::thread(&Logger::run, this);
+    }
+
+    // たまっているログを書き出してから終了する
+    // 書き出しスレッドの最後の確認より後に積まれたログは、書き込み中の呼び出しが終わるのを待ってここで書き出す
+    void stop() {
+        if (!running_.exchange(false)) {
+            return;
+        }
+        if (writer_.joinable()) {
+            writer_.join();
+        }
+        while (in_flight_.load() > 0) {
+            std::this_thread::yield();
+        }
+        std::string line;
+        drain(line);
+        report_dropped(line);
+        if (file_) {
+            std::fclose(file_);
+            file_ = nullptr;
+        }
+    }
+
+    bool enabled(LogLevel level) const { return level >= min_level_.load(std::memory_order_relaxed); }
+
+    void log(LogLevel level, std::string_view message, std::initializer_list<LogField> fields = {}) {
+        if (!enabled(level)) {
+            return;
+        }
+        int64_t mono_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - mono_origin_).count();
+
+        // バッファに書く呼び出しを数える（stop()はこれが0になってから残りを書き出す）
+        // 数えた後にもう一度running_を読むので、stop()が0を見た後の呼び出しは必ず停止を見る
+        // 停止後の呼び出しは数えない（書き続けるスレッドがあってもstop()の待ちが終わる）
+        bool counted = running_.load();
+        if (counted) {
+            in_flight_.fetch_add(1);
+        }
+        struct InFlight {
+            std::atomic<uint32_t>& count;
+            bool counted;
+            ~InFlight() {
+                if (counted) count.fetch_sub(1, std::memory_order_release);
+            }
+        } in_flight{in_flight_, counted};
+
+        if (!counted || !running_.load()) {
+            // 起動前・終了後は同期的に書く
+            char text[TEXT_SIZE];
+            size_t len = format_text(text, message, fields);
+            std::fprintf(stderr, "%s %.*s\n", log_level_name(level), static_cast<int>(len), text);
+            return;
+        }
+        // 時刻は呼び出しごとに読む（起動時の時計が合っていなくても、NTPで合わせた後は正しい時刻を書く）
+        auto wall = params_.wall_clock();
+
+        // スロットを1つ確保する（Vyukovの有界MPMCキュー）
+        size_t pos = head_.load(std::memory_order_relaxed);
+        Slot* slot;
+        while (true) {
+            slot = &slots_[pos & (CAPACITY - 1)];
+            size_t seq = slot->seq.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                dropped_.fetch_add(1, std::memory_order_relaxed); // 一杯
+                return;
+            } else {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+
+        slot->level = level;
+        slot->mono_ns = mono_ns;
+        slot->wall = wall;
+        slot->thread = thread_number();
+        slot->len = static_cast<uint16_t>(format_text(slot->text, message, fields));
+        slot->seq.store(pos + 1, std::memory_order_release);
+    }
+
+    uint64_t dropped() const { return dropped_.load(); }
+
+private:
+    struct Slot {
+        std::atomic<size_t> seq{0};
+        LogLevel level = LogLevel::Info;
+        uint16_t len = 0;
+        uint32_t thread = 0;
+        int64_t mono_ns = 0;
+        std::chrono::system_clock::time_point wall;
+        char text[TEXT_SIZE];
+    };
+
+    // 本文を "メッセージ key=value key=value" の形で書き込み、長さを返す
+    // TEXT_SIZEを超える分は、UTF-8の文字の途中で切らないように文字の境界まで戻して捨てる
+    static size_t format_text(char* out, std::string_view message, std::initializer_list<LogField> fields) {
+        size_t len = 0;
+        bool full = false;
+        auto append = [&](std::string_view s) {
+            if (full) {
+                return;
+            }
+            size_t n = s.size();
+            if (n > TEXT_SIZE - len) {
+                n = TEXT_SIZE - len;
+                // 入りきらない最初のバイトが継続バイト（10xxxxxx）なら、その文字の先頭バイトの前まで戻る
+                while (n > 0 && (static_cast<unsigned char>(s[n]) & 0xC0) == 0x80) {
+                    n--;
+                }
+                full = true;
+            }
+            std::memcpy(out + len, s.data(), n);
+            len += n;
+        };
+        append(message);
+        for (const LogField& field : fields) {
+            append(" ");
+            append(field.key());
+            append("=");
+            std::string_view value = field.value();
+            // 空白や=を含む値は引用符で囲む
+            bool quote = value.empty() || value.find_first_of(" =\"") != std::string_view::npos;
+            if (quote) append("\"");
+            append(value);
+            if (quote) append("\"");
+        }
+        return len;
+    }
+
+    // スレッドごとの小さな番号（ログでどのスレッドか見分ける用）
+    static uint32_t thread_number() {
+        static std::atomic<uint32_t> next{1};
+        thread_local uint32_t number = next.fetch_add(1);
+        return number;
+    }
+
+    void run() {
+        std::string line;
+        line.reserve(512);
+        while (true) {
+            bool stopping = !running_.load(std::memory_order_acquire);
+            size_t written = drain(line);
+            if (written == 0) {
+                if (stopping) {
+                    break;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            }
+        }
+        report_dropped(line);
+    }
+
+    // たまっているログをすべて書き出し、件数を返す
+    size_t drain(std::string& line) {
+        size_t count = 0;
+        while (true) {
+            Slot& slot = slots_[tail_ & (CAPACITY - 1)];
+            if (slot.seq.load(std::memory_order_acquire) != tail_ + 1) {
+                break;
+            }
+            format_line(line, slot.level, slot.wall, slot.mono_ns, slot.thread, std::string_view(slot.text, slot.len));
+            slot.seq.store(tail_ + CAPACITY, std::memory_order_release);
+            tail_++;
+            write_line(slot.level, line);
+            count++;
+        }
+        if (count > 0) {
+            report_dropped(line);
+            if (file_) std::fflush(file_);
+            std::fflush(stdout);
+        }
+        return count;
+    }
+
+    void report_dropped(std::string& line) {
+        uint64_t dropped = dropped_.load();
+        if (dropped > reported_dropped_) {
+            std::string text = "ログのバッファが一杯のため捨てました count=" + std::to_string(dropped - reported_dropped_);
+            reported_dropped_ = dropped;
+            int64_t mono_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - mono_origin_).count();
+            format_line(line, LogLevel::Warn, params_.wall_clock(), mono_ns, 0, text);
+            write_line(LogLevel::Warn, line);
+        }
+    }
+
+    // "2026-01-01 12:00:00.123 +123.456789 INFO  [3] 本文"
+    // 先頭の時刻は呼び出した時点の時計、+の後ろは起動からの経過時間（時計が飛んでも単調に増える）
+    static void format_line(std::string& line, LogLevel level, std::chrono::system_clock::time_point wall, int64_t mono_ns,
+                            uint32_t thread, std::string_view text) {
+        std::time_t t = std::chrono::system_clock::to_time_t(wall);
+        int ms = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(wall.time_since_epoch()).count() % 1000);
+        std::tm tm{};
+        localtime_r(&t, &tm);
+        char head[96];
+        size_t n = std::strftime(head, sizeof(head), "%Y-%m-%d %H:%M:%S", &tm);
+        std::snprintf(head + n, sizeof(head) - n, ".%03d +%.6f %-5s [%u] ", ms, mono_ns / 1e9, log_level_name(level), thread);
+        line.assign(head);
+        line.append(text.data(), text.size());
+        line.push_back('\n');
+    }
+
+    void write_line(LogLevel level, const std::string& line) {
+        if (file_ && level >= params_.file_level) {
+            std::fwrite(line.data(), 1, line.size(), file_);
+            file_bytes_ += line.size();
+            if (file_bytes_ >= params_.max_bytes) {
+                rotate();
+            }
+        }
+        if (level >= params_.console_level) {
+            std::fwrite(line.data(), 1, line.size(), level >= LogLevel::Warn ? stderr : stdout);
+        }
+    }
+
+    void open_file() {
+        file_ = std::fopen(params_.path.c_str(), "a");
+        if (file_ == nullptr) {
+            std::fprintf(stderr, "ログファイルを開けませんでした: %s\n", params_.path.c_str());
+            return;
+        }
+        std::fseek(file_, 0, SEEK_END);
+        file_bytes_ = static_cast<uint64_t>(std::max(0L, std::ftell(file_)));
+    }
+
+    // picam.log → picam.log.1 → ... → picam.log.<max_files>（最も古いものは消える）
+    void rotate() {
+        std::fclose(file_);
+        file_ = nullptr;
+        for (int i = params_.max_files - 1; i >= 1; i--) {
+            std::string from = params_.path + "." + std::to_string(i);
+            std::string to = params_.path + "." + std::to_string(i + 1);
+            std::rename(from.c_str(), to.c_str());
+        }
+        if (params_.max_files > 0) {
+            std::rename(params_.path.c_str(), (params_.path + ".1").c_str());
+        } else {
+            std::remove(params_.path.c_str());
+        }
+        open_file();
+    }
+
+    std::unique_ptr<Slot[]> slots_;
+    alignas(64) std::atomic<size_t> head_{0}; // 書き込み側（複数スレッド）
+    alignas(64) size_t tail_ = 0;             // 読み出し側（書き出しスレッドのみ）
+    std::atomic<uint64_t> dropped_{0};
+    uint64_t reported_dropped_ = 0;
+    alignas(64) std::atomic<uint32_t> in_flight_{0}; // log()の途中にいる呼び出しの数
+
+    std::chrono::steady_clock::time_point mono_origin_;
+
+    Params params_;
+    std::atomic<LogLevel> min_level_{LogLevel::Debug};
+    std::atomic<bool> running_{false};
+    std::thread writer_;
+    FILE* file_ = nullptr;
+    uint64_t file_bytes_ = 0;
+};
+
+// プロセス全体で使うロガー
+inline Logger& logger() {
+    static Logger instance;
+    return instance;
+}
+
+inline void log_debug(std::string_view message, std::initializer_list<LogField> fields = {}) {
+    logger().log(LogLevel::Debug, message, fields);
+}
+inline void log_info(std::string_view message, std::initializer_list<LogField> fields = {}) {
+    logger().log(LogLevel::Info, message, fields);
+}
+inline void log_warn(std::string_view message, std::initializer_list<LogField> fields = {}) {
+    logger().log(LogLevel::Warn, message, fields);
+}
+inline void log_error(std::string_view message, std::initializer_list<LogField> fields = {}) {
+    logger().log(LogLevel::Error, message, fields);
+}
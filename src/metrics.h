@@ -0,0 +1,196 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "trace_buffer.h"
+
+// 処理時間のヒストグラム（バケットの境界は固定）
+// observe()はアトミック変数への加算だけなので、どのスレッドからでもロックなしで呼べる
+class Histogram {
+public:
+    static constexpr size_t BUCKETS = 16;
+
+    // バケットの上限（マイクロ秒）。これを超えたものは+Infに入る
+    static constexpr std::array<uint64_t, BUCKETS> BOUNDS_US = {
+        100, 250, 500, 1000, 2500, 5000, 10000, 25000,
+        50000, 100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000};
+
+    void observe_us(uint64_t us) {
+        size_t i = 0;
+        while (i < BUCKETS && us > BOUNDS_US[i]) {
+            i++;
+        }
+        counts_[i].fetch_add(1, std::memory_order_relaxed);
+        sum_us_.fetch_add(us, std::memory_order_relaxed);
+    }
+
+    void observe(std::chrono::steady_clock::duration elapsed) {
+        observe_us(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count()));
+    }
+
+    // Prometheusのテキスト形式で書き出す（秒単位、バケットは累積）
+    void render(std::string& out, const std::string& name, const std::string& labels) const {
+        std::string sep = labels.empty() ? "" : ",";
+        uint64_t cumulative = 0;
+        char le[32];
+        for (size_t i = 0; i <= BUCKETS; i++) {
+            cumulative += counts_[i].load(std::memory_order_relaxed);
+            if (i < BUCKETS) {
+                std::snprintf(le, sizeof(le), "%g", BOUNDS_US[i] / 1e6);
+            } else {
+                std::snprintf(le, sizeof(le), "+Inf");
+            }
+            out += name + "_bucket{" + labels + sep + "le=\"" + le + "\"} " + std::to_string(cumulative) + "\n";
+        }
+        char sum[32];
+        std::snprintf(sum, sizeof(sum), "%.6f", sum_us_.load(std::memory_order_relaxed) / 1e6);
+        std::string braces = labels.empty() ? "" : "{" + labels + "}";
+        out += name + "_sum" + braces + " " + sum + "\n";
+        out += name + "_count" + braces + " " + std::to_string(cumulative) + "\n";
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, BUCKETS + 1> counts_{};
+    std::atomic<uint64_t> sum_us_{0};
+};
+
+// 単調増加のカウンター
+class Counter {
+public:
+    void add(uint64_t n = 1) { value_.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> value_{0};
+};
+
+// スコープを抜けるまでの時間をヒストグラムに記録する
+// trace_nameを渡すと、トレースが有効なときは同じ区間をトレースにも記録する
+class ScopedTimer {
+public:
+    explicit ScopedTimer(Histogram& histogram, const char* trace_name = nullptr)
+        : histogram_(histogram), trace_name_(trace_name), begin_(std::chrono::steady_clock::now()) {}
+    ~ScopedTimer() {
+        auto end = std::chrono::steady_clock::now();
+        histogram_.observe(end - begin_);
+        if (trace_name_ != nullptr) {
+            trace_buffer().record(trace_name_, begin_, end);
+        }
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    Histogram& histogram_;
+    const char* trace_name_;
+    std::chrono::steady_clock::time_point begin_;
+};
+
+// メトリクスの登録と、Prometheusのテキスト形式での書き出し
+//
+// 登録（histogram / counter / gauge）はWebサーバーの起動前に済ませる。
+// 登録後の記録はアトミック変数だけで行うので、カメラスレッドやHTTPのワーカーを待たせない
+class MetricsRegistry {
+public:
+    Histogram& histogram(const std::string& name, const std::string& help, const std::string& labels = "") {
+        std::lock_guard<std::mutex> lock(mutex_);
+        histograms_.emplace_back();
+        entries_.push_back({Type::Histogram, name, help, labels, &histograms_.back(), nullptr, nullptr});
+        return histograms_.back();
+    }
+
+    Counter& counter(const std::string& name, const std::string& help, const std::string& labels = "") {
+        std::lock_guard<std::mutex> lock(mutex_);
+        counters_.emplace_back();
+        entries_.push_back({Type::Counter, name, help, labels, nullptr, &counters_.back(), nullptr});
+        return counters_.back();
+    }
+
+    // 書き出しのたびにfnを呼んで値を取る（既存の統計を公開する用）
+    void gauge(const std::string& name, const std::string& help, std::function<double()> fn, const std::string& labels = "") {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries_.push_back({Type::Gauge, name, help, labels, nullptr, nullptr, std::move(fn)});
+    }
+
+    // 単調増加する既存の統計をカウンターとして公開する
+    void counter_fn(const std::string& name, const std::string& help, std::function<double()> fn, const std::string& labels = "") {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries_.push_back({Type::CounterFn, name, help, labels, nullptr, nullptr, std::move(fn)});
+    }
+
+    std::string render() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::string out;
+        out.reserve(16 * 1024);
+        std::vector<bool> done(entries_.size(), false);
+        // 同じ名前のメトリクスはまとめて書き出す（HELP / TYPEは1回だけ）
+        for (size_t i = 0; i < entries_.size(); i++) {
+            if (done[i]) continue;
+            const Entry& head = entries_[i];
+            out += "# HELP " + head.name + " " + head.help + "\n";
+            out += "# TYPE " + head.name + " " + type_name(head.type) + "\n";
+            for (size_t j = i; j < entries_.size(); j++) {
+                if (done[j] || entries_[j].name != head.name) continue;
+                render_entry(out, entries_[j]);
+                done[j] = true;
+            }
+        }
+        return out;
+    }
+
+private:
+    enum class Type { Histogram, Counter, Gauge, CounterFn };
+
+    struct Entry {
+        Type type;
+        std::string name;
+        std::string help;
+        std::string labels;
+        const Histogram* histogram;
+        const Counter* counter;
+        std::function<double()> fn;
+    };
+
+    static const char* type_name(Type type) {
+        switch (type) {
+        case Type::Histogram: return "histogram";
+        case Type::Counter:
+        case Type::CounterFn: return "counter";
+        case Type::Gauge: return "gauge";
+        }
+        return "untyped";
+    }
+
+    static void render_entry(std::string& out, const Entry& e) {
+        std::string braces = e.labels.empty() ? "" : "{" + e.labels + "}";
+        char value[32];
+        switch (e.type) {
+        case Type::Histogram:
+            e.histogram->render(out, e.name, e.labels);
+            break;
+        case Type::Counter:
+            out += e.name + braces + " " + std::to_string(e.counter->value()) + "\n";
+            break;
+        case Type::Gauge:
+        case Type::CounterFn:
+            std::snprintf(value, sizeof(value), "%.17g", e.fn());
+            out += e.name + braces + " " + value + "\n";
+            break;
+        }
+    }
+
+    mutable std::mutex mutex_;
+    std::deque<Histogram> histograms_; // dequeは要素のアドレスが変わらない
+    std::deque<Counter> counters_;
+    std::vector<Entry> entries_;
+};
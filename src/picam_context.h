@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <initializer_list>
+#include <memory>
+
+#include "control_queue.h"
+#include "event_index.h"
+#include "frame_hub.h"
+#include "frame_pool.h"
+#include "hls_stream.h"
+#include "http_cache.h"
+#include "line_notifier.h"
+#include "logger.h"
+#include "pipeline_metrics.h"
+#include "replay.h"
+#include "retention_manager.h"
+
+// カメラスレッド・Webサーバー・通知で共有するコンポーネント
+// main()で1つだけ作り、各コンポーネントに参照で渡す
+struct PicamContext {
+    // 監視状態、初期状態はON（書き換えはカメラスレッドのみ、読み取りは各スレッドから）
+    std::atomic<bool> monitoring_enabled{true};
+
+    // Webhook → カメラスレッドへの制御コマンド（写真要求、監視ON/OFF、プログラム終了）
+    ControlQueue control_queue;
+
+    // 処理時間などのメトリクス（/metricsでPrometheusの形式で公開）
+    PipelineMetrics metrics;
+
+    // /eventsの応答のキャッシュ（索引が更新されるまで有効）
+    ResponseCache events_cache;
+
+    std::unique_ptr<LineNotifier> line_notifier; // LINE通知をまとめて送るスレッド
+    std::unique_ptr<RetentionManager> retention; // 古いファイルを削除するスレッド
+    std::unique_ptr<EventIndex> event_index;     // 録画イベントの索引
+    std::unique_ptr<FramePool> frame_pool;       // カメラのフレームのバッファ（frame_hubより後に破棄する）
+    std::unique_ptr<FrameHub> frame_hub;         // ライブ映像のJPEG変換と配信
+    std::unique_ptr<HlsStream> hls;              // 録画中のHLSライブ配信（無効ならnullptr）
+    std::unique_ptr<Replay> replay;              // 録画済みの映像で動かす場合のみ（実機ではnullptr）
+
+    // リプレイ中ならevents.logに記録する
+    void replay_event(const char* name, std::initializer_list<LogField> fields = {}) {
+        if (replay) {
+            replay->event(name, fields);
+        }
+    }
+};
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <pigpio.h>
+
+#include "gpio_backend.h"
+
+// gpio_backend.hの定数はpigpioの値と揃えてあるので、そのまま渡せる
+static_assert(GPIO_LOW == PI_LOW && GPIO_HIGH == PI_HIGH, "GPIOのレベルがpigpioと一致しません");
+static_assert(GPIO_INPUT == PI_INPUT && GPIO_OUTPUT == PI_OUTPUT, "GPIOのモードがpigpioと一致しません");
+
+// pigpioをそのまま呼ぶ（実機用。pigpioが見つかったときだけビルドする）
+class PigpioBackend : public GpioBackend {
+public:
+    int initialise() override { return gpioInitialise(); }
+    void set_mode(unsigned pin, unsigned mode) override { gpioSetMode(pin, mode); }
+    int read(unsigned pin) override { return gpioRead(pin); }
+    void write(unsigned pin, unsigned level) override { gpioWrite(pin, level); }
+    void terminate() override { gpioTerminate(); }
+};
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "metrics.h"
+
+// パイプラインの各段階の処理時間と件数
+// 登録はコンストラクタで済ませるので、各スレッドはメンバーに記録するだけでよい
+struct PipelineMetrics {
+    MetricsRegistry registry; // /metricsで書き出す（他のメンバーより先に初期化する）
+
+    Histogram& capture_seconds = stage("capture");
+    Histogram& preprocess_seconds = stage("preprocess");
+    Histogram& detect_seconds = stage("detect");
+    Histogram& encode_seconds = stage("encode");
+    Histogram& imwrite_seconds = stage("imwrite");
+    Histogram& line_api_seconds = stage("line_api");
+    Histogram& frame_seconds = registry.histogram("picam_frame_processing_seconds", "1フレームの処理時間（cap.readの待ち時間を除く）");
+
+    Counter& frames_total = registry.counter("picam_frames_total", "処理したフレーム数");
+    Counter& capture_failures_total = registry.counter("picam_capture_failures_total", "cap.readに失敗した回数");
+    Counter& detections_total = registry.counter("picam_detections_total", "顔検出を実行した回数");
+    Counter& line_api_ok_total = line_api_result("ok");
+    Counter& line_api_retry_total = line_api_result("retryable");
+    Counter& line_api_error_total = line_api_result("error");
+
+    PipelineMetrics() = default;
+    PipelineMetrics(const PipelineMetrics&) = delete;
+    PipelineMetrics& operator=(const PipelineMetrics&) = delete;
+
+private:
+    Histogram& stage(const char* name) {
+        return registry.histogram("picam_stage_duration_seconds", "パイプラインの各段階の処理時間",
+                                  std::string("stage=\"") + name + "\"");
+    }
+
+    Counter& line_api_result(const char* result) {
+        return registry.counter("picam_line_api_requests_total", "LINE APIの呼び出し回数",
+                                std::string("result=\"") + result + "\"");
+    }
+};
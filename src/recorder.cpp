@@ -0,0 +1,202 @@
+#include "recorder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <filesystem>
+#include <iomanip>
+#include <sstream>
+
+#include "logger.h"
+#include "metrics.h"
+
+namespace {
+
+// 時刻を文字列で取得する関数
+std::string get_timestamp() {
+
+    // 現在時刻の取得
+    std::ostringstream oss;
+    auto t = std::time(nullptr);
+    std::tm tm{}; // {}で構造体の初期化
+    localtime_r(&t, &tm);
+
+    // YYYYMMDD-HHMMSS 形式の文字列を作成
+    oss << std::put_time(&tm, "%Y_%m_%d--%H_%M_%S");
+    return oss.str();
+}
+
+// 現在時刻（UNIX時間、ミリ秒）
+int64_t unix_time_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// ファイルサイズ（取得できなければ0）
+uint64_t file_size_or_zero(const std::string& path) {
+    std::error_code ec;
+    auto size = std::filesystem::file_size(path, ec);
+    return ec ? 0 : static_cast<uint64_t>(size);
+}
+
+} // namespace
+
+
+bool Recorder::start(const cv::Mat& frame, double fps, uint64_t incident) {
+
+    // 日時を取得
+    std::string get_time = get_timestamp();
+
+    video_filepath_ = video_dir_ + "/" + get_time + ".mp4";
+    video_filename_ = get_time + ".mp4";
+    recording_lease_ = context_.retention->acquire(video_filepath_);
+    if (context_.hls && context_.hls->prepare()) {
+        // mp4とHLSを1回のエンコードで同時に書き出す
+        writer_.open(context_.hls->writer_pipeline(video_filepath_, fps), cv::CAP_GSTREAMER, 0, fps, frame.size(), true);
+        if (!writer_.isOpened()) {
+            // エンコーダーやhlssink2がない環境でも、HLSなしで録画は残す
+            log_warn("HLSのパイプラインを開けませんでした。HLSなしで録画します", {{"path", video_filepath_}});
+        }
+    }
+    if (!writer_.isOpened()) {
+        writer_.open(video_filepath_, cv::VideoWriter::fourcc('H', '2', '6', '4'), fps, frame.size());
+    }
+
+    paused_ = false;
+    if (writer_.isOpened()) {
+        is_recording_ = true;
+        log_info("[録画開始]顔検出！録画中", {{"path", video_filepath_}});
+
+        // 顔の枠は動画と同じ名前の .vtt に書く
+        fps_ = fps;
+        frames_written_ = 0;
+        track_filepath_ = DetectionTrack::path_for(video_filepath_);
+        track_lease_ = context_.retention->acquire(track_filepath_);
+        track_.open(track_filepath_);
+    } else {
+        log_error("動画を開けませんでした。写真だけを保存します", {{"path", video_filepath_}});
+        recording_lease_.reset();
+    }
+
+    // 写真を保存
+    std::string photo_filepath = photo_dir_ + "/" + get_time + ".jpg";
+    photo_filename_ = get_time + ".jpg";
+    bool photo_saved = save_photo(photo_filepath, frame);
+
+    // 索引にイベントを登録（録画中の状態で書いておき、終了時に更新する）
+    // 動画を開けなかった場合は写真だけのイベントにしてすぐ閉じ、写真もなければ登録しない
+    current_event_ = EventRecord();
+    if (!is_recording_ && !photo_saved) {
+        return false;
+    }
+    current_event_.incident = incident;
+    current_event_.start_ms = unix_time_ms();
+    if (is_recording_) {
+        current_event_.video_file = video_filename_;
+    }
+    if (photo_saved) {
+        current_event_.photo_file = photo_filename_;
+        current_event_.photo_bytes = file_size_or_zero(photo_filepath);
+    }
+    current_event_.id = context_.event_index->begin_event(current_event_);
+    if (!is_recording_) {
+        close_event();
+    }
+    return is_recording_;
+}
+
+void Recorder::write(const cv::Mat& frame) {
+    if (is_recording_ && !paused_) {
+        ScopedTimer timer(context_.metrics.encode_seconds, "encode");
+        writer_.write(frame);
+        frames_written_++;
+    }
+}
+
+void Recorder::pause() {
+    if (is_recording_ && !paused_) {
+        // 表示中のキューを一時停止した位置で閉じる（再開後の枠と時刻が続かないように）
+        static const std::vector<cv::Rect> no_faces;
+        static const std::vector<int> no_neighbors;
+        track_.add(frames_written_ / fps_, no_faces, no_neighbors);
+        log_info("録画を一時停止", {{"path", video_filepath_}});
+    }
+    paused_ = true;
+}
+
+bool Recorder::stop() {
+    if (!is_recording_) {
+        // start()で動画を開けなかった（写真だけのイベントは閉じてある）
+        return false;
+    }
+    writer_.release();
+    is_recording_ = false;
+    context_.retention->add_file(video_filepath_);
+    recording_lease_.reset();
+    close_track();
+    log_info("録画停止", {{"path", video_filepath_}});
+    close_event();
+    return true;
+}
+
+void Recorder::add_detection(const std::vector<cv::Rect>& faces, const std::vector<int>& neighbors) {
+    if (!is_recording_ || paused_) {
+        return;
+    }
+    if (!faces.empty()) {
+        current_event_.face_frames++;
+        current_event_.max_faces = std::max(current_event_.max_faces, static_cast<uint32_t>(faces.size()));
+    }
+    for (int n : neighbors) {
+        current_event_.peak_confidence = std::max(current_event_.peak_confidence, static_cast<float>(n));
+    }
+    // このフレームは次に書き込むフレーム（frames_written_番目）
+    track_.add(frames_written_ / fps_, faces, neighbors);
+}
+
+bool Recorder::take_photo(const cv::Mat& frame, std::string& filename) {
+    // 日時を取得
+    std::string get_time = get_timestamp();
+    filename = get_time + ".jpg";
+    return save_photo(photo_dir_ + "/" + filename, frame);
+}
+
+void Recorder::close() {
+    if (writer_.isOpened()) {
+        writer_.release();
+        is_recording_ = false;
+        close_track();
+        // 録画中に終了した場合も、索引のイベントを閉じておく
+        close_event();
+    }
+}
+
+bool Recorder::save_photo(const std::string& path, const cv::Mat& frame) {
+    bool saved;
+    {
+        ScopedTimer timer(context_.metrics.imwrite_seconds, "imwrite");
+        saved = cv::imwrite(path, frame);
+    }
+    if (saved) {
+        log_info("画像を保存しました", {{"path", path}});
+        context_.retention->add_file(path);
+    } else {
+        log_error("画像を保存できませんでした", {{"path", path}});
+    }
+    return saved;
+}
+
+void Recorder::close_track() {
+    if (!track_.is_open()) {
+        return;
+    }
+    track_.close(frames_written_ / fps_);
+    context_.retention->add_file(track_filepath_);
+    track_lease_.reset();
+}
+
+void Recorder::close_event() {
+    current_event_.end_ms = unix_time_ms();
+    current_event_.video_bytes = current_event_.video_file.empty() ? 0 : file_size_or_zero(video_filepath_);
+    context_.event_index->update_event(current_event_);
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "detection_track.h"
+#include "event_index.h"
+#include "picam_context.h"
+#include "retention_manager.h"
+
+// 録画と写真の保存
+// 録画の開始時にサムネイルの写真を保存して索引にイベントを登録し、終了時にイベントを閉じる
+// 顔の枠は映像に描き込まず、動画と同じ名前の検出結果のトラック（.vtt）に書く
+// （カメラスレッドからだけ呼ぶ）
+class Recorder {
+public:
+    Recorder(PicamContext& context, std::string photo_dir, std::string video_dir)
+        : context_(context), photo_dir_(std::move(photo_dir)), video_dir_(std::move(video_dir)) {}
+
+    Recorder(const Recorder&) = delete;
+    Recorder& operator=(const Recorder&) = delete;
+
+    // 録画を開始する（ファイル名は現在時刻から決める）
+    // 動画を書き出せる状態になればtrue（写真は結果によらず保存する。動画を開けなければ索引には写真だけのイベントを登録する）
+    bool start(const cv::Mat& frame, double fps, uint64_t incident);
+
+    // 録画中（一時停止中でない）ならフレームを書き込む
+    void write(const cv::Mat& frame);
+
+    // 動画を開いたまま書き込みを止める / 再開する（止めている間のフレームは動画に入らない）
+    void pause();
+    void resume() { paused_ = false; }
+
+    // 録画を終了し、索引のイベントを終了状態に更新する
+    // 動画を書き出していればtrue（start()で動画を開けなかった場合はfalseで、何もしない）
+    bool stop();
+
+    // 録画中の検出結果をイベントに集計し、検出結果のトラックに書く
+    void add_detection(const std::vector<cv::Rect>& faces, const std::vector<int>& neighbors);
+
+    // 写真だけを保存する（成功すればファイル名を返す）
+    bool take_photo(const cv::Mat& frame, std::string& filename);
+
+    // 終了時に呼ぶ。録画中なら閉じて、索引のイベントも閉じておく
+    void close();
+
+    bool recording() const { return is_recording_; }
+    const std::string& video_filename() const { return video_filename_; }
+    const std::string& photo_filename() const { return photo_filename_; }
+
+private:
+    // 写真を保存する（処理時間を記録し、整理の対象に加える）
+    bool save_photo(const std::string& path, const cv::Mat& frame);
+
+    // 検出結果のトラックを録画の長さで閉じる
+    void close_track();
+
+    // 索引のイベントを終了状態に更新する
+    void close_event();
+
+    PicamContext& context_;
+    const std::string photo_dir_;
+    const std::string video_dir_;
+
+    cv::VideoWriter writer_; // 録画の開始/停止で開き直す
+    bool is_recording_ = false;
+    bool paused_ = false;
+    std::string video_filepath_;
+    std::string video_filename_;
+    std::string photo_filename_;
+    std::shared_ptr<RetentionManager::Lease> recording_lease_; // 録画中のファイルを削除させない
+    DetectionTrack track_;      // 録画中の検出結果のトラック
+    std::string track_filepath_;
+    std::shared_ptr<RetentionManager::Lease> track_lease_;
+    double fps_ = 0.0;
+    uint64_t frames_written_ = 0; // トラックの時刻（書き込んだフレーム数 / FPS）に使う
+    EventRecord current_event_; // 録画中のイベント（索引に書く情報）
+};
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <initializer_list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+
+#include "detection_labels.h"
+#include "logger.h"
+
+// リプレイの指定（コマンドライン引数から作る）
+//
+//   picam --replay <動画ファイル | 連番画像のパターン（frames/%04d.jpg）>
+//         [--fast] [--fps <FPS>] [--out <出力先>] [--config <設定ファイル>] [--detections <ラベル>]
+//
+// --detections を指定すると顔検出機を使わず、ラベル（detection_labels.h の形式）を検出結果として使う
+// （カスケードやOpenCVのバージョンによらず同じ結果になるので、正解の events.log と比較するテストに使う）
+struct ReplayOptions {
+    std::string source;
+    bool fast = false;                 // trueなら待たずに処理する（falseなら実時間で再生）
+    double fps = 0.0;                  // 0なら動画のFPS（取れなければCAMERA_FPS）
+    std::string out_dir = "../replay_out";
+    std::string config_path;           // 空なら通常の設定ファイル
+    std::string detections_path;       // 空なら顔検出機で検出する
+};
+
+// 引数を解析する（--replayがなければfalseを返し、通常の起動になる）
+inline bool parse_replay_options(int argc, char* argv[], ReplayOptions& options, std::string& error) {
+    bool replay = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = (i + 1 < argc);
+        if (arg == "--replay" && has_value) {
+            options.source = argv[++i];
+            replay = true;
+        } else if (arg == "--fast") {
+            options.fast = true;
+        } else if (arg == "--fps" && has_value) {
+            options.fps = std::atof(argv[++i]);
+        } else if (arg == "--out" && has_value) {
+            options.out_dir = argv[++i];
+        } else if (arg == "--config" && has_value) {
+            options.config_path = argv[++i];
+        } else if (arg == "--detections" && has_value) {
+            options.detections_path = argv[++i];
+        } else {
+            error = "不明な引数です: " + arg;
+            return false;
+        }
+    }
+    if (!replay && (options.fast || options.fps > 0.0 || !options.config_path.empty() ||
+                    !options.detections_path.empty())) {
+        error = "--fast / --fps / --config / --detections は --replay と一緒に指定してください";
+    }
+    return replay;
+}
+
+// 録画済みの映像でパイプライン全体を動かすためのクラス
+//
+// - 時刻はフレーム番号 / FPS の仮想時刻で進める（--fastでも録画の長さや通知の間隔は実時間と同じになる）
+// - 検出・インシデント・録画・通知・LEDの変化を、仮想時刻つきで events.log に書く。
+//   実時間やファイル名を含めないので、同じ映像と設定なら毎回同じ内容になり、正解ファイルと比較できる
+// - 処理速度（実時間でのFPS）は throughput.json に書く
+class Replay {
+public:
+    explicit Replay(const ReplayOptions& options) : options_(options) {}
+
+    ~Replay() {
+        if (events_) {
+            std::fclose(events_);
+        }
+    }
+
+    Replay(const Replay&) = delete;
+    Replay& operator=(const Replay&) = delete;
+
+    const ReplayOptions& options() const { return options_; }
+
+    // 出力先を作り、保存先などを環境変数で出力先に向ける（設定の読み込み前に呼ぶ）
+    // 実機の写真・動画・送信箱・索引には触れず、HTTPサーバーとHLSも使わない
+    bool prepare() {
+        if (!options_.detections_path.empty()) {
+            std::string error;
+            if (!labels_.load(options_.detections_path, error)) {
+                log_error("[Replay] " + error);
+                return false;
+            }
+            use_labels_ = true;
+        }
+
+        std::error_code ec;
+        std::filesystem::create_directories(options_.out_dir + "/photo", ec);
+        std::filesystem::create_directories(options_.out_dir + "/video", ec);
+        if (ec) {
+            log_error("[Replay] 出力先を作成できませんでした", {{"dir", options_.out_dir}});
+            return false;
+        }
+        // 前回のリプレイの状態を引き継がない
+        std::filesystem::remove(options_.out_dir + "/outbox.log", ec);
+        std::filesystem::remove(options_.out_dir + "/events.idx", ec);
+
+        setenv("PICAM_PHOTO_DIR", (options_.out_dir + "/photo").c_str(), 1);
+        setenv("PICAM_VIDEO_DIR", (options_.out_dir + "/video").c_str(), 1);
+        setenv("PICAM_OUTBOX_PATH", (options_.out_dir + "/outbox.log").c_str(), 1);
+        setenv("PICAM_EVENT_INDEX_PATH", (options_.out_dir + "/events.idx").c_str(), 1);
+        setenv("PICAM_LOG_PATH", (options_.out_dir + "/picam.log").c_str(), 1);
+        setenv("PICAM_HLS_ENABLED", "0", 1);
+
+        events_ = std::fopen((options_.out_dir + "/events.log").c_str(), "w");
+        if (events_ == nullptr) {
+            log_error("[Replay] events.logを作成できませんでした", {{"dir", options_.out_dir}});
+            return false;
+        }
+        return true;
+    }
+
+    // 再生を始める（fpsは映像のFPS）
+    void start(double fps) {
+        fps_ = fps > 0.0 ? fps : 15.0;
+        origin_ = std::chrono::steady_clock::now();
+        frame_ = 0;
+    }
+
+    // 現在のフレームの仮想時刻
+    std::chrono::steady_clock::time_point now() const {
+        return origin_ + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                             std::chrono::duration<double>(frame_ / fps_));
+    }
+
+    // 次のフレームに進む（実時間で再生する場合は、次のフレームの時刻まで待つ）
+    void next_frame() {
+        frame_++;
+        if (!options_.fast) {
+            std::this_thread::sleep_until(now());
+        }
+    }
+
+    uint64_t frame() const { return frame_; }
+
+    // --detections のラベル（指定がなければnullptrで、顔検出機を使う）
+    const DetectionLabels* labels() const { return use_labels_ ? &labels_ : nullptr; }
+
+    // events.logに1行書く（"t=<仮想時刻> frame=<番号> <イベント> key=value ..."。カメラスレッドから呼ぶ）
+    void event(const char* name, std::initializer_list<LogField> fields = {}) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (events_ == nullptr) {
+            return;
+        }
+        std::fprintf(events_, "t=%.3f frame=%llu %s", frame_ / fps_, static_cast<unsigned long long>(frame_), name);
+        for (const LogField& field : fields) {
+            std::string_view value = field.value();
+            std::fprintf(events_, " %s=%.*s", field.key(), static_cast<int>(value.size()), value.data());
+        }
+        std::fputc('\n', events_);
+    }
+
+    // LINE APIの呼び出しを数える（呼び出し回数はまとめ送信の実時間に左右されるので、events.logには書かない）
+    void count_line_api_call() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        line_api_calls_++;
+    }
+
+    // 処理速度をthroughput.jsonに書き、ログにも出す
+    void finish(uint64_t detections) {
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - origin_).count();
+        double processed_fps = elapsed > 0.0 ? frame_ / elapsed : 0.0;
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (events_) {
+            std::fclose(events_);
+            events_ = nullptr;
+        }
+        char summary[256];
+        std::snprintf(summary, sizeof(summary),
+                      "{\"frames\":%llu,\"detections\":%llu,\"elapsed_sec\":%.3f,\"fps\":%.2f,"
+                      "\"source_fps\":%.2f,\"realtime_factor\":%.2f,\"line_api_calls\":%llu}\n",
+                      static_cast<unsigned long long>(frame_), static_cast<unsigned long long>(detections), elapsed,
+                      processed_fps, fps_, processed_fps / fps_, static_cast<unsigned long long>(line_api_calls_));
+        FILE* out = std::fopen((options_.out_dir + "/throughput.json").c_str(), "w");
+        if (out) {
+            std::fputs(summary, out);
+            std::fclose(out);
+        }
+        // コマンドラインから使うので、結果は画面にも出す
+        std::fputs(summary, stdout);
+        log_info("[Replay] 再生が終了しました", {{"frames", frame_}, {"elapsed_sec", elapsed}, {"fps", processed_fps}});
+    }
+
+private:
+    ReplayOptions options_;
+    double fps_ = 15.0;
+    std::chrono::steady_clock::time_point origin_;
+    uint64_t frame_ = 0;
+    DetectionLabels labels_;
+    bool use_labels_ = false;
+
+    std::mutex mutex_;
+    FILE* events_ = nullptr;
+    uint64_t line_api_calls_ = 0;
+};
@@ -0,0 +1,298 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <sys/resource.h> // setpriority
+#include <sys/statvfs.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "logger.h"
+
+// 保存ファイルの整理の統計
+struct RetentionStats {
+    uint64_t files = 0;          // 索引にあるファイル数
+    uint64_t bytes = 0;          // 索引にあるファイルの合計サイズ
+    uint64_t deleted_files = 0;  // 削除したファイル数（累計）
+    uint64_t deleted_bytes = 0;
+    uint64_t skipped_in_use = 0; // 配信中などで削除を見送った回数（累計）
+    uint64_t scans = 0;          // ディレクトリの全走査の回数
+    uint64_t last_scan_files = 0;
+    double last_scan_ms = 0.0;   // 直近の全走査にかかった時間
+};
+
+// 写真・動画の保存ディレクトリを容量と経過時間で整理するクラス
+//
+// - 起動時と rescan_interval ごとにだけディレクトリを走査し、ファイルの索引（サイズ・更新時刻）を作る
+//   （新しいファイルは add_file() で索引に追加するので、毎回の走査は不要）
+// - interval ごとに、max_age を過ぎたファイル、quota を超えた分、空き容量が min_free を下回った分を古い順に削除する
+// - acquire() で読み手として登録されたファイル（配信中・録画中）は削除しない
+// - 削除したファイルはon_deletedで知らせる（録画イベントの索引から外すため）
+// - 整理は優先度を下げた専用スレッドで行うので、カメラやHTTPのスレッドの邪魔をしない
+class RetentionManager {
+public:
+    struct Params {
+        std::chrono::seconds max_age{6 * 60 * 60}; // 0なら経過時間では削除しない
+        uint64_t quota_bytes = 0;                  // 0なら容量の上限なし
+        uint64_t min_free_bytes = 0;               // 0なら空き容量を確認しない
+        std::chrono::milliseconds interval{60 * 1000};
+        std::chrono::milliseconds rescan_interval{60 * 60 * 1000};
+    };
+
+    // 読み手の登録（破棄されると登録が外れる）
+    class Lease {
+    public:
+        Lease(RetentionManager* manager, std::string path) : manager_(manager), path_(std::move(path)) {}
+        ~Lease() { manager_->release(path_); }
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+
+    private:
+        RetentionManager* manager_;
+        std::string path_;
+    };
+
+    // on_deletedは整理のスレッドでロックを持たずに呼ばれる
+    RetentionManager(std::vector<std::string> dirs, const Params& params,
+                     std::function<void(const std::string& path)> on_deleted = {})
+        : dirs_(std::move(dirs)), params_(params), on_deleted_(std::move(on_deleted)) {}
+
+    ~RetentionManager() { stop(); }
+
+    RetentionManager(const RetentionManager&) = delete;
+    RetentionManager& operator=(const RetentionManager&) = delete;
+
+    void start() {
+        running_ = true;
+        worker_ = std::thread(&RetentionManager::run, this);
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            running_ = false;
+        }
+        cv_.notify_all();
+        if (worker_.joinable()) {
+            worker_.join();
+        }
+    }
+
+    // 保存し終えたファイルを索引に追加する
+    void add_file(const std::string& path) {
+        std::error_code ec;
+        auto file_path = std::filesystem::path(path).lexically_normal();
+        auto size = std::filesystem::file_size(file_path, ec);
+        if (ec) return;
+        auto mtime = std::filesystem::last_write_time(file_path, ec);
+        if (ec) return;
+        std::lock_guard<std::mutex> lock(mutex_);
+        insert(file_path.string(), size, mtime);
+    }
+
+    // ファイルを読み手として登録する。戻り値を持っている間は削除されない
+    std::shared_ptr<Lease> acquire(const std::string& path) {
+        std::string key = std::filesystem::path(path).lexically_normal().string();
+        std::lock_guard<std::mutex> lock(mutex_);
+        readers_[key]++;
+        return std::make_shared<Lease>(this, key);
+    }
+
+    RetentionStats stats() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        RetentionStats s = stats_;
+        s.files = by_path_.size();
+        s.bytes = total_bytes_;
+        return s;
+    }
+
+private:
+    using FileTime = std::filesystem::file_time_type;
+
+    struct Entry {
+        uint64_t size;
+        FileTime mtime;
+    };
+
+    void run() {
+        lower_priority();
+        rescan();
+        auto next_rescan = std::chrono::steady_clock::now() + params_.rescan_interval;
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (running_) {
+            lock.unlock();
+            if (std::chrono::steady_clock::now() >= next_rescan) {
+                rescan();
+                next_rescan = std::chrono::steady_clock::now() + params_.rescan_interval;
+            }
+            enforce();
+            lock.lock();
+            cv_.wait_for(lock, params_.interval, [this] { return !running_; });
+        }
+    }
+
+    // このスレッドのCPU・I/Oの優先度を下げる
+    static void lower_priority() {
+        pid_t tid = static_cast<pid_t>(syscall(SYS_gettid));
+        setpriority(PRIO_PROCESS, static_cast<id_t>(tid), 19);
+#ifdef SYS_ioprio_set
+        // ベストエフォートクラスの最低優先度（IOPRIO_CLASS_BE=2, レベル7）
+        syscall(SYS_ioprio_set, 1 /* IOPRIO_WHO_PROCESS */, tid, (2 << 13) | 7);
+#endif
+    }
+
+    // ディレクトリを走査して索引を作り直す（外部で追加・削除されたファイルを反映する）
+    void rescan() {
+        auto begin = std::chrono::steady_clock::now();
+        std::map<std::string, Entry> scanned;
+        for (const auto& dir : dirs_) {
+            std::error_code ec;
+            for (std::filesystem::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+                std::error_code fec;
+                if (!it->is_regular_file(fec)) continue;
+                auto size = it->file_size(fec);
+                if (fec) continue;
+                auto mtime = it->last_write_time(fec);
+                if (fec) continue;
+                scanned[it->path().lexically_normal().string()] = Entry{size, mtime};
+            }
+        }
+        double elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        by_path_.clear();
+        by_age_.clear();
+        total_bytes_ = 0;
+        for (auto& kv : scanned) {
+            insert(kv.first, kv.second.size, kv.second.mtime);
+        }
+        stats_.scans++;
+        stats_.last_scan_files = scanned.size();
+        stats_.last_scan_ms = elapsed_ms;
+    }
+
+    // 条件を満たすまで古いファイルから削除する
+    void enforce() {
+        uint64_t need_free = free_space_shortfall();
+        std::set<std::string> in_use; // この回で見送ったファイル
+        while (true) {
+            std::string deleted;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (!running_) return;
+
+                // 1回に1ファイルだけ削除してロックを手放す（acquire()を長く待たせない）
+                auto now = FileTime::clock::now();
+                auto victim = by_age_.end();
+                for (auto it = by_age_.begin(); it != by_age_.end(); ++it) {
+                    bool expired = params_.max_age.count() > 0 && now - it->first > params_.max_age;
+                    bool over_quota = params_.quota_bytes > 0 && total_bytes_ > params_.quota_bytes;
+                    if (!expired && !over_quota && need_free == 0) {
+                        break; // これより新しいファイルは残す
+                    }
+                    if (readers_.count(it->second)) {
+                        if (in_use.insert(it->second).second) {
+                            stats_.skipped_in_use++;
+                        }
+                        continue;
+                    }
+                    victim = it;
+                    break;
+                }
+                if (victim == by_age_.end()) {
+                    return;
+                }
+
+                std::string path = victim->second;
+                uint64_t size = by_path_[path].size;
+                std::error_code ec;
+                std::filesystem::remove(path, ec);
+                if (ec) {
+                    log_warn("[Retention] ファイルを削除できませんでした", {{"path", path}, {"error", ec.message()}});
+                } else {
+                    stats_.deleted_files++;
+                    stats_.deleted_bytes += size;
+                    deleted = path;
+                }
+                // 削除できなかったファイルも索引からは外す（次の全走査で戻る）
+                erase(path);
+                need_free = need_free > size ? need_free - size : 0;
+            }
+            if (!deleted.empty() && on_deleted_) {
+                on_deleted_(deleted);
+            }
+        }
+    }
+
+    // 空き容量がmin_freeに足りない分（どのディレクトリでも最も足りない分）
+    uint64_t free_space_shortfall() const {
+        if (params_.min_free_bytes == 0) {
+            return 0;
+        }
+        uint64_t shortfall = 0;
+        for (const auto& dir : dirs_) {
+            struct statvfs st;
+            if (statvfs(dir.c_str(), &st) != 0) continue;
+            uint64_t available = static_cast<uint64_t>(st.f_bavail) * st.f_frsize;
+            if (available < params_.min_free_bytes) {
+                shortfall = std::max(shortfall, params_.min_free_bytes - available);
+            }
+        }
+        return shortfall;
+    }
+
+    void release(const std::string& path) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = readers_.find(path);
+        if (it != readers_.end() && --it->second == 0) {
+            readers_.erase(it);
+        }
+    }
+
+    // 以下はmutex_を持った状態で呼ぶ
+    void insert(const std::string& path, uint64_t size, FileTime mtime) {
+        erase(path);
+        by_path_[path] = Entry{size, mtime};
+        by_age_.emplace(mtime, path);
+        total_bytes_ += size;
+    }
+
+    void erase(const std::string& path) {
+        auto it = by_path_.find(path);
+        if (it == by_path_.end()) return;
+        by_age_.erase({it->second.mtime, path});
+        total_bytes_ -= it->second.size;
+        by_path_.erase(it);
+    }
+
+    std::vector<std::string> dirs_;
+    Params params_;
+    std::function<void(const std::string& path)> on_deleted_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    bool running_ = false;
+    std::thread worker_;
+
+    std::map<std::string, Entry> by_path_;
+    std::set<std::pair<FileTime, std::string>> by_age_; // 古い順
+    uint64_t total_bytes_ = 0;
+    std::map<std::string, int> readers_;
+    RetentionStats stats_;
+};
@@ -0,0 +1,236 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <pthread.h>
+#include <signal.h>
+
+#include "logger.h"
+
+// 処理区間（スパン）を記録するリングバッファ
+//
+// - カメラスレッドの各段階やHTTPのリクエストの開始・終了時刻を固定長のリングに上書きしながら記録する
+// - 書き込みはアトミック変数への数回のストアだけで、ロックもメモリ確保もしない（無効なら何もしない）
+// - 直近の区間をChromeのトレース形式（Perfetto / chrome://tracingで開けるJSON）で書き出す
+class TraceBuffer {
+public:
+    TraceBuffer() : origin_(std::chrono::steady_clock::now()) {}
+
+    ~TraceBuffer() { stop_dump_on_signal(); }
+
+    TraceBuffer(const TraceBuffer&) = delete;
+    TraceBuffer& operator=(const TraceBuffer&) = delete;
+
+    // 記録を開始する（capacityは保持する区間の数。記録を始める前に1回だけ呼ぶ）
+    void enable(size_t capacity) {
+        capacity_ = std::max<size_t>(capacity, 1);
+        slots_.reset(new Slot[capacity_]);
+        enabled_.store(true, std::memory_order_release);
+    }
+
+    bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+    // 呼び出したスレッドの名前（トレースビューアーの行の名前になる。nameは文字列リテラルなど寿命の長いもの）
+    static void set_thread_name(const char* name) { thread_name() = name; }
+
+    // 区間を記録する（nameは文字列リテラルなど寿命の長いもの）
+    void record(const char* name, std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end) {
+        if (!enabled_.load(std::memory_order_acquire)) {
+            return;
+        }
+        uint32_t tid = thread_id();
+        uint64_t i = next_.fetch_add(1, std::memory_order_relaxed);
+        Slot& slot = slots_[i % capacity_];
+        // seqが奇数の間は書き込み中（読み出し側は読み飛ばす）
+        slot.seq.store(2 * i + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.name.store(name, std::memory_order_relaxed);
+        slot.tid.store(tid, std::memory_order_relaxed);
+        slot.begin_ns.store(std::chrono::duration_cast<std::chrono::nanoseconds>(begin - origin_).count(), std::memory_order_relaxed);
+        slot.dur_ns.store(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count(), std::memory_order_relaxed);
+        slot.seq.store(2 * i + 2, std::memory_order_release);
+    }
+
+    uint64_t recorded() const { return next_.load(std::memory_order_relaxed); }
+
+    // 直近windowの区間をChromeのトレース形式のJSONにする
+    std::string render_json(std::chrono::milliseconds window) const {
+        std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        bool first = true;
+        char buf[256];
+
+        {
+            std::lock_guard<std::mutex> lock(threads_mutex_);
+            for (const auto& thread : threads_) {
+                std::snprintf(buf, sizeof(buf),
+                              "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                              first ? "" : ",", thread.first, thread.second);
+                out += buf;
+                first = false;
+            }
+        }
+
+        if (enabled()) {
+            struct Span {
+                const char* name;
+                uint32_t tid;
+                int64_t begin_ns;
+                int64_t dur_ns;
+            };
+            std::vector<Span> spans;
+            spans.reserve(capacity_);
+            int64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin_).count();
+            int64_t from_ns = now_ns - std::chrono::duration_cast<std::chrono::nanoseconds>(window).count();
+            for (size_t i = 0; i < capacity_; i++) {
+                const Slot& slot = slots_[i];
+                uint64_t seq = slot.seq.load(std::memory_order_acquire);
+                if (seq == 0 || (seq & 1) != 0) {
+                    continue;
+                }
+                Span span{slot.name.load(std::memory_order_relaxed), slot.tid.load(std::memory_order_relaxed),
+                          slot.begin_ns.load(std::memory_order_relaxed), slot.dur_ns.load(std::memory_order_relaxed)};
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (slot.seq.load(std::memory_order_relaxed) != seq) {
+                    continue; // 読んでいる間に上書きされた
+                }
+                if (span.begin_ns >= from_ns) {
+                    spans.push_back(span);
+                }
+            }
+            std::sort(spans.begin(), spans.end(), [](const Span& a, const Span& b) { return a.begin_ns < b.begin_ns; });
+
+            out.reserve(out.size() + spans.size() * 80);
+            for (const Span& span : spans) {
+                std::snprintf(buf, sizeof(buf), "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                              first ? "" : ",", span.name, span.tid, span.begin_ns / 1e3, span.dur_ns / 1e3);
+                out += buf;
+                first = false;
+            }
+        }
+        out += "]}";
+        return out;
+    }
+
+    // SIGUSR1を受けたらpathにトレースを書き出すスレッドを起動する
+    // シグナルはこのスレッドがsigwait()で受け取るので、他のスレッドを作る前にblock_dump_signal()を呼んでおく
+    static void block_dump_signal() {
+        sigset_t set;
+        sigemptyset(&set);
+        sigaddset(&set, SIGUSR1);
+        pthread_sigmask(SIG_BLOCK, &set, nullptr);
+    }
+
+    void start_dump_on_signal(const std::string& path, std::chrono::milliseconds window) {
+        dumping_.store(true);
+        dump_thread_ = std::thread([this, path, window] {
+            sigset_t set;
+            sigemptyset(&set);
+            sigaddset(&set, SIGUSR1);
+            while (true) {
+                int sig = 0;
+                if (sigwait(&set, &sig) != 0 || !dumping_.load()) {
+                    return;
+                }
+                write_file(path, window);
+            }
+        });
+    }
+
+    void stop_dump_on_signal() {
+        if (!dumping_.exchange(false)) {
+            return;
+        }
+        // 待っているスレッドにシグナルを送って起こす
+        pthread_kill(dump_thread_.native_handle(), SIGUSR1);
+        dump_thread_.join();
+    }
+
+    // トレースをファイルに書き出す（書き途中のファイルを読まれないよう、一時ファイルから置き換える）
+    bool write_file(const std::string& path, std::chrono::milliseconds window) const {
+        std::string json = render_json(window);
+        std::string tmp_path = path + ".tmp";
+        FILE* file = std::fopen(tmp_path.c_str(), "w");
+        if (file == nullptr) {
+            log_error("[Trace] ファイルを作成できませんでした", {{"path", tmp_path}});
+            return false;
+        }
+        bool ok = std::fwrite(json.data(), 1, json.size(), file) == json.size();
+        ok = (std::fclose(file) == 0) && ok;
+        if (!ok || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+            log_error("[Trace] ファイルを書き出せませんでした", {{"path", path}});
+            return false;
+        }
+        log_info("[Trace] トレースを書き出しました", {{"path", path}, {"bytes", json.size()}});
+        return true;
+    }
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> seq{0};
+        std::atomic<const char*> name{nullptr};
+        std::atomic<uint32_t> tid{0};
+        std::atomic<int64_t> begin_ns{0};
+        std::atomic<int64_t> dur_ns{0};
+    };
+
+    static const char*& thread_name() {
+        thread_local const char* name = nullptr;
+        return name;
+    }
+
+    // スレッドごとの番号（初回だけ名前を登録する）
+    uint32_t thread_id() {
+        thread_local uint32_t id = 0;
+        if (id == 0) {
+            std::lock_guard<std::mutex> lock(threads_mutex_);
+            id = next_tid_++;
+            if (thread_name() != nullptr) {
+                threads_.emplace_back(id, thread_name());
+            }
+        }
+        return id;
+    }
+
+    std::chrono::steady_clock::time_point origin_;
+    std::atomic<bool> enabled_{false};
+    size_t capacity_ = 0;
+    std::unique_ptr<Slot[]> slots_;
+    alignas(64) std::atomic<uint64_t> next_{0};
+
+    mutable std::mutex threads_mutex_;
+    uint32_t next_tid_ = 1;
+    std::vector<std::pair<uint32_t, const char*>> threads_;
+
+    std::atomic<bool> dumping_{false};
+    std::thread dump_thread_;
+};
+
+// プロセス全体で使うトレースのバッファ
+inline TraceBuffer& trace_buffer() {
+    static TraceBuffer instance;
+    return instance;
+}
+
+// スコープを抜けるまでの区間をトレースに記録する（ヒストグラムを持たない処理用）
+class TraceSpan {
+public:
+    explicit TraceSpan(const char* name) : name_(name), begin_(std::chrono::steady_clock::now()) {}
+    ~TraceSpan() { trace_buffer().record(name_, begin_, std::chrono::steady_clock::now()); }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* name_;
+    std::chrono::steady_clock::time_point begin_;
+};
@@ -0,0 +1,865 @@
+#include "web_server.h"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <fstream>
+#include <limits>
+#include <memory>
+
+#include "nlohmann/json.hpp"
+#include "concurrency_limiter.h"
+#include "detection_track.h"
+#include "http_request_timer.h"
+#include "line_signature.h"
+#include "logger.h"
+#include "trace_buffer.h"
+
+using json = nlohmann::json;
+
+namespace {
+
+// Webhookがコマンドの処理結果を待つ最大時間（過ぎたら「まだ確認できていない」と返信する）
+const std::chrono::seconds PHOTO_RESULT_TIMEOUT(20);
+const std::chrono::seconds MONITORING_RESULT_TIMEOUT(3);
+
+// 録画イベントのJSON表現（保存ファイルの整理で削除されたファイルはnull）
+json event_to_json(const EventRecord& event) {
+    auto file_or_null = [](const std::string& name) { return name.empty() ? json(nullptr) : json(name); };
+    return {
+        {"id", event.id},
+        {"incident", event.incident},
+        {"start_ms", event.start_ms},
+        {"end_ms", event.end_ms},
+        {"duration_ms", event.duration_ms()},
+        {"recording", event.open()},
+        {"max_faces", event.max_faces},
+        {"face_frames", event.face_frames},
+        {"peak_confidence", event.peak_confidence},
+        {"video", file_or_null(event.video_file)},
+        {"video_bytes", event.video_bytes},
+        {"detections", event.video_file.empty() ? json(nullptr) : json(DetectionTrack::path_for(event.video_file))}, // 検出結果のトラック（/video?file=）
+        {"thumbnail", file_or_null(event.photo_file)},
+        {"thumbnail_bytes", event.photo_bytes}
+    };
+}
+
+// ページングのカーソル（"<開始時刻ms>_<id>"）を読み取る
+bool parse_event_cursor(const std::string& text, EventCursor& cursor) {
+    size_t sep = text.find('_');
+    if (sep == std::string::npos) {
+        return false;
+    }
+    cursor.start_ms = std::stoll(text.substr(0, sep));
+    cursor.id = std::stoull(text.substr(sep + 1));
+    return true;
+}
+
+// UNIX時間（秒）を読み取り、ミリ秒にする
+// 数字以外を含む値や、ミリ秒にするとint64_tに収まらない値はfalse
+bool parse_unix_seconds_ms(const std::string& text, int64_t& ms) {
+    int64_t seconds = 0;
+    auto result = std::from_chars(text.data(), text.data() + text.size(), seconds);
+    if (result.ec != std::errc() || result.ptr != text.data() + text.size()) {
+        return false;
+    }
+    if (seconds > std::numeric_limits<int64_t>::max() / 1000 || seconds < std::numeric_limits<int64_t>::min() / 1000) {
+        return false;
+    }
+    ms = seconds * 1000;
+    return true;
+}
+
+// 配信の応答は1回で接続を閉じてもらう
+// （送信後にkeep-aliveの次のリクエストを待つ間もワーカーは塞がるため、Webhook用に残したワーカーを削らない）
+void close_after_response(httplib::Response& res) {
+    res.set_header("Connection", "close");
+}
+
+// 同時実行数の上限を超えたリクエストへの503
+void reject_busy(httplib::Response& res, const char* retry_after) {
+    res.status = 503;
+    res.set_header("Retry-After", retry_after);
+    res.set_content("Server busy", "text/plain");
+}
+
+// メトリクスとトレースで使うHTTPのルート名
+const std::vector<std::string>& http_routes() {
+    static const std::vector<std::string> routes = {
+        "/image", "/video", "/live.mjpg", "/live/{file}", "/webhook", "/events", "/events/{id}", "/metrics", "/trace", "other"};
+    return routes;
+}
+
+// パスに対応するルートの番号
+size_t http_route_index(const std::string& path) {
+    const auto& routes = http_routes();
+    std::string route = "other";
+    if (path.compare(0, 6, "/live/") == 0) {
+        route = "/live/{file}";
+    } else if (path.compare(0, 8, "/events/") == 0) {
+        route = "/events/{id}";
+    } else if (std::find(routes.begin(), routes.end(), path) != routes.end()) {
+        route = path;
+    }
+    return std::find(routes.begin(), routes.end(), route) - routes.begin();
+}
+
+} // namespace
+
+
+// Webhookイベント（テキストメッセージ）を処理する関数
+// ディスパッチャースレッドから呼ばれるので、返信やコマンド結果待ちでHTTPワーカーを塞がない
+void WebServer::handle_webhook_event(const WebhookEvent& event, const AppConfig& config) {
+    log_info("ユーザーメッセージ", {{"text", event.text}});
+
+    // -応答ロジックの実装
+    // コマンド表から種類を引いて処理を振り分ける
+    switch (lookup_webhook_command(event.text)) {
+
+    // ！＝写真を送信
+    case WebhookCommand::TakePhoto:
+        if (!context_.monitoring_enabled.load()) {
+            line_.reply(event.reply_token, "監視が停止中のため、写真は表示されません。", config);
+        } else {
+            // カメラスレッドに撮影を依頼する（送信できれば写真が届くので返信しない）
+            push_command(event, ControlCommandType::TakePhoto, false, PHOTO_RESULT_TIMEOUT,
+                         [](bool sent) { return sent ? "" : "写真の送信に失敗しました。"; },
+                         "写真の撮影をまだ確認できていません。撮影できれば写真が届きます。");
+        }
+        break;
+
+    // ？＝監視状態を通知
+    case WebhookCommand::QueryStatus:
+        if (context_.monitoring_enabled.load()) {
+            line_.reply(event.reply_token, "現在、監視中です。", config);
+        } else {
+            line_.reply(event.reply_token, "現在、監視は停止中です。", config);
+        }
+        break;
+
+    // 監視停止＝監視とWeb公開を停止
+    // 結果はfalseなら「状態が変わらなかった（すでに停止中）」
+    case WebhookCommand::StopMonitoring:
+        push_command(event, ControlCommandType::SetMonitoring, false, MONITORING_RESULT_TIMEOUT,
+                     [](bool changed) { return changed ? "監視を停止します。（停止中は写真や動画は確認できません）" : "すでに監視は停止しています。"; },
+                     "監視の停止をまだ確認できていません。しばらくしてから「？」で状態を確認してください。");
+        break;
+
+    // 監視再開＝監視とWeb公開を再開
+    case WebhookCommand::ResumeMonitoring:
+        push_command(event, ControlCommandType::SetMonitoring, true, MONITORING_RESULT_TIMEOUT,
+                     [](bool changed) { return changed ? "監視を再開します。" : "すでに監視中です。"; },
+                     "監視の再開をまだ確認できていません。しばらくしてから「？」で状態を確認してください。");
+        break;
+
+    // プログラム終了＝プログラムを終了
+    case WebhookCommand::Shutdown:
+        context_.control_queue.push(ControlCommandType::Shutdown);
+        break;
+
+    // それ以外はコマンドリストを送信
+    case WebhookCommand::Help:
+        line_.reply(event.reply_token, 
+            "次の[コマンド]を送信できます。\n[コマンド]：説明\n\n[！]：写真を撮影し、LINEに送信します。\n[？]：監視状態を確認できます。\n[監視停止]：監視を停止し、再開まで待機します。\n[監視再開]：監視を再開します。\n[プログラム終了]：プログラムを終了します。", config);
+        break;
+    }
+}
+
+
+// コマンドをカメラスレッドに渡し、結果が出たら（timeoutを過ぎたら）ディスパッチャースレッドで1回だけ返信する
+// 結果を待つ間もディスパッチャーは次のイベントを処理する（「？」などが撮影の完了を待たない）
+// reply_for_resultが空文字列を返せば返信しない
+void WebServer::push_command(const WebhookEvent& event, ControlCommandType type, bool enable, std::chrono::milliseconds timeout,
+                             const char* (*reply_for_result)(bool ok), const char* reply_on_timeout) {
+    auto replied = std::make_shared<std::atomic<bool>>(false);
+    auto reply_once = [this, replied, reply_token = event.reply_token](const char* text) {
+        if (replied->exchange(true) || *text == '\0') {
+            return;
+        }
+        auto snapshot = config_store_.get();
+        line_.reply(reply_token, text, snapshot->app);
+    };
+    // 結果はカメラスレッドか通知スレッドから届くので、返信はディスパッチャーに積む
+    context_.control_queue.push(type, enable, [this, reply_once, reply_for_result](bool ok) {
+        const char* text = reply_for_result(ok);
+        webhook_dispatcher_.post_task([reply_once, text] { reply_once(text); });
+    });
+    webhook_dispatcher_.post_after(timeout, [reply_once, reply_on_timeout] { reply_once(reply_on_timeout); });
+}
+
+
+// キャッシュしたレスポンスを返す
+// ETagが一致すれば304、クライアントが対応していればgzip圧縮済みの本文を返す
+void WebServer::send_cached_response(const httplib::Request& req, httplib::Response& res, const CachedResponse& cached, const char* content_type) {
+    res.set_header("ETag", cached.etag);
+    res.set_header("Cache-Control", "no-cache"); // 毎回ETagで確認させる
+    res.set_header("Vary", "Accept-Encoding");
+    if (etag_matches(req.get_header_value("If-None-Match"), cached.etag)) {
+        context_.events_cache.count_not_modified();
+        res.status = 304;
+        return;
+    }
+    if (!cached.gzip_body.empty() && accepts_gzip(req.get_header_value("Accept-Encoding"))) {
+        res.set_header("Content-Encoding", "gzip");
+        res.set_content(cached.gzip_body, content_type);
+    } else {
+        res.set_content(cached.body, content_type);
+    }
+}
+
+
+// HTTPのルートごとの処理時間
+Histogram& WebServer::http_route_histogram(const std::string& path) {
+    return *route_histograms_[http_route_index(path)];
+}
+
+// HTTPのステータスコード（2xx / 3xx / 4xx / 5xx）ごとの応答数
+Counter& WebServer::http_status_counter(int status) {
+    return *status_counters_[std::min(std::max(status / 100, 2), 5) - 2];
+}
+
+// 各コンポーネントの統計をメトリクスとして登録する（Webサーバーの起動前に1回だけ呼ぶ）
+void WebServer::register_component_metrics() {
+    MetricsRegistry& metrics = context_.metrics.registry;
+
+    // ルートごとの処理時間と応答数（最初のリクエストより前に登録を済ませる）
+    for (const auto& route : http_routes()) {
+        route_histograms_.push_back(&metrics.histogram("picam_http_request_duration_seconds", "HTTPリクエストの処理時間（送信完了まで）",
+                                                       "route=\"" + route + "\""));
+    }
+    for (int i = 0; i < 4; i++) {
+        status_counters_[i] = &metrics.counter("picam_http_responses_total", "HTTPの応答数", "code=\"" + std::to_string(i + 2) + "xx\"");
+    }
+
+    metrics.gauge("picam_monitoring_enabled", "監視中なら1", [this] { return context_.monitoring_enabled.load() ? 1.0 : 0.0; });
+    metrics.gauge("picam_config_version", "設定ファイルのバージョン", [this] { return static_cast<double>(config_store_.version()); });
+
+    metrics.counter_fn("picam_control_commands_total", "処理した制御コマンドの数", [this] { return static_cast<double>(context_.control_queue.stats().count); });
+    metrics.gauge("picam_control_latency_max_seconds", "制御コマンドの受付から実行までの最大時間", [this] { return context_.control_queue.stats().max_ms / 1000.0; });
+
+    metrics.counter_fn("picam_notify_events_total", "受け付けたLINE通知の数", [this] { return static_cast<double>(context_.line_notifier->stats().events); });
+    metrics.counter_fn("picam_notify_api_calls_total", "LINE通知のpush回数", [this] { return static_cast<double>(context_.line_notifier->stats().api_calls); });
+    metrics.counter_fn("picam_notify_failures_total", "送信に失敗したLINE通知の数", [this] { return static_cast<double>(context_.line_notifier->stats().failures); });
+    metrics.gauge("picam_notify_latency_max_seconds", "LINE通知の受付から送信完了までの最大時間", [this] { return context_.line_notifier->stats().max_latency_ms / 1000.0; });
+
+    metrics.gauge("picam_retention_files", "保存されている写真・動画の数", [this] { return static_cast<double>(context_.retention->stats().files); });
+    metrics.gauge("picam_retention_bytes", "保存されている写真・動画の合計サイズ", [this] { return static_cast<double>(context_.retention->stats().bytes); });
+    metrics.counter_fn("picam_retention_deleted_files_total", "古いファイルとして削除した数", [this] { return static_cast<double>(context_.retention->stats().deleted_files); });
+    metrics.gauge("picam_retention_last_scan_seconds", "直近のディレクトリ走査にかかった時間", [this] { return context_.retention->stats().last_scan_ms / 1000.0; });
+
+    metrics.gauge("picam_events", "索引にある録画イベントの数", [this] { return static_cast<double>(context_.event_index->size()); });
+    metrics.counter_fn("picam_events_cache_hits_total", "/eventsの応答キャッシュのヒット数", [this] { return static_cast<double>(context_.events_cache.stats().hits); });
+    metrics.counter_fn("picam_events_cache_not_modified_total", "/eventsで304を返した数", [this] { return static_cast<double>(context_.events_cache.stats().not_modified); });
+
+    metrics.gauge("picam_frame_pool_slots", "フレームのバッファの数", [this] { return static_cast<double>(context_.frame_pool->stats().slots); });
+    metrics.gauge("picam_frame_pool_in_use", "使用中のフレームのバッファの数", [this] { return static_cast<double>(context_.frame_pool->stats().in_use); });
+    metrics.counter_fn("picam_frame_pool_grown_total", "空きがなくフレームのバッファを追加した回数", [this] { return static_cast<double>(context_.frame_pool->stats().grown); });
+    metrics.counter_fn("picam_frame_pool_reallocated_total", "フレームのバッファが作り直された回数", [this] { return static_cast<double>(context_.frame_pool->stats().reallocated); });
+
+    metrics.gauge("picam_live_viewers", "ライブ映像の視聴者数", [this] { return static_cast<double>(context_.frame_hub->stats().viewers); });
+    metrics.counter_fn("picam_live_encoded_frames_total", "ライブ映像のJPEG変換回数", [this] { return static_cast<double>(context_.frame_hub->stats().encoded); });
+    metrics.counter_fn("picam_live_dropped_frames_total", "変換が追いつかず捨てたライブ映像のフレーム数", [this] { return static_cast<double>(context_.frame_hub->stats().dropped); });
+}
+
+
+//Webサーバーを起動し、リクエストを処理する関数
+void WebServer::run(int port) {
+
+    // 起動時の設定（ワーカー数などはサーバー起動時にのみ反映される）
+    auto startup_config = config_store_.get();
+    const AppConfig& config = startup_config->app;
+
+    // Webhookの署名検証器はワーカースレッドごとに持ち、設定のスナップショットが変わったら作り直す
+    // （スレッド間で共有しないので、検証のたびにロックを取らない）
+    if (config.channel_secret.empty()) {
+        log_warn("CHANNEL_SECRETが未設定のため、Webhookリクエストはすべて拒否されます");
+    }
+
+    // ボディが上限を超えるリクエストは読み込む前に413で拒否する
+    // （LINEのイベントは数KB程度）
+    const size_t webhook_max_body = static_cast<size_t>(config.webhook_max_body);
+    svr_.set_payload_max_length(webhook_max_body);
+
+    // 画像・動画の保存先
+    const std::string photo_dir = config.photo_dir;
+    const std::string video_dir = config.video_dir;
+
+    // -ワーカースレッドと接続の制限
+    // Pi 4Bのメモリを使い切らないよう、ワーカー数と待ち行列の長さを固定する
+    const int http_workers = config.http_workers;
+    const int http_max_queued = config.http_max_queued;
+    svr_.new_task_queue = [http_workers, http_max_queued] {
+        return new httplib::ThreadPool(http_workers, http_max_queued);
+    };
+
+    // 遅いクライアントや放置されたkeep-alive接続がワーカーを占有し続けないようにする
+    svr_.set_read_timeout(config.http_read_timeout);
+    svr_.set_write_timeout(config.http_write_timeout);
+    svr_.set_keep_alive_timeout(std::chrono::duration_cast<std::chrono::seconds>(config.http_keep_alive_timeout).count());
+    svr_.set_keep_alive_max_count(config.http_keep_alive_max_count);
+
+    // 動画1本の送信にかけられる最大時間
+    const std::chrono::milliseconds max_transfer_time = config.http_max_transfer;
+
+    // ルートごとの同時実行数
+    // 画像・動画配信と索引などの検索はワーカーを最大 (ワーカー数 - Webhook予約分) までしか使えないため、
+    // 配信が混んでいてもWebhookを処理するワーカーは必ず残る
+    const int webhook_reserved = config.http_webhook_reserved_workers;
+    ConcurrencyLimiter media_limiter(http_workers - webhook_reserved);
+    ConcurrencyLimiter image_limiter(config.http_image_max_concurrency);
+    ConcurrencyLimiter video_limiter(config.http_video_max_concurrency);
+    ConcurrencyLimiter live_limiter(config.live_max_viewers);
+    // 索引の検索やメトリクス・トレースの書き出しも、Webhook用のワーカーを使わない
+    ConcurrencyLimiter query_limiter(config.http_query_max_concurrency);
+
+    log_info("[Server] ワーカー数", {{"workers", http_workers}, {"webhook_reserved", webhook_reserved}});
+
+    // -画像配信のエンドポイント
+    // ngrokのURL + /imageにアクセスが来たら処理が実行される
+    svr_.Get("/image", [&](const httplib::Request& req, httplib::Response& res) {
+        close_after_response(res);
+        if (!context_.monitoring_enabled.load()) {
+            res.status = 403;
+            res.set_content("Monitoring stopped", "text/plain");
+            return;
+        }
+
+        // 同時実行数の上限を超えていれば503を返す
+        auto slot = ConcurrencySlot::acquire(image_limiter, media_limiter);
+        if (!slot) {
+            reject_busy(res, "2");
+            return;
+        }
+
+        if (!req.has_param("file")) {
+            res.status = 400;
+            res.set_content("missing file parameter", "text/plain");
+            return;
+        }
+        // HTTPリクエストのパラメーターから値を取り出して文字列として受け取る
+        std::string filename = req.get_param_value("file");
+        std::string image_path = photo_dir + "/" + filename; 
+
+        // 読み込み中に削除されないよう登録する
+        auto lease = context_.retention->acquire(image_path);
+
+        // ファイルをバイナリで読む
+        std::ifstream ifs(image_path, std::ios::binary);
+        if (!ifs) {
+            res.set_content("Image not found", "text/plain");
+            res.status = 404;
+            return;
+        }
+
+        // ファイル内容をそのまま読み込む
+        std::string data((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+
+        // overlay=1 なら、同じ名前の録画の検出結果のトラックから撮影時（録画の先頭）の顔の枠を描く
+        // （保存した画像には枠を描かない。トラックがない写真はそのまま返す）
+        if (req.get_param_value("overlay") == "1") {
+            std::vector<cv::Rect> faces;
+            DetectionTrack::read_at(video_dir + "/" + DetectionTrack::path_for(filename), 0.0, faces);
+            if (!faces.empty()) {
+                cv::Mat image = cv::imdecode(cv::Mat(1, static_cast<int>(data.size()), CV_8UC1, data.data()), cv::IMREAD_COLOR);
+                std::vector<unsigned char> jpeg;
+                if (!image.empty()) {
+                    for (const cv::Rect& face : faces) {
+                        cv::rectangle(image, face, cv::Scalar(0, 0, 255), 2);
+                    }
+                    if (cv::imencode(".jpg", image, jpeg)) {
+                        data.assign(jpeg.begin(), jpeg.end());
+                    }
+                }
+            }
+        }
+
+        // HTTPレスポンスでバイナリとして送る
+        res.set_content(data, "image/jpeg");
+    });
+
+    
+    // -動画配信のエンドポイント
+    // ngrokのURL + /video.mp4 にアクセスが来たらこの処理が実行される
+    svr_.Get("/video", [&](const httplib::Request& req, httplib::Response& res) {
+        close_after_response(res);
+
+        if (!context_.monitoring_enabled.load()) {
+            res.status = 403;
+            res.set_content("Monitoring stopped", "text/plain");
+            return;
+        }
+        
+        if (!req.has_param("file")) {
+            res.status = 400;
+            res.set_content("missing file parameter", "text/plain");
+            return;
+        }
+
+        // 同時実行数の上限を超えていれば503を返す
+        auto slot = ConcurrencySlot::acquire(video_limiter, media_limiter);
+        if (!slot) {
+            reject_busy(res, "5");
+            return;
+        }
+
+        // HTTPリクエストのパラメーターから値を取り出して文字列として受け取る
+        std::string filename = req.get_param_value("file");
+        std::string video_path = video_dir + "/" + filename; 
+
+        // 送信が終わるまで削除されないよう登録する
+        auto lease = context_.retention->acquire(video_path);
+        auto ifs = std::make_shared<std::ifstream>(video_path, std::ios::binary | std::ios::ate);
+
+        if (!*ifs) {
+            res.set_content("Video not found", "text/plain");
+            res.status = 404;
+            return;
+        }
+
+        // ファイル全体をメモリに読み込まず、少しずつ読みながら送信する
+        // （Rangeリクエストにも対応し、枠は送信完了まで保持する）
+        size_t file_size = static_cast<size_t>(ifs->tellg());
+        auto deadline = std::chrono::steady_clock::now() + max_transfer_time;
+
+        // 動画と同じ名前の .vtt は検出結果のトラック（<track kind="metadata"> で読める）
+        bool is_track = filename.size() > 4 && filename.compare(filename.size() - 4, 4, ".vtt") == 0;
+
+        res.set_content_provider(file_size, is_track ? "text/vtt" : "video/mp4",
+            [ifs, slot, lease, deadline](size_t offset, size_t length, httplib::DataSink& sink) {
+                // 送信時間の上限を超えたら打ち切る
+                if (std::chrono::steady_clock::now() > deadline) {
+                    return false;
+                }
+                char buffer[64 * 1024];
+                ifs->seekg(static_cast<std::streamoff>(offset));
+                ifs->read(buffer, static_cast<std::streamsize>(std::min(length, sizeof(buffer))));
+                std::streamsize n = ifs->gcount();
+                if (n <= 0) {
+                    return false;
+                }
+                return sink.write(buffer, static_cast<size_t>(n));
+            },
+            [](bool success) {
+                if (success) {
+                    log_info("[Server] ビデオが正常に送信されました");
+                }
+            });
+        res.status = 200;
+    });
+
+
+    // -ライブ映像のエンドポイント
+    // カメラのフレームをMJPEG（multipart/x-mixed-replace）で配信する
+    // JPEGへの変換はFrameHubが1フレームに1回だけ行い、全視聴者で共有する
+    const std::chrono::milliseconds live_max_duration = config.live_max_duration;
+    svr_.Get("/live.mjpg", [&, live_max_duration](const httplib::Request&, httplib::Response& res) {
+        close_after_response(res);
+
+        if (!context_.monitoring_enabled.load()) {
+            res.status = 403;
+            res.set_content("Monitoring stopped", "text/plain");
+            return;
+        }
+
+        // 視聴者数の上限と、画像・動画配信と共有するワーカーの枠を確保する
+        // （視聴中はワーカーを1つ占有する）
+        auto slot = ConcurrencySlot::acquire(live_limiter, media_limiter);
+        if (!slot) {
+            reject_busy(res, "10");
+            return;
+        }
+
+        auto viewer = context_.frame_hub->add_viewer();
+        auto deadline = std::chrono::steady_clock::now() + live_max_duration;
+        auto last_seq = std::make_shared<uint64_t>(0);
+        res.set_header("Cache-Control", "no-cache, no-store");
+        res.set_chunked_content_provider("multipart/x-mixed-replace; boundary=frame",
+            [this, viewer, slot, deadline, last_seq](size_t, httplib::DataSink& sink) {
+                // 視聴時間の上限を超えたら打ち切る
+                if (std::chrono::steady_clock::now() > deadline) {
+                    sink.done();
+                    return true;
+                }
+                FrameHub::Frame frame;
+                if (!context_.frame_hub->wait_next(*last_seq, std::chrono::milliseconds(1000), frame)) {
+                    // 監視停止中などでフレームが来ない。接続が切れていれば終了する
+                    return sink.is_writable();
+                }
+                *last_seq = frame.seq;
+                std::string header = "--frame\r\nContent-Type: image/jpeg\r\nContent-Length: " +
+                                     std::to_string(frame.jpeg->size()) + "\r\n\r\n";
+                return sink.write(header.data(), header.size()) &&
+                       sink.write(reinterpret_cast<const char*>(frame.jpeg->data()), frame.jpeg->size()) &&
+                       sink.write("\r\n", 2);
+            });
+    });
+
+    // -録画中のHLSライブ配信
+    // /live/live.m3u8 とセグメント（/live/seg00000.ts など）をtmpfsから返す
+    svr_.Get(R"(/live/([A-Za-z0-9_.]+))", [&](const httplib::Request& req, httplib::Response& res) {
+        close_after_response(res);
+
+        if (!context_.monitoring_enabled.load()) {
+            res.status = 403;
+            res.set_content("Monitoring stopped", "text/plain");
+            return;
+        }
+
+        std::string path;
+        std::string content_type;
+        if (!context_.hls || !context_.hls->resolve(req.matches[1].str(), path, content_type)) {
+            res.status = 404;
+            res.set_content("Not found", "text/plain");
+            return;
+        }
+
+        // セグメントは小さく短時間で返せるので、画像と同じ枠を使う
+        auto slot = ConcurrencySlot::acquire(image_limiter, media_limiter);
+        if (!slot) {
+            reject_busy(res, "1");
+            return;
+        }
+
+        std::ifstream ifs(path, std::ios::binary);
+        if (!ifs) {
+            res.status = 404;
+            res.set_content("Not found", "text/plain");
+            return;
+        }
+        std::string data((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+
+        // プレイリストは毎回取り直させ、セグメントは内容が変わらないのでキャッシュさせる
+        res.set_header("Cache-Control", content_type == "video/mp2t" ? "max-age=60" : "no-cache, no-store");
+        res.set_content(data, content_type.c_str());
+    });
+
+    // -ライブ映像の統計
+    // 視聴者数と、JPEG変換の回数・時間（視聴者数が増えても変換回数は増えない）
+    svr_.Get("/live_stats", [this](const httplib::Request&, httplib::Response& res) {
+        FrameHubStats stats = context_.frame_hub->stats();
+        json stats_json = {
+            {"viewers", stats.viewers},
+            {"published", stats.published},
+            {"encoded", stats.encoded},
+            {"dropped", stats.dropped},
+            {"avg_encode_ms", stats.avg_encode_ms}
+        };
+        res.set_content(stats_json.dump(), "application/json");
+    });
+
+
+    // -Webhookリクエストへの処理
+    // LINE Developersに設定したWebhookURLにアクセスが来たらこの処理が実行される
+    // イベントをディスパッチャーに積んだらすぐに200を返す（LINE側のタイムアウト・再送を防ぐ）
+    svr_.Post("/webhook", [&](const httplib::Request& req, httplib::Response& res) {
+
+        // ボディサイズの確認
+        if (req.body.size() > webhook_max_body) {
+            res.set_content("Payload Too Large", "text/plain");
+            res.status = 413;
+            return;
+        }
+
+        // 署名の検証（JSONの解析より前に行い、不正なリクエストは安く弾く）
+        // 検証器を作ったときのスナップショットを持っておくので、アドレスの比較で変更が分かる
+        thread_local std::shared_ptr<const ConfigSnapshot> verifier_config;
+        thread_local std::unique_ptr<LineSignatureVerifier> verifier;
+        auto snapshot = config_store_.get();
+        if (snapshot != verifier_config) {
+            verifier = std::make_unique<LineSignatureVerifier>(snapshot->app.channel_secret);
+            verifier_config = std::move(snapshot);
+        }
+        if (!verifier->verify(req.body, req.get_header_value("X-Line-Signature"))) {
+            res.set_content("Unauthorized", "text/plain");
+            res.status = 401;
+            return;
+        }
+
+        // リクエストボディの解析
+        // DOMを作らずに、必要なフィールドだけをストリーミングで取り出す
+        // （vectorはワーカースレッドごとに使い回す）
+        thread_local std::vector<WebhookEvent> events;
+        events.clear();
+        if (!parse_webhook_events(req.body, events)) {
+            log_warn("JSON解析エラー");
+            res.set_content("Bad Request", "text/plain");
+            res.status = 400;
+            return;
+        }
+
+        log_info("Webhookリクエストを受信しました", {{"events", events.size()}});
+
+        // テキストメッセージのイベントをディスパッチャーに積む
+        for (auto& event : events) {
+            if (!webhook_dispatcher_.post(std::move(event))) {
+                log_warn("Webhookイベントのキューが一杯のため破棄しました");
+            }
+        }
+
+        res.set_content("OK", "text/plain");
+        res.status = 200;
+    });
+
+
+    // -制御コマンドの遅延統計
+    // Webhookでコマンドを受けてから、カメラスレッドが実行するまでの時間
+    svr_.Get("/control_stats", [this](const httplib::Request&, httplib::Response& res) {
+        ControlLatencyStats stats = context_.control_queue.stats();
+        json stats_json = {
+            {"count", stats.count},
+            {"avg_ms", stats.avg_ms},
+            {"max_ms", stats.max_ms},
+            {"last_ms", stats.last_ms}
+        };
+        res.set_content(stats_json.dump(), "application/json");
+    });
+
+
+    // -設定のバージョン
+    // 設定ファイルの再読み込みに成功するたびに増える
+    svr_.Get("/config_version", [this](const httplib::Request&, httplib::Response& res) {
+        auto snapshot = config_store_.get();
+        json version_json = {
+            {"version", snapshot->version},
+            {"loaded_at", std::chrono::duration_cast<std::chrono::seconds>(snapshot->loaded_at.time_since_epoch()).count()}
+        };
+        res.set_content(version_json.dump(), "application/json");
+    });
+
+
+    // -録画イベントの一覧
+    // /events?from=<UNIX時間（秒）>&to=<UNIX時間（秒）>&limit=<件数>&cursor=<前回のnext_cursor>
+    // 開始時刻が範囲内のイベントを新しい順に返す。索引だけを参照し、動画・画像ファイルには触れない
+    // 応答は新しいイベントが記録されるまでキャッシュし、ETagが一致すれば304を返す
+    svr_.Get("/events", [&](const httplib::Request& req, httplib::Response& res) {
+        auto slot = ConcurrencySlot::acquire(query_limiter, media_limiter);
+        if (!slot) {
+            reject_busy(res, "1");
+            return;
+        }
+        int64_t from_ms = 0;
+        int64_t to_ms = std::numeric_limits<int64_t>::max();
+        size_t limit = 50;
+        EventCursor cursor;
+        try {
+            if (req.has_param("from") && !parse_unix_seconds_ms(req.get_param_value("from"), from_ms)) {
+                throw std::invalid_argument("from");
+            }
+            if (req.has_param("to") && !parse_unix_seconds_ms(req.get_param_value("to"), to_ms)) {
+                throw std::invalid_argument("to");
+            }
+            if (req.has_param("limit")) limit = std::max<size_t>(1, std::min<size_t>(std::stoul(req.get_param_value("limit")), 500));
+            if (req.has_param("cursor") && !parse_event_cursor(req.get_param_value("cursor"), cursor)) {
+                throw std::invalid_argument("cursor");
+            }
+        } catch (const std::exception&) {
+            res.status = 400;
+            res.set_content("invalid parameter", "text/plain");
+            return;
+        }
+
+        // 正規化したパラメーターをキャッシュのキーにする
+        std::string key = std::to_string(from_ms) + "/" + std::to_string(to_ms) + "/" + std::to_string(limit) + "/" +
+                          std::to_string(cursor.start_ms) + "_" + std::to_string(cursor.id);
+        auto cached = context_.events_cache.get(key, context_.event_index->version(), [&] {
+            bool has_more = false;
+            std::vector<EventRecord> events = context_.event_index->query(from_ms, to_ms, limit, cursor, &has_more);
+            json events_json = json::array();
+            for (const EventRecord& event : events) {
+                events_json.push_back(event_to_json(event));
+            }
+            json page_json = {{"events", events_json}, {"next_cursor", nullptr}};
+            if (has_more) {
+                page_json["next_cursor"] = std::to_string(events.back().start_ms) + "_" + std::to_string(events.back().id);
+            }
+            return page_json.dump();
+        });
+        send_cached_response(req, res, *cached, "application/json");
+    });
+
+    // -録画イベント1件
+    // /events/<id>
+    svr_.Get(R"(/events/(\d+))", [&](const httplib::Request& req, httplib::Response& res) {
+        auto slot = ConcurrencySlot::acquire(query_limiter, media_limiter);
+        if (!slot) {
+            reject_busy(res, "1");
+            return;
+        }
+        EventRecord event;
+        uint64_t id = 0;
+        try {
+            id = std::stoull(req.matches[1].str());
+        } catch (const std::exception&) {
+            res.status = 400;
+            return;
+        }
+        // バージョンはイベントを読む前に取る（間に更新されても、次の確認で新しいETagになる）
+        uint64_t version = context_.event_index->version();
+        std::string etag = context_.events_cache.etag_for(version);
+        // ETagは索引全体のバージョンなので、存在しないidでも一致する。先にidを確かめる
+        if (!context_.event_index->get(id, event)) {
+            res.status = 404;
+            res.set_content("Event not found", "text/plain");
+            return;
+        }
+        if (etag_matches(req.get_header_value("If-None-Match"), etag)) {
+            context_.events_cache.count_not_modified();
+            res.status = 304;
+            res.set_header("ETag", etag);
+            return;
+        }
+        res.set_header("ETag", etag);
+        res.set_header("Cache-Control", "no-cache");
+        res.set_content(event_to_json(event).dump(), "application/json");
+    });
+
+
+    // -保存ファイルの整理の統計
+    // 索引にあるファイル数・合計サイズ、削除数、ディレクトリの走査にかかった時間
+    svr_.Get("/retention_stats", [this](const httplib::Request&, httplib::Response& res) {
+        RetentionStats stats = context_.retention->stats();
+        json stats_json = {
+            {"files", stats.files},
+            {"bytes", stats.bytes},
+            {"deleted_files", stats.deleted_files},
+            {"deleted_bytes", stats.deleted_bytes},
+            {"skipped_in_use", stats.skipped_in_use},
+            {"scans", stats.scans},
+            {"last_scan_files", stats.last_scan_files},
+            {"last_scan_ms", stats.last_scan_ms}
+        };
+        res.set_content(stats_json.dump(), "application/json");
+    });
+
+
+    // -LINE通知の統計
+    // 通知1件あたりのAPI呼び出し回数と、受付から送信完了までの時間
+    svr_.Get("/notify_stats", [this](const httplib::Request&, httplib::Response& res) {
+        if (!context_.line_notifier) {
+            res.status = 503;
+            return;
+        }
+        LineNotifierStats stats = context_.line_notifier->stats();
+        json stats_json = {
+            {"events", stats.events},
+            {"api_calls", stats.api_calls},
+            {"failures", stats.failures},
+            {"calls_per_event", stats.calls_per_event},
+            {"avg_latency_ms", stats.avg_latency_ms},
+            {"max_latency_ms", stats.max_latency_ms}
+        };
+        res.set_content(stats_json.dump(), "application/json");
+    });
+
+    // -メトリクス（Prometheusのテキスト形式）
+    // 各段階・各ルートの処理時間のヒストグラムと、各コンポーネントの統計
+    register_component_metrics();
+    svr_.Get("/metrics", [&](const httplib::Request&, httplib::Response& res) {
+        auto slot = ConcurrencySlot::acquire(query_limiter, media_limiter);
+        if (!slot) {
+            reject_busy(res, "1");
+            return;
+        }
+        res.set_content(context_.metrics.registry.render(), "text/plain; version=0.0.4");
+    });
+
+    // -トレース（Chromeのトレース形式。Perfettoやchrome://tracingで開く）
+    // /trace?seconds=<秒数> で直近の区間を取得する（省略時はTRACE_WINDOW）
+    const std::chrono::milliseconds trace_window = config.trace_window;
+    svr_.Get("/trace", [&, trace_window](const httplib::Request& req, httplib::Response& res) {
+        if (!trace_buffer().enabled()) {
+            res.status = 404;
+            res.set_content("Tracing disabled (TRACE_ENABLED=1)", "text/plain");
+            return;
+        }
+        std::chrono::milliseconds window = trace_window;
+        if (req.has_param("seconds")) {
+            try {
+                window = std::chrono::seconds(std::max(1, std::min(std::stoi(req.get_param_value("seconds")), 3600)));
+            } catch (const std::exception&) {
+                res.status = 400;
+                res.set_content("invalid seconds", "text/plain");
+                return;
+            }
+        }
+        auto slot = ConcurrencySlot::acquire(query_limiter, media_limiter);
+        if (!slot) {
+            reject_busy(res, "1");
+            return;
+        }
+        std::string body = trace_buffer().render_json(window);
+        std::string compressed;
+        if (accepts_gzip(req.get_header_value("Accept-Encoding")) && gzip_compress(body, compressed)) {
+            res.set_header("Content-Encoding", "gzip");
+            body = std::move(compressed);
+        }
+        res.set_header("Content-Disposition", "attachment; filename=\"picam_trace.json\"");
+        res.set_content(std::move(body), "application/json");
+    });
+
+    // ルートごとの処理時間（レスポンスの送信完了まで）を記録する
+    // ルーティングの前に弾かれたリクエスト（413・400など）は開始時刻がないので、応答数だけ数える
+    svr_.set_pre_routing_handler([](const httplib::Request& req, httplib::Response&) {
+        TraceBuffer::set_thread_name("http");
+        HttpRequestTimer::begin(req);
+        return httplib::Server::HandlerResponse::Unhandled;
+    });
+    svr_.set_post_routing_handler([](const httplib::Request& req, httplib::Response&) {
+        HttpRequestTimer::respond(req);
+    });
+    svr_.set_logger([this](const httplib::Request& req, const httplib::Response& res) {
+        http_status_counter(res.status).add();
+        HttpRequestTimer::Clock::time_point request_begin;
+        if (!HttpRequestTimer::take(req, request_begin)) {
+            return;
+        }
+        auto request_end = HttpRequestTimer::Clock::now();
+        http_route_histogram(req.path).observe(request_end - request_begin);
+        trace_buffer().record(http_routes()[http_route_index(req.path)].c_str(), request_begin, request_end);
+    });
+
+    // Webhookイベントの処理スレッドを起動
+    // イベントごとに最新の設定を使う（トークンの差し替えがすぐに反映される）
+    webhook_dispatcher_.start([this](const WebhookEvent& event) {
+        auto snapshot = config_store_.get();
+        handle_webhook_event(event, snapshot->app);
+    });
+
+    // ポートはstop()と排他で開く（stop()が先なら開かない。後なら待ち受けの開始を待ってから止める）
+    int bound_port = -1;
+    {
+        std::lock_guard<std::mutex> lock(listen_mutex_);
+        if (stop_requested_) {
+            svr_.decommission(); // wait_until_ready()で待っているスレッドを戻す
+        } else {
+            bound_port = port == 0 ? svr_.bind_to_any_port("0.0.0.0") : (svr_.bind_to_port("0.0.0.0", port) ? port : -1);
+            if (bound_port < 0) {
+                log_error("[Server] ポートを開けませんでした", {{"port", port}});
+            } else {
+                port_ = bound_port;
+            }
+        }
+    }
+    if (bound_port >= 0) {
+        log_info("[Server] 待ち受けを開始しました", {{"port", bound_port}});
+        // listen_after_bind() はブロッキング関数（処理がここで止まって待ち受ける）
+        svr_.listen_after_bind();
+        // listen_after_bind() が返ってくるのは通常、サーバー停止時のみ
+    }
+
+    // 残っているイベントを処理してからディスパッチャーを終了
+    webhook_dispatcher_.stop();
+}
+
+void WebServer::stop() {
+    std::lock_guard<std::mutex> lock(listen_mutex_);
+    if (stop_requested_) {
+        return;
+    }
+    stop_requested_ = true;
+    if (port_ >= 0) {
+        // ポートを開いた直後はまだ待ち受けが始まっていないことがある（そのまま止めると待ち受けが続く）
+        svr_.wait_until_ready();
+        svr_.stop();
+    }
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "httplib.h"
+#include "config_store.h"
+#include "line_client.h"
+#include "picam_context.h"
+#include "webhook_dispatcher.h"
+#include "webhook_parser.h"
+
+// Webサーバー（画像・動画・ライブ映像の配信、LINEのWebhook、統計とメトリクス）
+// run()は待ち受けを続けるので専用のスレッドで呼び、stop()で止める
+class WebServer {
+public:
+    WebServer(PicamContext& context, ConfigStore& config_store, LineClient& line)
+        : context_(context), config_store_(config_store), line_(line) {}
+
+    WebServer(const WebServer&) = delete;
+    WebServer& operator=(const WebServer&) = delete;
+
+    // ルートを登録して待ち受ける（stop()が呼ばれるまで戻らない）
+    // portが0なら空いているポートで待ち受ける（テスト用。番号はwait_until_ready()で取得する）
+    void run(int port);
+
+    // 待ち受けが始まるまで待ち、ポート番号を返す（待ち受けられなかったら-1）
+    int wait_until_ready() {
+        svr_.wait_until_ready();
+        return svr_.is_running() ? port_.load() : -1;
+    }
+
+    // 待ち受けを止める（別のスレッドから呼ぶ。run()より先に呼ばれたら、run()は待ち受けずに戻る）
+    void stop();
+
+private:
+    // Webhookイベント（テキストメッセージ）を処理する
+    void handle_webhook_event(const WebhookEvent& event, const AppConfig& config);
+
+    // コマンドをカメラスレッドに渡し、結果か時間切れの返信を後からディスパッチャーで送る（結果を待たない）
+    void push_command(const WebhookEvent& event, ControlCommandType type, bool enable, std::chrono::milliseconds timeout,
+                      const char* (*reply_for_result)(bool ok), const char* reply_on_timeout);
+
+    // 各コンポーネントの統計をメトリクスとして登録する（待ち受けの前に1回だけ呼ぶ）
+    void register_component_metrics();
+
+    // キャッシュしたレスポンスを返す
+    void send_cached_response(const httplib::Request& req, httplib::Response& res, const CachedResponse& cached,
+                              const char* content_type);
+
+    // HTTPのルートごとの処理時間と、ステータスコードごとの応答数
+    Histogram& http_route_histogram(const std::string& path);
+    Counter& http_status_counter(int status);
+
+    PicamContext& context_;
+    ConfigStore& config_store_;
+    LineClient& line_;
+    httplib::Server svr_;
+    std::atomic<int> port_{-1}; // 待ち受けているポート
+    std::mutex listen_mutex_;   // ポートを開く処理とstop()の順序を決める
+    bool stop_requested_ = false;
+    WebhookDispatcher webhook_dispatcher_; // Webhookイベントを処理するスレッド
+    std::vector<Histogram*> route_histograms_; // http_routes()の順
+    std::array<Counter*, 4> status_counters_{}; // 2xx / 3xx / 4xx / 5xx
+};
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Webhookで受け取ったテキストメッセージイベント
+struct WebhookEvent {
+    std::string text;
+    std::string reply_token;
+};
+
+// Webhookイベントを別スレッドで処理するディスパッチャー
+// HTTPハンドラはpost()で積むだけにして、LINEへの返信などの重い処理はこのスレッドで行う
+// カメラスレッドの処理結果を待つ間もこのスレッドは塞がず、結果や時間切れの返信はpost_task()・post_after()で後から積む
+class WebhookDispatcher {
+public:
+    using Handler = std::function<void(const WebhookEvent&)>;
+    using Task = std::function<void()>;
+    using Clock = std::chrono::steady_clock;
+
+    explicit WebhookDispatcher(size_t max_queued = 64) : max_queued_(max_queued) {}
+
+    ~WebhookDispatcher() { stop(); }
+
+    void start(Handler handler) {
+        handler_ = std::move(handler);
+        running_ = true;
+        worker_ = std::thread(&WebhookDispatcher::run, this);
+    }
+
+    // 残っているイベントと処理を済ませてからスレッドを終了する（時刻を待っている処理はその場で実行する）
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            running_ = false;
+        }
+        cv_.notify_all();
+        if (worker_.joinable()) {
+            worker_.join();
+        }
+    }
+
+    // イベントを積む。キューが一杯ならfalseを返す
+    bool post(WebhookEvent event) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (queue_.size() >= max_queued_) {
+                return false;
+            }
+            queue_.push_back(std::move(event));
+        }
+        cv_.notify_one();
+        return true;
+    }
+
+    // このスレッドで実行する処理を積む（コマンドの結果の返信など。イベントより先に実行し、上限はない）
+    // スレッドが終了した後は捨てる
+    void post_task(Task task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (finished_) {
+                return;
+            }
+            tasks_.push_back(std::move(task));
+        }
+        cv_.notify_one();
+    }
+
+    // delayが経過したらこのスレッドで実行する処理を積む（結果を待つ時間切れの返信など）
+    void post_after(std::chrono::milliseconds delay, Task task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (finished_) {
+                return;
+            }
+            timers_.emplace(Clock::now() + delay, std::move(task));
+        }
+        cv_.notify_one();
+    }
+
+private:
+    void run() {
+        while (true) {
+            WebhookEvent event;
+            Task task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                while (true) {
+                    if (!tasks_.empty()) {
+                        task = std::move(tasks_.front());
+                        tasks_.pop_front();
+                        break;
+                    }
+                    if (!timers_.empty() && (!running_ || timers_.begin()->first <= Clock::now())) {
+                        task = std::move(timers_.begin()->second);
+                        timers_.erase(timers_.begin());
+                        break;
+                    }
+                    if (!queue_.empty()) {
+                        event = std::move(queue_.front());
+                        queue_.pop_front();
+                        break;
+                    }
+                    if (!running_) {
+                        finished_ = true; // 処理待ちなし
+                        return;
+                    }
+                    if (timers_.empty()) {
+                        cv_.wait(lock);
+                    } else {
+                        cv_.wait_until(lock, timers_.begin()->first);
+                    }
+                }
+            }
+            if (task) {
+                task();
+            } else {
+                handler_(event);
+            }
+        }
+    }
+
+    size_t max_queued_;
+    Handler handler_;
+    bool running_ = false;
+    bool finished_ = false; // スレッドが終了した（以降の処理は捨てる）
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<WebhookEvent> queue_;
+    std::deque<Task> tasks_;
+    std::multimap<Clock::time_point, Task> timers_;
+    std::thread worker_;
+};
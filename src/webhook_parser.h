@@ -0,0 +1,188 @@
+#pragma once
+
+#include <array>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+#include "webhook_dispatcher.h"
+
+// -LINEから送られるコマンド
+enum class WebhookCommand {
+    TakePhoto,        // ！
+    QueryStatus,      // ？
+    StopMonitoring,   // 監視停止
+    ResumeMonitoring, // 監視再開
+    Shutdown,         // プログラム終了
+    Help              // それ以外（コマンド一覧を返信）
+};
+
+struct WebhookCommandEntry {
+    std::string_view text;
+    WebhookCommand command;
+};
+
+// コマンド文字列の対応表（コンパイル時に確定する）
+constexpr std::array<WebhookCommandEntry, 5> WEBHOOK_COMMAND_TABLE = {{
+    {"！", WebhookCommand::TakePhoto},
+    {"？", WebhookCommand::QueryStatus},
+    {"監視停止", WebhookCommand::StopMonitoring},
+    {"監視再開", WebhookCommand::ResumeMonitoring},
+    {"プログラム終了", WebhookCommand::Shutdown},
+}};
+
+// メッセージ文字列からコマンドを引く（メモリ確保なし）
+constexpr WebhookCommand lookup_webhook_command(std::string_view text) {
+    for (const auto& entry : WEBHOOK_COMMAND_TABLE) {
+        if (entry.text == text) {
+            return entry.command;
+        }
+    }
+    return WebhookCommand::Help;
+}
+
+static_assert(lookup_webhook_command("監視再開") == WebhookCommand::ResumeMonitoring, "command table");
+static_assert(lookup_webhook_command("監視") == WebhookCommand::Help, "command table");
+
+
+// -Webhookボディのストリーミング解析
+// JSONのDOMを作らず、events[]の type / message.type / message.text / replyToken だけを取り出す
+class WebhookSaxHandler : public nlohmann::json_sax<nlohmann::json> {
+public:
+    explicit WebhookSaxHandler(std::vector<WebhookEvent>& events) : events_(events) {}
+
+    bool null() override { return true; }
+    bool boolean(bool) override { return true; }
+    bool number_integer(number_integer_t) override { return true; }
+    bool number_unsigned(number_unsigned_t) override { return true; }
+    bool number_float(number_float_t, const string_t&) override { return true; }
+    bool binary(binary_t&) override { return true; }
+
+    bool string(string_t& value) override {
+        switch (top()) {
+        case Scope::Event:
+            if (key_[depth_] == Key::Type) {
+                event_type_is_message_ = (value == "message");
+            } else if (key_[depth_] == Key::ReplyToken) {
+                current_.reply_token.swap(value);
+            }
+            break;
+        case Scope::Message:
+            if (key_[depth_] == Key::Type) {
+                message_type_is_text_ = (value == "text");
+            } else if (key_[depth_] == Key::Text) {
+                current_.text.swap(value);
+            }
+            break;
+        default:
+            break;
+        }
+        return true;
+    }
+
+    bool key(string_t& value) override {
+        if (depth_ < MAX_DEPTH) {
+            key_[depth_] = to_key(value);
+        }
+        return true;
+    }
+
+    bool start_object(std::size_t) override {
+        Scope parent = top();
+        Scope scope = Scope::Other;
+        if (depth_ == 0) {
+            scope = Scope::Root;
+        } else if (parent == Scope::Events) {
+            scope = Scope::Event;
+            current_.text.clear();
+            current_.reply_token.clear();
+            event_type_is_message_ = false;
+            message_type_is_text_ = false;
+        } else if (parent == Scope::Event && key_[depth_] == Key::Message) {
+            scope = Scope::Message;
+        }
+        push(scope);
+        return true;
+    }
+
+    bool end_object() override {
+        // テキストメッセージのイベントだけを結果に追加
+        if (top() == Scope::Event && event_type_is_message_ && message_type_is_text_) {
+            events_.push_back(std::move(current_));
+            current_ = WebhookEvent();
+        }
+        pop();
+        return true;
+    }
+
+    bool start_array(std::size_t) override {
+        push((top() == Scope::Root && key_[depth_] == Key::Events) ? Scope::Events : Scope::Other);
+        return true;
+    }
+
+    bool end_array() override {
+        pop();
+        return true;
+    }
+
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception&) override {
+        return false;
+    }
+
+private:
+    // 現在位置しているJSONコンテナの種類
+    enum class Scope { None, Root, Events, Event, Message, Other };
+    // 注目するキー（文字列を保持せず列挙値で覚える）
+    enum class Key { Other, Events, Type, ReplyToken, Message, Text };
+
+    static constexpr int MAX_DEPTH = 16;
+
+    static Key to_key(const string_t& k) {
+        if (k == "type") return Key::Type;
+        if (k == "text") return Key::Text;
+        if (k == "message") return Key::Message;
+        if (k == "replyToken") return Key::ReplyToken;
+        if (k == "events") return Key::Events;
+        return Key::Other;
+    }
+
+    Scope top() const {
+        if (depth_ == 0) return Scope::None;
+        return depth_ <= MAX_DEPTH ? scope_[depth_ - 1] : Scope::Other;
+    }
+
+    // スコープを積む（深すぎる階層はOther扱いで深さだけ数える）
+    void push(Scope scope) {
+        if (depth_ < MAX_DEPTH) {
+            scope_[depth_] = scope;
+        }
+        depth_++;
+        if (depth_ < MAX_DEPTH) {
+            key_[depth_] = Key::Other;
+        }
+    }
+
+    void pop() {
+        if (depth_ > 0) {
+            depth_--;
+        }
+    }
+
+    std::vector<WebhookEvent>& events_;
+    WebhookEvent current_;
+    bool event_type_is_message_ = false;
+    bool message_type_is_text_ = false;
+
+    int depth_ = 0;
+    std::array<Scope, MAX_DEPTH> scope_{};
+    // key_[d] は深さdのオブジェクト内で最後に読んだキー
+    std::array<Key, MAX_DEPTH + 1> key_{};
+};
+
+// Webhookボディを解析し、テキストメッセージのイベントをeventsに追加する
+// 不正なJSONならfalseを返す
+inline bool parse_webhook_events(const std::string& body, std::vector<WebhookEvent>& events) {
+    WebhookSaxHandler handler(events);
+    return nlohmann::json::sax_parse(body, &handler);
+}
@@ -0,0 +1,22 @@
+# リプレイのevents.logを正解ファイルと比較する（ctestから cmake -P で呼ぶ）
+#
+#   cmake -DMAIN_APP=<main_app> -DFRAMES=<連番画像のパターン> -DLABELS=<.labels> -DCONFIG=<設定>
+#         -DGOLDEN=<正解のevents.log> -DOUT=<出力先> -P replay_golden.cmake
+#
+# 意図して挙動を変えた場合は、出力先のevents.logを正解ファイルにコピーして更新する
+
+file(REMOVE_RECURSE ${OUT})
+execute_process(
+    COMMAND ${MAIN_APP} --replay ${FRAMES} --fast --fps 15 --detections ${LABELS} --config ${CONFIG} --out ${OUT}
+    RESULT_VARIABLE result
+)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "リプレイが失敗しました（終了コード ${result}）")
+endif()
+
+file(READ ${GOLDEN} expected)
+file(READ ${OUT}/events.log actual)
+if(NOT actual STREQUAL expected)
+    execute_process(COMMAND diff -u ${GOLDEN} ${OUT}/events.log)
+    message(FATAL_ERROR "events.logが正解と異なります: ${OUT}/events.log")
+endif()
@@ -0,0 +1,77 @@
+// 設定ファイルの読み込みとConfigStoreのスナップショットのテスト
+
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "app_config.h"
+#include "config_store.h"
+#include "test_harness.h"
+#include "test_support.h"
+
+TEST_CASE("config/reload_replaces_snapshot_on_every_thread") {
+    TempDir dir;
+    std::string path = dir / "config.txt";
+    write_test_config(path, {{"CAMERA_FPS", "10"}});
+    ConfigStore store(path);
+    REQUIRE(store.reload());
+
+    auto first = store.get();
+    REQUIRE(first);
+    CHECK_EQ(first->version, 1u);
+    CHECK_EQ(first->app.camera_fps, 10);
+    // 変わっていなければ同じスナップショット
+    CHECK(store.get() == first);
+
+    write_test_config(path, {{"CAMERA_FPS", "12"}});
+    REQUIRE(store.reload());
+    auto second = store.get();
+    CHECK_EQ(second->version, 2u);
+    CHECK_EQ(second->app.camera_fps, 12);
+    // 持っていた古いスナップショットはそのまま使える
+    CHECK_EQ(first->app.camera_fps, 10);
+
+    // 別のスレッドも新しい設定を見る
+    int seen = 0;
+    std::thread reader([&] { seen = store.get()->app.camera_fps; });
+    reader.join();
+    CHECK_EQ(seen, 12);
+
+    // 検証に通らない設定は反映しない
+    write_test_config(path, {{"CAMERA_FPS", "abc"}});
+    CHECK(!store.reload());
+    CHECK(store.get() == second);
+    CHECK_EQ(store.version(), 2u);
+}
+
+TEST_CASE("config/recreated_store_does_not_return_cached_snapshot") {
+    TempDir dir;
+    std::string path = dir / "config.txt";
+    write_test_config(path, {{"CAMERA_FPS", "10"}});
+    auto store = std::make_unique<ConfigStore>(path);
+    REQUIRE(store->reload());
+    CHECK_EQ(store->get()->app.camera_fps, 10);
+    store.reset();
+
+    // 同じアドレス・同じバージョンで作り直されても、前のストアのキャッシュは返さない
+    write_test_config(path, {{"CAMERA_FPS", "12"}});
+    store = std::make_unique<ConfigStore>(path);
+    CHECK(!store->get());
+    REQUIRE(store->reload());
+    CHECK_EQ(store->get()->version, 1u);
+    CHECK_EQ(store->get()->app.camera_fps, 12);
+}
+
+TEST_CASE("config/live_viewers_leave_a_media_worker") {
+    // 既定（ワーカー8・Webhook予約2）では、配信と検索の枠6のうち5人まで
+    AppConfig config;
+    std::string error;
+    CHECK(parse_app_config({{"LIVE_MAX_VIEWERS", "5"}}, config, error, false));
+    AppConfig all_slots;
+    CHECK(!parse_app_config({{"LIVE_MAX_VIEWERS", "6"}}, all_slots, error, false));
+    CHECK(error.find("LIVE_MAX_VIEWERS") == 0);
+
+    // ワーカーを増やせば10人で視聴できる
+    AppConfig more_workers;
+    CHECK(parse_app_config({{"LIVE_MAX_VIEWERS", "10"}, {"HTTP_WORKERS", "13"}}, more_workers, error, false));
+}
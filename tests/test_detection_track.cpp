@@ -0,0 +1,56 @@
+// 検出結果のトラック（DetectionTrack）のテスト
+
+#include <string>
+#include <vector>
+
+#include "detection_track.h"
+#include "test_harness.h"
+#include "test_support.h"
+
+TEST_CASE("track/reopen_starts_without_previous_faces") {
+    TempDir dir;
+    const std::vector<cv::Rect> faces = {cv::Rect(10, 20, 30, 40)};
+    const std::vector<int> neighbors = {5};
+
+    DetectionTrack track;
+    REQUIRE(track.open(dir / "first.vtt"));
+    track.add(1.0, faces, neighbors);
+    track.close(2.0);
+
+    // 次の録画の最初の枠が前の録画の最後の枠と同じでも、新しいキューとして0秒から書く
+    REQUIRE(track.open(dir / "second.vtt"));
+    track.add(0.0, faces, neighbors);
+    track.close(0.5);
+
+    std::string second = read_text_file(dir / "second.vtt");
+    CHECK_EQ(count_occurrences(second, " --> "), 1u);
+    CHECK(second.find("00:00:00.000 --> 00:00:00.500") != std::string::npos);
+
+    std::vector<cv::Rect> read;
+    CHECK(DetectionTrack::read_at(dir / "second.vtt", 0.25, read));
+    REQUIRE_EQ(read.size(), 1u);
+    CHECK(read[0] == faces[0]);
+}
+
+TEST_CASE("track/reopen_does_not_carry_pending_cue_start") {
+    TempDir dir;
+    const std::vector<cv::Rect> faces = {cv::Rect(10, 20, 30, 40)};
+    const std::vector<int> neighbors = {5};
+
+    // 枠が映ったまま短い録画を閉じ、次の録画では別の枠から始める
+    DetectionTrack track;
+    REQUIRE(track.open(dir / "first.vtt"));
+    track.add(0.2, faces, neighbors);
+    track.close(0.4);
+
+    const std::vector<cv::Rect> other = {cv::Rect(50, 60, 30, 40)};
+    REQUIRE(track.open(dir / "second.vtt"));
+    track.add(1.0, other, neighbors);
+    track.close(2.0);
+
+    // 前の録画の枠（0.2秒から）は新しいファイルに書き直されない
+    std::string second = read_text_file(dir / "second.vtt");
+    CHECK_EQ(count_occurrences(second, " --> "), 1u);
+    CHECK(second.find("00:00:01.000 --> 00:00:02.000") != std::string::npos);
+    CHECK(second.find("\"x\":10") == std::string::npos);
+}
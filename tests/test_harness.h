@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// テストの登録と実行（外部のテストフレームワークに依存しない最小限のもの）
+//
+//   TEST_CASE("pipeline/replay_records_clip") {
+//       REQUIRE(rig.open());
+//       CHECK_EQ(count, 1);
+//   }
+//
+// - 名前は "<グループ>/<名前>"。./picam_tests --filter pipeline/ で先頭が一致するものだけ実行する
+//   （ctestはグループごとに1つのテストとして呼ぶ）
+// - CHECKは失敗しても続け、REQUIREは失敗したらそのテストを打ち切る
+// - SKIP("理由") でテストを飛ばす（実行したテストがすべて飛ばされたら終了コード77。ctestのSKIP_RETURN_CODE）
+namespace test {
+
+struct Abort {};
+struct Skipped {
+    std::string reason;
+};
+
+struct Case {
+    const char* name;
+    void (*body)();
+};
+
+inline std::vector<Case>& registry() {
+    static std::vector<Case> cases;
+    return cases;
+}
+
+inline int& current_failures() {
+    static int failures = 0;
+    return failures;
+}
+
+struct Registrar {
+    Registrar(const char* name, void (*body)()) { registry().push_back({name, body}); }
+};
+
+inline void report(const char* file, int line, const std::string& message) {
+    std::fprintf(stderr, "  %s:%d: %s\n", file, line, message.c_str());
+    current_failures()++;
+}
+
+template <typename A, typename B>
+bool check_eq(const A& a, const B& b, const char* expr_a, const char* expr_b, const char* file, int line) {
+    if (a == b) {
+        return true;
+    }
+    std::ostringstream oss;
+    oss << expr_a << " == " << expr_b << " が成り立ちません（" << a << " と " << b << "）";
+    report(file, line, oss.str());
+    return false;
+}
+
+// filterに先頭が一致するテストを実行し、終了コードを返す
+inline int run_all(const std::string& filter) {
+    int passed = 0;
+    int failed = 0;
+    int skipped = 0;
+    for (const Case& c : registry()) {
+        if (std::strncmp(c.name, filter.c_str(), filter.size()) != 0) {
+            continue;
+        }
+        std::fprintf(stderr, "[ RUN  ] %s\n", c.name);
+        current_failures() = 0;
+        try {
+            c.body();
+        } catch (const Abort&) {
+            // REQUIREの失敗（報告済み）
+        } catch (const Skipped& s) {
+            std::fprintf(stderr, "[ SKIP ] %s: %s\n", c.name, s.reason.c_str());
+            skipped++;
+            continue;
+        } catch (const std::exception& e) {
+            report(__FILE__, __LINE__, std::string("例外: ") + e.what());
+        }
+        if (current_failures() == 0) {
+            std::fprintf(stderr, "[  OK  ] %s\n", c.name);
+            passed++;
+        } else {
+            std::fprintf(stderr, "[ FAIL ] %s\n", c.name);
+            failed++;
+        }
+    }
+    std::fprintf(stderr, "%d passed, %d failed, %d skipped\n", passed, failed, skipped);
+    if (failed > 0) {
+        return 1;
+    }
+    if (passed == 0 && skipped > 0) {
+        return 77;
+    }
+    if (passed == 0) {
+        std::fprintf(stderr, "一致するテストがありません: %s\n", filter.c_str());
+        return 1;
+    }
+    return 0;
+}
+
+} // namespace test
+
+#define TEST_CONCAT_(a, b) a##b
+#define TEST_CONCAT(a, b) TEST_CONCAT_(a, b)
+#define TEST_CASE(name)                                                                                       \
+    static void TEST_CONCAT(test_body_, __LINE__)();                                                          \
+    static test::Registrar TEST_CONCAT(test_registrar_, __LINE__)(name, &TEST_CONCAT(test_body_, __LINE__)); \
+    static void TEST_CONCAT(test_body_, __LINE__)()
+
+#define CHECK(expr) \
+    ((expr) ? (void)0 : test::report(__FILE__, __LINE__, "CHECK(" #expr ") が成り立ちません"))
+#define REQUIRE(expr)                                                          \
+    do {                                                                       \
+        if (!(expr)) {                                                         \
+            test::report(__FILE__, __LINE__, "REQUIRE(" #expr ") が成り立ちません"); \
+            throw test::Abort{};                                               \
+        }                                                                      \
+    } while (0)
+#define CHECK_EQ(a, b) test::check_eq((a), (b), #a, #b, __FILE__, __LINE__)
+#define REQUIRE_EQ(a, b)                                              \
+    do {                                                              \
+        if (!test::check_eq((a), (b), #a, #b, __FILE__, __LINE__)) {  \
+            throw test::Abort{};                                      \
+        }                                                             \
+    } while (0)
+#define SKIP(reason) throw test::Skipped{reason}
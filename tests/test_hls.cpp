@@ -0,0 +1,35 @@
+// HLSのライブ配信（HlsStream）のテスト
+// 録画用のパイプラインをappsrcの代わりにvideotestsrcで動かし、mp4とHLSの両方が書き出されることを確かめる
+
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+
+#include "hls_stream.h"
+#include "test_harness.h"
+#include "test_support.h"
+
+TEST_CASE("hls/writer_pipeline_negotiates_with_videotestsrc") {
+    if (std::system("gst-inspect-1.0 x264enc > /dev/null 2>&1 && gst-inspect-1.0 hlssink2 > /dev/null 2>&1 && "
+                    "gst-inspect-1.0 mp4mux > /dev/null 2>&1") != 0) {
+        SKIP("GStreamer（x264enc・hlssink2・mp4mux）がありません");
+    }
+    TempDir dir;
+    // 空白を含むパスでも1つの値として渡せること
+    HlsStream::Params params;
+    params.dir = dir / "hls out";
+    params.encoder = "x264enc";
+    HlsStream hls(params);
+    REQUIRE(hls.prepare());
+    const std::string mp4_path = dir / "clip 1.mp4";
+
+    // 15fpsで3秒（セグメント3本分）。パイプラインの記述はシェルに解釈させず1つの引数で渡す
+    std::string pipeline = "videotestsrc num-buffers=45 ! video/x-raw,width=320,height=240,framerate=15/1 ! " +
+                           hls.encode_pipeline(mp4_path, 15.0);
+    REQUIRE(std::system(("gst-launch-1.0 -q '" + pipeline + "' > /dev/null 2>&1").c_str()) == 0);
+
+    CHECK(std::filesystem::file_size(mp4_path) > 0);
+    std::string playlist = read_text_file(params.dir + "/" + HlsStream::PLAYLIST_NAME);
+    CHECK(playlist.find("seg00000.ts") != std::string::npos);
+    CHECK(std::filesystem::exists(params.dir + "/seg00000.ts"));
+}
@@ -0,0 +1,101 @@
+// インシデント単位の録画と通知のテスト（リプレイの仮想時刻とラベルで動かす）
+
+#include <chrono>
+#include <string>
+
+#include "incident_policy.h"
+#include "test_harness.h"
+#include "test_support.h"
+
+namespace {
+
+using std::chrono::milliseconds;
+using std::chrono::seconds;
+
+// 15fpsで、[first_sec, last_sec) に顔が映っているラベルの行
+std::string presence(double first_sec, double last_sec) {
+    return std::to_string(static_cast<int>(first_sec * 15)) + "-" + std::to_string(static_cast<int>(last_sec * 15) - 1) +
+           " 100 80 60 60\n";
+}
+
+} // namespace
+
+// 60秒間居座り、15秒ごとに6秒だけ映らなくなる（RECORD_HOLDの5秒より長い）人
+// 以前は顔が戻るたびに録画を止めて開き直していた（動画が2本に分かれ、2本目の動画の通知は上限で抑制されていた）
+// 今は同じ動画に続けて録画し、写真と動画の通知が1回ずつ届く
+TEST_CASE("incident/returning_face_keeps_one_clip") {
+    TempDir dir;
+    StubLineServer line_server;
+    PicamRig::Options options;
+    options.replay.source = write_frames(dir / "frames", 100 * 15, cv::Size(160, 120));
+    options.replay.detections_path = dir / "loiter.labels";
+    write_text_file(options.replay.detections_path,
+                    presence(0, 9) + presence(15, 24) + presence(30, 39) + presence(45, 60));
+    options.replay.fps = 15.0;
+    options.replay.fast = true;
+    options.config = {{"RECORD_HOLD", "5s"}, {"RECORD_MAX_HOLD", "30s"}, {"INCIDENT_GAP", "60s"}};
+    PicamRig rig(dir, line_server, options);
+    REQUIRE(rig.open());
+    rig.run();
+    rig.shutdown();
+
+    std::string events = rig.events_log();
+    CHECK_EQ(count_occurrences(events, " incident_open"), 1u);
+    CHECK_EQ(count_occurrences(events, " clip_start"), 1u);
+    CHECK_EQ(count_occurrences(events, " clip_pause"), 4u);
+    CHECK_EQ(count_occurrences(events, " clip_resume"), 3u);
+    CHECK_EQ(count_occurrences(events, " clip_stop"), 1u);
+    CHECK_EQ(count_occurrences(events, " notify_image"), 1u);
+    CHECK_EQ(count_occurrences(events, " notify_text text=動画を撮影しました。 video=true"), 1u);
+
+    // 録画イベント（動画）は1つだけ
+    CHECK_EQ(rig.context.event_index->size(), 1u);
+
+    // スタブに届いたpushにも写真と動画が1回ずつ含まれる
+    std::string pushed;
+    for (const auto& r : line_server.received()) {
+        pushed += r.body;
+    }
+    CHECK_EQ(count_occurrences(pushed, "\"type\":\"image\""), 1u);
+    CHECK_EQ(count_occurrences(pushed, "/video?file="), 1u);
+}
+
+TEST_CASE("incident/policy_pauses_then_closes_after_max_hold") {
+    IncidentPolicy::Params params;
+    params.hold = milliseconds(2000);
+    params.max_hold = milliseconds(5000);
+    params.incident_gap = milliseconds(10000);
+    IncidentPolicy policy(params);
+    IncidentPolicy::Clock::time_point t0;
+
+    IncidentActions a = policy.update(t0, true, true);
+    CHECK(a.incident_opened && a.start_clip && a.notify_image);
+
+    // hold を過ぎたら一時停止（動画は閉じない）
+    a = policy.update(t0 + milliseconds(2000), false, true);
+    CHECK(a.pause_clip && !a.stop_clip);
+
+    // max_hold より前に戻れば同じ動画を再開する
+    a = policy.update(t0 + milliseconds(4000), true, true);
+    CHECK(a.resume_clip && !a.start_clip && !a.notify_image);
+
+    // 最後の検出から max_hold で動画を閉じて通知する
+    a = policy.update(t0 + milliseconds(6000), false, true);
+    CHECK(a.pause_clip);
+    a = policy.update(t0 + milliseconds(9000), false, true);
+    CHECK(a.stop_clip && a.notify_video && !a.incident_closed);
+
+    // incident_gap 以内の検出は同じインシデントの新しい動画（写真は送らない）
+    a = policy.update(t0 + milliseconds(12000), true, true);
+    CHECK(a.start_clip && !a.incident_opened && !a.notify_image);
+    a = policy.update(t0 + milliseconds(14000), false, true);
+    CHECK(a.pause_clip);
+    a = policy.update(t0 + milliseconds(17000), false, true);
+    CHECK(a.stop_clip);
+
+    // incident_gap を過ぎたらインシデントを閉じる
+    a = policy.update(t0 + milliseconds(27000), false, true);
+    CHECK(a.incident_closed);
+    CHECK_EQ(policy.stats().incidents, 1u);
+    CHECK_EQ(policy.stats().clips, 2u);
+}
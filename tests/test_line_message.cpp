@@ -0,0 +1,123 @@
+// LINEのメッセージのボディ（LineMessageBuilder）のテスト
+// 組み立てたボディをJSONとして読み直し、Messaging APIのスキーマと上限を確かめる
+
+#include <string>
+
+#include "line_message.h"
+#include "nlohmann/json.hpp"
+#include "test_harness.h"
+
+namespace {
+
+using nlohmann::json;
+
+const std::string IMAGE_URL = "https://picam.example/image?file=2026_01_01--12_00_00.jpg";
+
+// 文字をcount個並べた文字列
+std::string repeat(const std::string& unit, size_t count) {
+    std::string out;
+    for (size_t i = 0; i < count; i++) {
+        out += unit;
+    }
+    return out;
+}
+
+} // namespace
+
+TEST_CASE("message/push_and_reply_follow_schema") {
+    LineMessageBuilder builder;
+    builder.begin_push("Utest");
+    REQUIRE(builder.add_text("動画を撮影しました。"));
+    REQUIRE(builder.add_image(IMAGE_URL, IMAGE_URL));
+    REQUIRE(builder.add_video("https://picam.example/video?file=a.mp4", IMAGE_URL));
+    REQUIRE(builder.add_flex("お知らせ", R"({"type":"bubble","body":{"type":"box","layout":"vertical","contents":[]}})"));
+
+    json push = json::parse(builder.finish());
+    CHECK_EQ(push["to"], "Utest");
+    REQUIRE(push["messages"].is_array());
+    REQUIRE_EQ(push["messages"].size(), 4u);
+    CHECK_EQ(push["messages"][0], json({{"type", "text"}, {"text", "動画を撮影しました。"}}));
+    CHECK_EQ(push["messages"][1], json({{"type", "image"}, {"originalContentUrl", IMAGE_URL}, {"previewImageUrl", IMAGE_URL}}));
+    CHECK_EQ(push["messages"][2]["type"], "video");
+    CHECK_EQ(push["messages"][2]["originalContentUrl"], "https://picam.example/video?file=a.mp4");
+    CHECK_EQ(push["messages"][3]["type"], "flex");
+    CHECK_EQ(push["messages"][3]["altText"], "お知らせ");
+    CHECK_EQ(push["messages"][3]["contents"]["type"], "bubble");
+
+    // 同じバッファで次のボディを組み立てる（前の内容は残らない）
+    builder.begin_reply("reply-token");
+    REQUIRE(builder.add_text("現在、監視中です。"));
+    json reply = json::parse(builder.finish());
+    CHECK_EQ(reply["replyToken"], "reply-token");
+    CHECK(!reply.contains("to"));
+    CHECK_EQ(reply["messages"].size(), 1u);
+    // finish()は何度呼んでも同じボディ
+    CHECK_EQ(json::parse(builder.finish()), reply);
+}
+
+TEST_CASE("message/escapes_text_and_ids") {
+    LineMessageBuilder builder;
+    const std::string to = "U\"quoted\\id";
+    const std::string text = std::string("改行\nタブ\t引用\"バックスラッシュ\\制御") + '\x01' + "\r\b\f終わり";
+    builder.begin_push(to);
+    REQUIRE(builder.add_text(text));
+
+    std::string body = builder.finish();
+    CHECK(body.find('\n') == std::string::npos);
+    CHECK(body.find("\\u0001") != std::string::npos);
+    json push = json::parse(body, nullptr, false);
+    REQUIRE(!push.is_discarded());
+    CHECK_EQ(push["to"], to);
+    CHECK_EQ(push["messages"][0]["text"], text);
+}
+
+TEST_CASE("message/rejects_values_over_limits") {
+    LineMessageBuilder builder;
+    builder.begin_push("Utest");
+
+    // テキストは1〜5000文字（バイト数ではなく文字数で数える）
+    CHECK(!builder.add_text(""));
+    CHECK(builder.add_text(repeat("あ", LineMessageBuilder::MAX_TEXT_LENGTH)));
+    CHECK(!builder.add_text(repeat("あ", LineMessageBuilder::MAX_TEXT_LENGTH + 1)));
+
+    // URLはHTTPSで2000文字まで
+    const std::string prefix = "https://picam.example/";
+    CHECK(!builder.add_image("http://picam.example/a.jpg", IMAGE_URL));
+    CHECK(!builder.add_video(IMAGE_URL, "ftp://picam.example/a.jpg"));
+    CHECK(!builder.add_image(prefix + std::string(LineMessageBuilder::MAX_URL_LENGTH - prefix.size() + 1, 'a'), IMAGE_URL));
+    CHECK(builder.add_image(prefix + std::string(LineMessageBuilder::MAX_URL_LENGTH - prefix.size(), 'a'), IMAGE_URL));
+
+    // Flexの代替テキストは1〜400文字、contentsはJSONオブジェクト
+    CHECK(!builder.add_flex("", "{}"));
+    CHECK(!builder.add_flex(repeat("あ", 401), "{}"));
+    CHECK(!builder.add_flex("お知らせ", "[]"));
+    CHECK(!builder.add_flex("お知らせ", ""));
+
+    // 断ったメッセージはボディに入らない
+    CHECK_EQ(builder.message_count(), 2u);
+    json push = json::parse(builder.finish());
+    CHECK_EQ(push["messages"].size(), 2u);
+}
+
+TEST_CASE("message/caps_push_at_five_messages") {
+    LineMessageBuilder builder;
+    builder.begin_push("Utest");
+    for (size_t i = 0; i < LineMessageBuilder::MAX_MESSAGES; i++) {
+        CHECK(!builder.full());
+        CHECK(builder.add_text("通知" + std::to_string(i)));
+    }
+    CHECK(builder.full());
+    CHECK(!builder.add_text("6件目"));
+    CHECK(!builder.add_image(IMAGE_URL, IMAGE_URL));
+
+    json push = json::parse(builder.finish());
+    REQUIRE_EQ(push["messages"].size(), LineMessageBuilder::MAX_MESSAGES);
+    CHECK_EQ(push["messages"][4]["text"], "通知4");
+
+    // 閉じた後は追加できず、begin_*で数え直す
+    CHECK(!builder.add_text("閉じた後"));
+    builder.begin_push("Utest");
+    CHECK(!builder.full());
+    CHECK(builder.add_text("次のpush"));
+    CHECK_EQ(builder.message_count(), 1u);
+}
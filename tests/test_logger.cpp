@@ -0,0 +1,194 @@
+// 非同期のロガー（Logger）のテスト
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "logger.h"
+#include "test_harness.h"
+#include "test_support.h"
+
+namespace {
+
+// テストで動かす時計
+std::atomic<int64_t> fake_wall_s{0};
+
+std::chrono::system_clock::time_point fake_wall_clock() {
+    return std::chrono::system_clock::time_point(std::chrono::seconds(fake_wall_s.load()));
+}
+
+// ログの行の先頭に付く時刻（ローカル時刻、ミリ秒まで）
+std::string wall_prefix(int64_t unix_s) {
+    std::time_t t = static_cast<std::time_t>(unix_s);
+    std::tm tm{};
+    localtime_r(&t, &tm);
+    char text[32];
+    std::strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", &tm);
+    return std::string(text) + ".000 ";
+}
+
+// 文字列がUTF-8として正しいか（文字の途中で切れていないか）
+bool valid_utf8(const std::string& text) {
+    size_t i = 0;
+    while (i < text.size()) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        size_t n = c < 0x80 ? 1 : (c & 0xE0) == 0xC0 ? 2 : (c & 0xF0) == 0xE0 ? 3 : (c & 0xF8) == 0xF0 ? 4 : 0;
+        if (n == 0 || i + n > text.size()) {
+            return false;
+        }
+        for (size_t k = 1; k < n; k++) {
+            if ((static_cast<unsigned char>(text[i + k]) & 0xC0) != 0x80) {
+                return false;
+            }
+        }
+        i += n;
+    }
+    return true;
+}
+
+// ログの行から本文（"[スレッド番号] " の後ろ）を取り出す
+std::string line_text(const std::string& text, const std::string& marker) {
+    size_t pos = text.find(marker);
+    if (pos == std::string::npos) {
+        return "";
+    }
+    size_t begin = text.rfind("] ", pos);
+    size_t end = text.find('\n', pos);
+    begin = begin == std::string::npos ? pos : begin + 2;
+    return text.substr(begin, end == std::string::npos ? std::string::npos : end - begin);
+}
+
+// 標準エラー出力を一時的にファイルへ向ける（stop()と同時に書かれて同期的に書き出された行を数える）
+class StderrCapture {
+public:
+    explicit StderrCapture(const std::string& path) : path_(path) {
+        std::fflush(stderr);
+        saved_ = dup(STDERR_FILENO);
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        dup2(fd, STDERR_FILENO);
+        close(fd);
+    }
+    ~StderrCapture() { restore(); }
+
+    std::string restore() {
+        if (saved_ >= 0) {
+            std::fflush(stderr);
+            dup2(saved_, STDERR_FILENO);
+            close(saved_);
+            saved_ = -1;
+        }
+        return read_text_file(path_);
+    }
+
+private:
+    std::string path_;
+    int saved_ = -1;
+};
+
+} // namespace
+
+TEST_CASE("log/timestamp_follows_wall_clock_step") {
+    TempDir dir;
+    Logger log;
+    Logger::Params params;
+    params.path = dir / "picam.log";
+    params.console_level = LogLevel::Error;
+    params.wall_clock = fake_wall_clock;
+
+    // 起動時は時計が合っていない（RTCのないRaspberry PiはNTPで合わせるまで古い時刻のまま）
+    fake_wall_s.store(1000000000);
+    log.start(params);
+    log.log(LogLevel::Info, "同期前");
+    // NTPで時計が進んだ後の行は、進んだ時刻で書く
+    fake_wall_s.store(1767268800);
+    log.log(LogLevel::Info, "同期後");
+    // 戻った場合も同じ
+    fake_wall_s.store(1767265200);
+    log.log(LogLevel::Info, "巻き戻し後");
+    log.stop();
+
+    std::string text = read_text_file(params.path);
+    CHECK(text.find(wall_prefix(1000000000)) != std::string::npos);
+    size_t synced = text.find(wall_prefix(1767268800));
+    REQUIRE(synced != std::string::npos);
+    CHECK(text.find("同期後", synced) != std::string::npos);
+    size_t stepped_back = text.find(wall_prefix(1767265200));
+    REQUIRE(stepped_back != std::string::npos);
+    CHECK(text.find("巻き戻し後", stepped_back) != std::string::npos);
+}
+
+TEST_CASE("log/truncation_keeps_utf8_boundary") {
+    TempDir dir;
+    Logger log;
+    Logger::Params params;
+    params.path = dir / "picam.log";
+    params.console_level = LogLevel::Error;
+    log.start(params);
+
+    // 3バイトの文字が上限（TEXT_SIZE）をまたぐ場合は、その文字の手前で切る
+    std::string message = "ab";
+    for (int i = 0; i < 100; i++) {
+        message += "あ";
+    }
+    log.log(LogLevel::Info, message);
+    // フィールドの値の途中で上限に達した場合も同じで、続くフィールドは書かない
+    log.log(LogLevel::Info, std::string(220, 'x'), {{"name", "監視カメラ"}, {"next", 1}});
+    log.stop();
+
+    std::string text = read_text_file(params.path);
+    std::string first = line_text(text, "abあ");
+    CHECK_EQ(first.size(), 2u + 3 * 76);
+    CHECK(valid_utf8(first));
+    std::string second = line_text(text, std::string(220, 'x'));
+    CHECK(valid_utf8(second));
+    CHECK(second.size() <= Logger::TEXT_SIZE);
+    CHECK_EQ(second, std::string(220, 'x') + " name=監視");
+}
+
+TEST_CASE("log/stop_keeps_entries_logged_while_stopping") {
+    TempDir dir;
+    // 書き出しスレッドが最後に確かめた後に積まれたログも失われないこと
+    // （ファイルに書かれた行・停止後に標準エラー出力へ書かれた行・バッファが一杯で捨てた件数の合計が呼び出し回数に一致する）
+    for (int round = 0; round < 20; round++) {
+        Logger log;
+        Logger::Params params;
+        params.path = dir / ("race" + std::to_string(round) + ".log");
+        params.console_level = LogLevel::Error;
+        log.start(params);
+
+        StderrCapture capture(dir / ("stderr" + std::to_string(round) + ".txt"));
+        std::atomic<bool> stopped{false};
+        std::atomic<uint64_t> calls{0};
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; t++) {
+            threads.emplace_back([&] {
+                int after_stop = 0;
+                while (after_stop < 50) {
+                    log.log(LogLevel::Info, "race-entry");
+                    calls.fetch_add(1);
+                    if (stopped.load()) {
+                        after_stop++;
+                    }
+                }
+            });
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        log.stop();
+        stopped.store(true);
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        std::string console = capture.restore();
+
+        uint64_t written = count_occurrences(read_text_file(params.path), "race-entry");
+        uint64_t synchronous = count_occurrences(console, "race-entry");
+        CHECK_EQ(written + synchronous + log.dropped(), calls.load());
+    }
+}
@@ -0,0 +1,54 @@
+// テストの実行ファイル
+//
+//   ./picam_tests [--filter <グループ/名前の先頭>]
+//   ./picam_tests --write-frames <ディレクトリ> <枚数>   リプレイの正解比較に使う連番画像を書く
+//
+// ctestからはグループごとに --filter を付けて呼ばれる（CMakeLists.txtのadd_test）
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+#include "test_harness.h"
+#include "test_support.h"
+
+namespace {
+
+// このスレッドでoperator newを呼んだ回数（カメラスレッドの定常状態のメモリ確保を数える）
+thread_local uint64_t thread_allocations = 0;
+
+} // namespace
+
+uint64_t thread_allocation_count() { return thread_allocations; }
+
+void* operator new(std::size_t size) {
+    thread_allocations++;
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+int main(int argc, char* argv[]) {
+    std::string filter;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--filter" && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (arg == "--write-frames" && i + 2 < argc) {
+            std::string dir = argv[++i];
+            int count = std::atoi(argv[++i]);
+            write_frames(dir, count, cv::Size(160, 120));
+            return 0;
+        } else {
+            std::fprintf(stderr, "不明な引数です: %s\n", arg.c_str());
+            return 2;
+        }
+    }
+    return test::run_all(filter);
+}
@@ -0,0 +1,170 @@
+// 送信箱（LineOutbox）の障害注入テスト
+// LINE APIのスタブで接続断・遅延・5xx・429を返し、実際のLineClient::postで再送させる
+
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+
+#include "test_harness.h"
+#include "test_support.h"
+
+namespace {
+
+using std::chrono::milliseconds;
+
+// スタブにつないだLineClientで送る送信箱
+struct OutboxRig {
+    OutboxRig(const TempDir& dir, StubLineServer& line_server)
+        : path(dir / "outbox.log"), line(context, line_server.base()) {
+        config.channel_access_token = "test-token";
+    }
+
+    std::unique_ptr<LineOutbox> make_outbox() {
+        auto outbox = std::make_unique<LineOutbox>(path,
+            [this](const std::string& endpoint, const std::string& body, const std::string& retry_key) {
+                return line.post(endpoint, body, config, retry_key);
+            });
+        outbox->base_delay = milliseconds(50);
+        outbox->max_delay = milliseconds(200);
+        return outbox;
+    }
+
+    std::string path;
+    PicamContext context;
+    AppConfig config;
+    LineClient line;
+};
+
+StubLineServer::Response respond(int status) {
+    StubLineServer::Response response;
+    response.status = status;
+    return response;
+}
+
+// on_doneの結果を受け取るfuture
+struct DoneResult {
+    std::shared_ptr<std::promise<bool>> promise = std::make_shared<std::promise<bool>>();
+    std::future<bool> future = promise->get_future();
+
+    LineOutbox::DoneCallback callback() {
+        auto p = promise;
+        return [p](bool ok) { p->set_value(ok); };
+    }
+};
+
+const std::string BODY = "{\"to\":\"Utest\",\"messages\":[{\"type\":\"text\",\"text\":\"テスト\"}]}";
+
+} // namespace
+
+TEST_CASE("outbox/retries_drop_5xx_429_and_delay_with_one_retry_key") {
+    TempDir dir;
+    StubLineServer line_server;
+    OutboxRig rig(dir, line_server);
+
+    StubLineServer::Response dropped;
+    dropped.drop = true;
+    StubLineServer::Response rate_limited = respond(429);
+    rate_limited.retry_after = "0";
+    StubLineServer::Response delayed = respond(200);
+    delayed.delay = milliseconds(300);
+    line_server.push_response(dropped);
+    line_server.push_response(respond(500));
+    line_server.push_response(rate_limited);
+    line_server.push_response(delayed);
+
+    auto outbox = rig.make_outbox();
+    outbox->start();
+    DoneResult done;
+    outbox->submit(LINE_PUSH_MESSAGE_ENDPOINT, BODY, done.callback());
+    REQUIRE(done.future.wait_for(std::chrono::seconds(10)) == std::future_status::ready);
+    CHECK(done.future.get());
+    CHECK(outbox->wait_idle(milliseconds(1000)));
+    outbox->stop();
+
+    // 4回とも同じリトライキー（LINE側で二重に配信されない）
+    auto received = line_server.received();
+    REQUIRE_EQ(received.size(), 4u);
+    for (const auto& r : received) {
+        CHECK_EQ(r.body, BODY);
+        CHECK_EQ(r.retry_key, received.front().retry_key);
+    }
+    CHECK_EQ(rig.context.metrics.line_api_retry_total.value(), 3u);
+    CHECK_EQ(rig.context.metrics.line_api_ok_total.value(), 1u);
+
+    // 配信済みなので、開き直しても再送しない
+    auto reopened = rig.make_outbox();
+    reopened->start();
+    CHECK_EQ(reopened->pending_count(), 0u);
+    reopened->stop();
+    CHECK_EQ(line_server.received().size(), 4u);
+}
+
+TEST_CASE("outbox/gives_up_on_4xx") {
+    TempDir dir;
+    StubLineServer line_server;
+    OutboxRig rig(dir, line_server);
+    line_server.push_response(respond(400));
+
+    auto outbox = rig.make_outbox();
+    outbox->start();
+    DoneResult done;
+    outbox->submit(LINE_PUSH_MESSAGE_ENDPOINT, BODY, done.callback());
+    REQUIRE(done.future.wait_for(std::chrono::seconds(10)) == std::future_status::ready);
+    CHECK(!done.future.get());
+    outbox->stop();
+    CHECK_EQ(line_server.received().size(), 1u);
+    CHECK_EQ(rig.context.metrics.line_api_error_total.value(), 1u);
+}
+
+TEST_CASE("outbox/follows_retry_after") {
+    TempDir dir;
+    StubLineServer line_server;
+    OutboxRig rig(dir, line_server);
+    StubLineServer::Response rate_limited = respond(429);
+    rate_limited.retry_after = "1";
+    line_server.push_response(rate_limited);
+
+    auto outbox = rig.make_outbox();
+    outbox->start();
+    auto begin = std::chrono::steady_clock::now();
+    DoneResult done;
+    outbox->submit(LINE_PUSH_MESSAGE_ENDPOINT, BODY, done.callback());
+    REQUIRE(done.future.wait_for(std::chrono::seconds(10)) == std::future_status::ready);
+    CHECK(done.future.get());
+    // バックオフ（最大200ms）ではなくRetry-Afterの1秒を待ってから再送する
+    CHECK(std::chrono::steady_clock::now() - begin >= milliseconds(1000));
+    outbox->stop();
+    CHECK_EQ(line_server.received().size(), 2u);
+}
+
+TEST_CASE("outbox/stop_fails_pending_and_resends_after_restart") {
+    TempDir dir;
+    StubLineServer line_server;
+    OutboxRig rig(dir, line_server);
+    line_server.push_response(respond(503));
+
+    auto outbox = rig.make_outbox();
+    outbox->base_delay = milliseconds(60000); // 次の再送より先に止める
+    outbox->max_delay = milliseconds(60000);
+    outbox->start();
+    DoneResult done;
+    outbox->submit(LINE_PUSH_MESSAGE_ENDPOINT, BODY, done.callback());
+    REQUIRE(line_server.wait_for(LINE_PUSH_MESSAGE_ENDPOINT, 1, std::chrono::seconds(10)));
+
+    // 止めると、待っている呼び出し元にはfalseが返る（futureが壊れたままにならない）
+    outbox->stop();
+    REQUIRE(done.future.wait_for(milliseconds(0)) == std::future_status::ready);
+    CHECK(!done.future.get());
+
+    // リクエストはファイルに残り、次の起動で同じリトライキーのまま再送される
+    auto reopened = rig.make_outbox();
+    reopened->start();
+    CHECK(line_server.wait_for(LINE_PUSH_MESSAGE_ENDPOINT, 2, std::chrono::seconds(10)));
+    CHECK(reopened->wait_idle(milliseconds(5000)));
+    reopened->stop();
+
+    auto received = line_server.received();
+    REQUIRE_EQ(received.size(), 2u);
+    CHECK_EQ(received[1].retry_key, received[0].retry_key);
+}
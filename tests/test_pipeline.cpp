@@ -0,0 +1,169 @@
+// CameraPipelineとWebServerを、MockGpio・連番画像のファイル・LINE APIのスタブでつないで動かすテスト
+
+#include <chrono>
+#include <filesystem>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "test_harness.h"
+#include "test_support.h"
+
+namespace {
+
+// 15fpsで10秒（150フレーム）。1〜3秒目に顔が映る
+PicamRig::Options short_clip_options(const TempDir& dir) {
+    PicamRig::Options options;
+    options.replay.source = write_frames(dir / "frames", 150);
+    options.replay.detections_path = dir / "clip.labels";
+    write_text_file(options.replay.detections_path, "15-45 100 80 60 60\n");
+    options.replay.fps = 15.0;
+    options.replay.fast = true;
+    return options;
+}
+
+} // namespace
+
+TEST_CASE("pipeline/replay_records_clip_and_notifies_line") {
+    TempDir dir;
+    StubLineServer line_server;
+    PicamRig rig(dir, line_server, short_clip_options(dir));
+    REQUIRE(rig.open());
+    rig.run();
+    rig.shutdown();
+
+    std::string events = rig.events_log();
+    CHECK_EQ(count_occurrences(events, " incident_open"), 1u);
+    CHECK_EQ(count_occurrences(events, " clip_start"), 1u);
+    CHECK_EQ(count_occurrences(events, " clip_stop"), 1u);
+    CHECK_EQ(count_occurrences(events, " notify_image"), 1u);
+    CHECK_EQ(count_occurrences(events, " notify_text text=動画を撮影しました。 video=true"), 1u);
+    CHECK_EQ(count_occurrences(events, " led pin=blue on=true"), 1u);
+
+    // 写真と動画の通知は送信箱からLineClient::postでスタブに届く
+    auto received = line_server.received();
+    REQUIRE(!received.empty());
+    std::string pushed;
+    for (const auto& r : received) {
+        CHECK_EQ(r.path, LINE_PUSH_MESSAGE_ENDPOINT);
+        CHECK_EQ(r.authorization, std::string("Bearer test-token"));
+        CHECK(!r.retry_key.empty());
+        pushed += r.body;
+    }
+    CHECK(pushed.find("\"type\":\"image\"") != std::string::npos);
+    CHECK(pushed.find("https://picam.example/video?file=") != std::string::npos);
+
+    // 録画イベントが索引に残る
+    CHECK_EQ(rig.context.event_index->size(), 1u);
+}
+
+TEST_CASE("pipeline/webhook_photo_command_and_shutdown") {
+    TempDir dir;
+    StubLineServer line_server;
+    PicamRig::Options options;
+    // 実時間で50fps・最大30秒。終了コマンドで止める
+    options.replay.source = write_frames(dir / "frames", 1500, cv::Size(160, 120));
+    options.replay.detections_path = dir / "none.labels";
+    write_text_file(options.replay.detections_path, "# 顔なし\n");
+    options.replay.fps = 50.0;
+    options.replay.fast = false;
+    options.web_server = true;
+    PicamRig rig(dir, line_server, options);
+    REQUIRE(rig.open());
+    PipelineThread camera(rig);
+
+    httplib::Client client("127.0.0.1", rig.web_port);
+
+    // 署名のないリクエストは401
+    std::string photo_body = webhook_text_body("！");
+    auto unsigned_res = client.Post("/webhook", photo_body, "application/json");
+    REQUIRE(unsigned_res);
+    CHECK_EQ(unsigned_res->status, 401);
+
+    // 「！」で撮影した写真がpushされる
+    httplib::Headers headers = {{"X-Line-Signature", sign_webhook("test-secret", photo_body)}};
+    auto photo_res = client.Post("/webhook", headers, photo_body, "application/json");
+    REQUIRE(photo_res);
+    CHECK_EQ(photo_res->status, 200);
+    CHECK(line_server.wait_for(LINE_PUSH_MESSAGE_ENDPOINT, 1, std::chrono::seconds(10)));
+
+    // 録画イベントの一覧が返る
+    auto events_res = client.Get("/events");
+    REQUIRE(events_res);
+    CHECK_EQ(events_res->status, 200);
+
+    // 「プログラム終了」でカメラスレッドのループが終わる
+    std::string shutdown_body = webhook_text_body("プログラム終了");
+    headers = {{"X-Line-Signature", sign_webhook("test-secret", shutdown_body)}};
+    auto shutdown_res = client.Post("/webhook", headers, shutdown_body, "application/json");
+    REQUIRE(shutdown_res);
+    CHECK_EQ(shutdown_res->status, 200);
+    camera.join();
+    CHECK(rig.context.replay->frame() < 1500u);
+    rig.shutdown();
+
+    auto received = line_server.received();
+    REQUIRE(!received.empty());
+    CHECK(received.front().body.find("https://picam.example/image?file=") != std::string::npos);
+}
+
+TEST_CASE("pipeline/steady_state_frame_loop_does_not_allocate") {
+    TempDir dir;
+    StubLineServer line_server;
+    write_frames(dir / "frames", 1);
+    // 20秒間ずっと顔が映っている（録画中・ライブ映像の視聴者ありの定常状態）
+    PreloadedSource source(dir / "frames/0000.png", 300, 15.0);
+    PicamRig::Options options;
+    options.replay.source = dir / "frames/0000.png";
+    options.replay.detections_path = dir / "steady.labels";
+    write_text_file(options.replay.detections_path, "0-299 100 80 60 60\n");
+    options.replay.fps = 15.0;
+    options.replay.fast = true;
+    options.source = &source;
+    PicamRig rig(dir, line_server, options);
+    REQUIRE(rig.open());
+    auto viewer = rig.context.frame_hub->add_viewer();
+
+    // 録画の開始と通知が済んだ後のフレームを数える
+    source.measure(100, 250, rig.context.frame_pool.get());
+    rig.run();
+    viewer.reset();
+    rig.shutdown();
+
+    REQUIRE(source.measured);
+    CHECK_EQ(source.allocations, 0u);
+    CHECK_EQ(source.pool_grown, 0u);
+    CHECK_EQ(source.pool_reallocated, 0u);
+    CHECK_EQ(count_occurrences(rig.events_log(), " clip_start"), 1u);
+}
+
+TEST_CASE("pipeline/unopened_video_records_photo_only_event") {
+    TempDir dir;
+    StubLineServer line_server;
+    PicamRig rig(dir, line_server, short_clip_options(dir));
+    REQUIRE(rig.open());
+    // 保存先がなくなると動画を開けない（SDカードの取り外しなど）
+    std::filesystem::remove_all(dir / "out/video");
+    rig.run();
+    rig.shutdown();
+
+    // 写真は通知し、存在しない動画のURLは送らない
+    std::string events = rig.events_log();
+    CHECK_EQ(count_occurrences(events, " clip_start"), 1u);
+    CHECK_EQ(count_occurrences(events, " notify_image"), 1u);
+    CHECK_EQ(count_occurrences(events, "動画を撮影しました。"), 0u);
+    std::string pushed;
+    for (const auto& r : line_server.received()) {
+        pushed += r.body;
+    }
+    CHECK(pushed.find("/video?file=") == std::string::npos);
+
+    // 索引には写真だけの閉じたイベントが残る
+    REQUIRE_EQ(rig.context.event_index->size(), 1u);
+    std::vector<EventRecord> recorded = rig.context.event_index->query(0, std::numeric_limits<int64_t>::max(), 10);
+    REQUIRE_EQ(recorded.size(), 1u);
+    CHECK(recorded[0].video_file.empty());
+    CHECK_EQ(recorded[0].video_bytes, 0u);
+    CHECK(!recorded[0].photo_file.empty());
+    CHECK(!recorded[0].open());
+}
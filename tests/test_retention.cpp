@@ -0,0 +1,211 @@
+// 保存ファイルの整理（RetentionManager）のテスト
+// 一時ディレクトリに更新時刻をずらしたファイルを置き、容量・経過時間・空き容量・読み手の登録と、削除したファイルを録画イベントの索引から外すことを確かめる
+
+#include <sys/statvfs.h>
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "event_index.h"
+#include "retention_manager.h"
+#include "test_harness.h"
+#include "test_support.h"
+
+namespace {
+
+using std::chrono::hours;
+using std::chrono::minutes;
+
+// sizeバイトのファイルを置き、更新時刻をageだけ過去にする
+void write_aged_file(const std::string& path, size_t size, std::chrono::seconds age) {
+    write_text_file(path, std::string(size, 'x'));
+    std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now() - age);
+}
+
+// 起動時の1回だけ整理する（次の整理はテストの間に来ない）
+RetentionManager::Params single_pass(RetentionManager::Params params) {
+    params.interval = hours(1);
+    params.rescan_interval = hours(1);
+    return params;
+}
+
+// 削除数がcountになるまで待つ
+bool wait_deleted(const RetentionManager& retention, uint64_t count) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (retention.stats().deleted_files < count) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return true;
+}
+
+bool exists(const std::string& path) { return std::filesystem::exists(path); }
+
+} // namespace
+
+TEST_CASE("retention/quota_deletes_oldest_and_skips_leased") {
+    TempDir dir;
+    // a（最も古い）〜e に1000バイトずつ
+    const std::vector<std::string> names = {"a.mp4", "b.jpg", "c.mp4", "d.jpg", "e.mp4"};
+    for (size_t i = 0; i < names.size(); i++) {
+        write_aged_file(dir / names[i], 1000, minutes(static_cast<int>(50 - i * 10)));
+    }
+
+    RetentionManager::Params params;
+    params.max_age = std::chrono::seconds(0);
+    params.quota_bytes = 3000;
+    RetentionManager retention({dir.path()}, single_pass(params));
+    auto lease = retention.acquire(dir / "a.mp4"); // 配信中
+    retention.start();
+    REQUIRE(wait_deleted(retention, 2));
+    retention.stop();
+
+    // 配信中のaを残し、その次に古いb・cを消して上限に収める
+    CHECK(exists(dir / "a.mp4"));
+    CHECK(!exists(dir / "b.jpg"));
+    CHECK(!exists(dir / "c.mp4"));
+    CHECK(exists(dir / "d.jpg"));
+    CHECK(exists(dir / "e.mp4"));
+    RetentionStats stats = retention.stats();
+    CHECK_EQ(stats.deleted_files, 2u);
+    CHECK_EQ(stats.deleted_bytes, 2000u);
+    CHECK_EQ(stats.skipped_in_use, 1u);
+    CHECK_EQ(stats.files, 3u);
+    CHECK_EQ(stats.bytes, 3000u);
+}
+
+TEST_CASE("retention/max_age_deletes_expired_files_only") {
+    TempDir dir;
+    write_aged_file(dir / "old.mp4", 100, hours(2));
+    write_aged_file(dir / "older.jpg", 100, hours(3));
+    write_aged_file(dir / "recording.mp4", 100, hours(4)); // 録画中（読み手として登録）
+    write_aged_file(dir / "recent.mp4", 100, minutes(30));
+
+    RetentionManager::Params params;
+    params.max_age = hours(1);
+    RetentionManager retention({dir.path()}, single_pass(params));
+    auto lease = retention.acquire(dir / "recording.mp4");
+    retention.start();
+    REQUIRE(wait_deleted(retention, 2));
+    retention.stop();
+
+    CHECK(!exists(dir / "old.mp4"));
+    CHECK(!exists(dir / "older.jpg"));
+    CHECK(exists(dir / "recording.mp4"));
+    CHECK(exists(dir / "recent.mp4"));
+    CHECK_EQ(retention.stats().deleted_files, 2u);
+    CHECK_EQ(retention.stats().skipped_in_use, 1u);
+}
+
+TEST_CASE("retention/min_free_deletes_until_shortfall_is_covered") {
+    TempDir dir;
+    const size_t file_size = 1024 * 1024;
+    const std::vector<std::string> names = {"1.mp4", "2.mp4", "3.mp4", "4.mp4", "5.mp4"};
+    for (size_t i = 0; i < names.size(); i++) {
+        write_aged_file(dir / names[i], file_size, minutes(static_cast<int>(50 - i * 10)));
+    }
+
+    // 今の空き容量より2.5MB多くを求める（古い3ファイルを消せば足りる）
+    struct statvfs st;
+    REQUIRE_EQ(statvfs(dir.path().c_str(), &st), 0);
+    uint64_t available = static_cast<uint64_t>(st.f_bavail) * st.f_frsize;
+    RetentionManager::Params params;
+    params.max_age = std::chrono::seconds(0);
+    params.min_free_bytes = available + file_size * 5 / 2;
+    RetentionManager retention({dir.path()}, single_pass(params));
+    retention.start();
+    REQUIRE(wait_deleted(retention, 3));
+    retention.stop();
+
+    CHECK(!exists(dir / "1.mp4"));
+    CHECK(!exists(dir / "2.mp4"));
+    CHECK(!exists(dir / "3.mp4"));
+    CHECK(exists(dir / "4.mp4"));
+    CHECK(exists(dir / "5.mp4"));
+    CHECK_EQ(retention.stats().deleted_files, 3u);
+}
+
+TEST_CASE("retention/added_files_are_indexed_without_rescan") {
+    TempDir dir;
+    write_aged_file(dir / "existing.mp4", 1000, minutes(30));
+
+    RetentionManager::Params params;
+    params.max_age = std::chrono::seconds(0);
+    RetentionManager retention({dir.path()}, single_pass(params));
+    retention.start();
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (retention.stats().scans == 0 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    REQUIRE_EQ(retention.stats().scans, 1u);
+    CHECK_EQ(retention.stats().files, 1u);
+
+    // 保存したファイルは走査を待たずに索引に入る（同じファイルを2回追加しても1件）
+    write_aged_file(dir / "new.jpg", 500, std::chrono::seconds(0));
+    retention.add_file(dir / "new.jpg");
+    retention.add_file(dir / "./new.jpg");
+    RetentionStats stats = retention.stats();
+    CHECK_EQ(stats.files, 2u);
+    CHECK_EQ(stats.bytes, 1500u);
+    CHECK_EQ(stats.scans, 1u);
+    retention.stop();
+}
+
+TEST_CASE("retention/deleted_files_leave_event_index") {
+    TempDir dir;
+    std::filesystem::create_directory(dir / "media");
+    write_aged_file(dir / "media/old.mp4", 1000, hours(3));
+    write_aged_file(dir / "media/old.jpg", 100, hours(3));
+    write_aged_file(dir / "media/new.mp4", 1000, minutes(1));
+
+    EventIndex index(dir / "events.idx");
+    REQUIRE(index.open());
+    EventRecord old_event;
+    old_event.start_ms = 1000;
+    old_event.end_ms = 2000;
+    old_event.video_file = "old.mp4";
+    old_event.video_bytes = 1000;
+    old_event.photo_file = "old.jpg";
+    old_event.photo_bytes = 100;
+    uint64_t old_id = index.begin_event(old_event);
+    EventRecord new_event = old_event;
+    new_event.start_ms = 3000;
+    new_event.video_file = "new.mp4";
+    new_event.photo_file.clear();
+    new_event.photo_bytes = 0;
+    uint64_t new_id = index.begin_event(new_event);
+
+    RetentionManager::Params params;
+    params.max_age = hours(1);
+    RetentionManager retention({dir / "media"}, single_pass(params), [&](const std::string& path) {
+        index.file_deleted(std::filesystem::path(path).filename().string());
+    });
+    retention.start();
+    REQUIRE(wait_deleted(retention, 2));
+    retention.stop();
+
+    // 削除したファイルはイベントから外れ、イベント自体は残る
+    EventRecord record;
+    REQUIRE(index.get(old_id, record));
+    CHECK(record.video_file.empty());
+    CHECK_EQ(record.video_bytes, 0u);
+    CHECK(record.photo_file.empty());
+    CHECK_EQ(record.start_ms, 1000);
+    REQUIRE(index.get(new_id, record));
+    CHECK_EQ(record.video_file, std::string("new.mp4"));
+    CHECK(exists(dir / "media/new.mp4"));
+
+    // 索引のファイルにも残る（次の起動で読み込んでも外れたまま）
+    index.close();
+    EventIndex reloaded(dir / "events.idx");
+    REQUIRE(reloaded.open());
+    REQUIRE(reloaded.get(old_id, record));
+    CHECK(record.video_file.empty());
+    CHECK(record.photo_file.empty());
+    CHECK_EQ(reloaded.size(), 2u);
+}
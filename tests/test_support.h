@@ -0,0 +1,506 @@
+#pragma once
+
+#include <stdlib.h> // mkdtemp
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <openssl/evp.h>
+#include <opencv2/opencv.hpp>
+
+#include "httplib.h"
+#include "camera_pipeline.h"
+#include "config_store.h"
+#include "frame_pool.h"
+#include "frame_source.h"
+#include "gpio_backend.h"
+#include "line_client.h"
+#include "line_outbox.h"
+#include "picam_context.h"
+#include "replay.h"
+#include "web_server.h"
+
+// テストで使う部品（一時ディレクトリ、連番画像、LINE APIのスタブ、main.cppと同じ構成）
+
+// テストごとの一時ディレクトリ（破棄するときに中身ごと消す）
+class TempDir {
+public:
+    TempDir() {
+        char pattern[] = "/tmp/picam_test_XXXXXX";
+        const char* created = mkdtemp(pattern);
+        path_ = created ? created : "/tmp";
+    }
+
+    ~TempDir() {
+        std::error_code ec;
+        std::filesystem::remove_all(path_, ec);
+    }
+
+    TempDir(const TempDir&) = delete;
+    TempDir& operator=(const TempDir&) = delete;
+
+    const std::string& path() const { return path_; }
+    std::string operator/(const std::string& name) const { return path_ + "/" + name; }
+
+private:
+    std::string path_;
+};
+
+inline void write_text_file(const std::string& path, const std::string& content) {
+    std::ofstream(path) << content;
+}
+
+inline std::string read_text_file(const std::string& path) {
+    std::ifstream ifs(path);
+    return std::string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+}
+
+// textの中のneedleの数
+inline size_t count_occurrences(const std::string& text, const std::string& needle) {
+    size_t count = 0;
+    for (size_t pos = text.find(needle); pos != std::string::npos; pos = text.find(needle, pos + needle.size())) {
+        count++;
+    }
+    return count;
+}
+
+// Prometheusのテキスト形式からseries（"名前{ラベル}"）の値を取り出す（なければ-1）
+inline double metric_value(const std::string& text, const std::string& series) {
+    std::string prefix = "\n" + series + " ";
+    size_t pos = text.find(prefix);
+    if (pos == std::string::npos) {
+        return -1.0;
+    }
+    return std::stod(text.substr(pos + prefix.size()));
+}
+
+// dirに連番画像（0000.png, 0001.png, ...）を書き、VideoCaptureで開くパターンを返す
+// 中身は顔のない単色の画像（顔の位置はラベルで与える）
+inline std::string write_frames(const std::string& dir, int count, cv::Size size = cv::Size(320, 240)) {
+    std::filesystem::create_directories(dir);
+    cv::Mat frame(size, CV_8UC3);
+    char name[32];
+    for (int i = 0; i < count; i++) {
+        frame.setTo(cv::Scalar(i % 256, 64, 128));
+        std::snprintf(name, sizeof(name), "/%04d.png", i);
+        cv::imwrite(dir + name, frame);
+    }
+    return dir + "/%04d.png";
+}
+
+// このスレッドでoperator newを呼んだ回数（test_main.cppで数える）
+uint64_t thread_allocation_count();
+
+// 読み込んでおいた1枚の画像を、決まった枚数だけ毎回コピーして渡す入力元
+// read()ではファイルを読まないので、カメラスレッドのメモリ確保をパイプラインの分だけ数えられる
+// measure()で指定した範囲のフレームの間に、このスレッドで確保した回数とプールの統計の差を記録する
+class PreloadedSource : public FrameSource {
+public:
+    PreloadedSource(std::string path, int frames, double fps) : path_(std::move(path)), frames_(frames), fps_(fps) {}
+
+    // from枚目を読む直前からto枚目を読む直前まで（to - from回のループ）を数える
+    void measure(int from, int to, const FramePool* pool) {
+        measure_from_ = from;
+        measure_to_ = to;
+        pool_ = pool;
+    }
+
+    bool open() override {
+        image_ = cv::imread(path_);
+        read_ = 0;
+        return !image_.empty();
+    }
+
+    bool read(cv::Mat& frame) override {
+        if (read_ == measure_from_) {
+            allocations_begin_ = thread_allocation_count();
+            pool_begin_ = pool_ ? pool_->stats() : FramePoolStats();
+        } else if (read_ == measure_to_) {
+            allocations = thread_allocation_count() - allocations_begin_;
+            FramePoolStats end = pool_ ? pool_->stats() : FramePoolStats();
+            pool_grown = end.grown - pool_begin_.grown;
+            pool_reallocated = end.reallocated - pool_begin_.reallocated;
+            measured = true;
+        }
+        if (read_ >= frames_) {
+            return false;
+        }
+        image_.copyTo(frame);
+        read_++;
+        return true;
+    }
+
+    cv::Size frame_size() override { return image_.size(); }
+    double fps() override { return fps_; }
+    void release() override {}
+
+    bool measured = false;
+    uint64_t allocations = 0;
+    uint64_t pool_grown = 0;
+    uint64_t pool_reallocated = 0;
+
+private:
+    std::string path_;
+    int frames_;
+    double fps_;
+    cv::Mat image_;
+    int read_ = 0;
+    int measure_from_ = -1;
+    int measure_to_ = -1;
+    const FramePool* pool_ = nullptr;
+    uint64_t allocations_begin_ = 0;
+    FramePoolStats pool_begin_;
+};
+
+// LINE Webhookの署名（Base64(HMAC-SHA256(チャネルシークレット, ボディ))）
+inline std::string sign_webhook(const std::string& secret, const std::string& body) {
+    unsigned char mac[EVP_MAX_MD_SIZE];
+    size_t mac_len = 0;
+    EVP_Q_mac(nullptr, "HMAC", nullptr, "SHA256", nullptr, secret.data(), secret.size(),
+              reinterpret_cast<const unsigned char*>(body.data()), body.size(), mac, sizeof(mac), &mac_len);
+    unsigned char encoded[4 * EVP_MAX_MD_SIZE / 3 + 4];
+    int encoded_len = EVP_EncodeBlock(encoded, mac, static_cast<int>(mac_len));
+    return std::string(reinterpret_cast<char*>(encoded), encoded_len);
+}
+
+// テキストメッセージ1件のWebhookのボディ
+inline std::string webhook_text_body(const std::string& text, const std::string& reply_token = "test-reply-token") {
+    return "{\"destination\":\"Utest\",\"events\":[{\"type\":\"message\",\"replyToken\":\"" + reply_token +
+           "\",\"message\":{\"type\":\"text\",\"id\":\"1\",\"text\":\"" + text + "\"}}]}";
+}
+
+// LINE Messaging APIのスタブ（127.0.0.1の空いているポートで待ち受け、受け取ったリクエストを記録する）
+//
+// - push_response() で積んだ応答を受け取った順に返す（なくなったら200）
+// - 応答ごとにステータス・遅延・Retry-Afterを指定でき、dropなら本文の途中で接続を切る（クライアントには接続エラーに見える）
+class StubLineServer {
+public:
+    struct Response {
+        int status = 200;
+        std::chrono::milliseconds delay{0};
+        bool drop = false;
+        std::string retry_after;
+    };
+
+    struct Received {
+        std::string path;
+        std::string body;
+        std::string authorization;
+        std::string retry_key;
+    };
+
+    StubLineServer() {
+        auto handler = [this](const httplib::Request& req, httplib::Response& res) {
+            Response planned;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                received_.push_back({req.path, req.body, req.get_header_value("Authorization"),
+                                     req.get_header_value("X-Line-Retry-Key")});
+                if (!planned_.empty()) {
+                    planned = planned_.front();
+                    planned_.pop_front();
+                }
+            }
+            cv_.notify_all();
+            if (planned.delay.count() > 0) {
+                std::this_thread::sleep_for(planned.delay);
+            }
+            if (planned.drop) {
+                // ヘッダーだけ送って本文を送らずに切る
+                res.set_content_provider(16, "application/json",
+                                         [](size_t, size_t, httplib::DataSink&) { return false; });
+                return;
+            }
+            res.status = planned.status;
+            if (!planned.retry_after.empty()) {
+                res.set_header("Retry-After", planned.retry_after);
+            }
+            res.set_content("{}", "application/json");
+        };
+        svr_.Post("/v2/bot/message/push", handler);
+        svr_.Post("/v2/bot/message/reply", handler);
+        port_ = svr_.bind_to_any_port("127.0.0.1");
+        thread_ = std::thread([this] { svr_.listen_after_bind(); });
+        svr_.wait_until_ready();
+    }
+
+    ~StubLineServer() {
+        svr_.stop();
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+    }
+
+    StubLineServer(const StubLineServer&) = delete;
+    StubLineServer& operator=(const StubLineServer&) = delete;
+
+    // LineClientのapi_baseに渡すURL
+    std::string base() const { return "http://127.0.0.1:" + std::to_string(port_); }
+
+    void push_response(Response response) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        planned_.push_back(response);
+    }
+
+    std::vector<Received> received() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return received_;
+    }
+
+    // pathへのリクエストの数
+    size_t count(const std::string& path) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t n = 0;
+        for (const auto& r : received_) {
+            n += (r.path == path);
+        }
+        return n;
+    }
+
+    // pathへのリクエストがn件になるまで最大timeoutだけ待つ
+    bool wait_for(const std::string& path, size_t n, std::chrono::milliseconds timeout) {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        std::unique_lock<std::mutex> lock(mutex_);
+        return cv_.wait_until(lock, deadline, [&] {
+            size_t count = 0;
+            for (const auto& r : received_) {
+                count += (r.path == path);
+            }
+            return count >= n;
+        });
+    }
+
+private:
+    httplib::Server svr_;
+    int port_ = -1;
+    std::thread thread_;
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Response> planned_;
+    std::vector<Received> received_;
+};
+
+// テスト用の設定（LINEのキーなどの必須の値を入れた上で、overridesで上書きする）
+inline void write_test_config(const std::string& path, const ConfigMap& overrides) {
+    ConfigMap config = {
+        {"CHANNEL_ACCESS_TOKEN", "test-token"},
+        {"CHANNEL_SECRET", "test-secret"},
+        {"USER_ID_TO_SEND", "Utest"},
+        {"NGROK_URL_BASE", "picam.example"},
+        {"HTTP_WORKERS", "4"},
+        {"HTTP_WEBHOOK_RESERVED_WORKERS", "1"},
+        {"LIVE_MAX_VIEWERS", "2"},
+        {"NOTIFY_COALESCE", "0ms"},
+        {"NOTIFY_MIN_INTERVAL", "0ms"},
+        {"DETECTION_INTERVAL", "1"},
+        {"RECORD_HOLD", "1s"},
+        {"RECORD_MAX_HOLD", "4s"},
+        {"INCIDENT_GAP", "2s"},
+        {"RETENTION_MIN_FREE", "0"},
+    };
+    for (const auto& kv : overrides) {
+        config[kv.first] = kv.second;
+    }
+    std::ofstream out(path);
+    for (const auto& kv : config) {
+        out << kv.first << "=" << kv.second << "\n";
+    }
+}
+
+// main.cppと同じ順にコンポーネントをつないだ構成
+//
+// - GPIOはMockGpio、LINE APIはStubLineServer（送信箱の送信関数から実際のLineClient::postで送る）
+// - フレームはsourceから読む（既定では連番画像のファイルをVideoCaptureSourceで開く）
+// - リプレイの仮想時刻で動かし、--detectionsのラベルを検出結果にするので、結果は実行環境によらない
+class PicamRig {
+public:
+    struct Options {
+        ReplayOptions replay;      // source / detections_path / fps / fast
+        ConfigMap config;          // write_test_configへの上書き
+        bool web_server = false;   // trueならport 0でWebServerを起動する
+        FrameSource* source = nullptr; // nullptrならreplay.sourceをVideoCaptureSourceで開く
+    };
+
+    PicamRig(const TempDir& dir, StubLineServer& line_server, Options options)
+        : dir_(dir), line_server_(line_server), options_(std::move(options)) {}
+
+    ~PicamRig() { shutdown(); }
+
+    PicamRig(const PicamRig&) = delete;
+    PicamRig& operator=(const PicamRig&) = delete;
+
+    // 出力先と設定を用意し、すべてのコンポーネントを起動してパイプラインを開く
+    bool open() {
+        options_.replay.out_dir = dir_ / "out";
+        options_.replay.config_path = dir_ / "config.txt";
+        write_test_config(options_.replay.config_path, options_.config);
+
+        context.replay = std::make_unique<Replay>(options_.replay);
+        if (!context.replay->prepare()) {
+            return false;
+        }
+        gpio_ = std::make_unique<MockGpio>([this](unsigned pin, unsigned level) {
+            context.replay_event("led", {{"pin", pin == LED_BLUE ? "blue" : "red"}, {"on", level == GPIO_HIGH}});
+        });
+
+        config_store = std::make_unique<ConfigStore>(options_.replay.config_path);
+        if (!config_store->reload()) {
+            return false;
+        }
+        auto startup_config = config_store->get();
+        const AppConfig& config = startup_config->app;
+
+        line = std::make_unique<LineClient>(context, line_server_.base());
+        outbox = std::make_unique<LineOutbox>(config.outbox_path,
+            [this](const std::string& endpoint, const std::string& body, const std::string& retry_key) {
+                return line->post(endpoint, body, config_store->get()->app, retry_key);
+            });
+        outbox->base_delay = std::chrono::milliseconds(50);
+        outbox->max_delay = std::chrono::milliseconds(200);
+        outbox->start();
+
+        context.line_notifier = std::make_unique<LineNotifier>(
+            [this](const std::string& body, std::function<void(bool)> on_result) {
+                outbox->submit(LINE_PUSH_MESSAGE_ENDPOINT, body, std::move(on_result));
+            },
+            config.notify_coalesce, config.notify_min_interval);
+        context.line_notifier->start();
+
+        context.event_index = std::make_unique<EventIndex>(config.event_index_path);
+        context.event_index->open();
+
+        RetentionManager::Params retention_params;
+        retention_params.max_age = std::chrono::duration_cast<std::chrono::seconds>(config.retention_max_age);
+        retention_params.quota_bytes = config.retention_quota;
+        retention_params.min_free_bytes = config.retention_min_free;
+        retention_params.interval = config.retention_interval;
+        retention_params.rescan_interval = config.retention_rescan_interval;
+        context.retention = std::make_unique<RetentionManager>(
+            std::vector<std::string>{config.photo_dir, config.video_dir}, retention_params,
+            [this](const std::string& path) { context.event_index->file_deleted(std::filesystem::path(path).filename().string()); });
+        context.retention->start();
+
+        context.frame_pool = std::make_unique<FramePool>(4);
+        FrameHub::Params live_params;
+        live_params.max_fps = config.live_max_fps;
+        live_params.width = config.live_width;
+        live_params.jpeg_quality = config.live_jpeg_quality;
+        context.frame_hub = std::make_unique<FrameHub>(live_params);
+        context.frame_hub->start();
+
+        if (options_.web_server) {
+            web_server = std::make_unique<WebServer>(context, *config_store, *line);
+            server_thread_ = std::thread(&WebServer::run, web_server.get(), 0);
+            web_port = web_server->wait_until_ready();
+            if (web_port < 0) {
+                return false;
+            }
+        }
+
+        if (options_.source == nullptr) {
+            owned_source_ = std::make_unique<VideoCaptureSource>(options_.replay.source);
+            options_.source = owned_source_.get();
+        }
+        pipeline = std::make_unique<CameraPipeline>(context, *config_store, *gpio_, *line, *options_.source);
+        opened_ = pipeline->open(options_.replay);
+        return opened_;
+    }
+
+    // 監視ループ（映像の終わりか終了コマンドで戻る）
+    void run() { pipeline->run(); }
+
+    // main.cppの終了処理と同じ順に止める（通知は送り切ってから止める）
+    void shutdown() {
+        if (shut_down_) {
+            return;
+        }
+        shut_down_ = true;
+        if (web_server) {
+            web_server->stop();
+        }
+        ControlCommand pending_cmd;
+        while (context.control_queue.try_pop(pending_cmd)) {
+            context.control_queue.complete(pending_cmd, false);
+        }
+        if (context.line_notifier) {
+            context.line_notifier->stop();
+        }
+        if (outbox) {
+            outbox->wait_idle(std::chrono::seconds(5));
+            outbox->stop();
+        }
+        if (server_thread_.joinable()) {
+            server_thread_.join();
+        }
+        if (context.retention) {
+            context.retention->stop();
+        }
+        if (context.frame_hub) {
+            context.frame_hub->stop();
+        }
+        if (pipeline) {
+            pipeline->close();
+        }
+        if (context.event_index) {
+            context.event_index->close();
+        }
+        if (context.replay && opened_) {
+            context.replay->finish(context.metrics.detections_total.value());
+        }
+    }
+
+    // events.log（shutdown()の後に読む）
+    std::string events_log() const { return read_text_file(options_.replay.out_dir + "/events.log"); }
+
+    PicamContext context;
+    std::unique_ptr<ConfigStore> config_store;
+    std::unique_ptr<LineClient> line;
+    std::unique_ptr<LineOutbox> outbox;
+    std::unique_ptr<WebServer> web_server;
+    std::unique_ptr<CameraPipeline> pipeline;
+    int web_port = -1;
+
+private:
+    const TempDir& dir_;
+    StubLineServer& line_server_;
+    Options options_;
+    std::unique_ptr<MockGpio> gpio_;
+    std::unique_ptr<VideoCaptureSource> owned_source_;
+    std::thread server_thread_;
+    bool opened_ = false;
+    bool shut_down_ = false;
+};
+
+// 別スレッドで監視ループを回す
+// テストが途中で失敗して抜けた場合も、終了コマンドを積んでからスレッドを待つ
+class PipelineThread {
+public:
+    explicit PipelineThread(PicamRig& rig) : rig_(rig), thread_([&rig] { rig.run(); }) {}
+
+    ~PipelineThread() {
+        if (thread_.joinable()) {
+            rig_.context.control_queue.push(ControlCommandType::Shutdown);
+            thread_.join();
+        }
+    }
+
+    PipelineThread(const PipelineThread&) = delete;
+    PipelineThread& operator=(const PipelineThread&) = delete;
+
+    void join() { thread_.join(); }
+
+private:
+    PicamRig& rig_;
+    std::thread thread_;
+};
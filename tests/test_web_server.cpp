@@ -0,0 +1,478 @@
+// WebServerの起動と停止、各ルートの応答のテスト
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "nlohmann/json.hpp"
+#include "http_cache.h"
+#include "test_harness.h"
+#include "test_support.h"
+
+namespace {
+
+// パイプラインなしでWebServerだけを動かす構成
+struct WebOnly {
+    TempDir dir;
+    PicamContext context;
+    std::unique_ptr<ConfigStore> config_store;
+    std::unique_ptr<LineClient> line;
+    std::unique_ptr<WebServer> server;
+
+    explicit WebOnly(const ConfigMap& overrides = {}) {
+        write_test_config(dir / "config.txt", overrides);
+        config_store = std::make_unique<ConfigStore>(dir / "config.txt");
+        line = std::make_unique<LineClient>(context, "http://127.0.0.1:9");
+        server = std::make_unique<WebServer>(context, *config_store, *line);
+    }
+};
+
+// run()がtimeout以内に戻ればtrue
+// 戻らなければスレッドを待てないので、その場で失敗として終了する（ctestのタイムアウトを待たない）
+bool returns_within(std::thread& thread, std::future<void>& done, std::chrono::milliseconds timeout) {
+    if (done.wait_for(timeout) != std::future_status::ready) {
+        std::fprintf(stderr, "  WebServer::run() が戻りません\n");
+        std::_Exit(1);
+    }
+    thread.join();
+    return true;
+}
+
+// リクエストだけ送って応答を読まない接続（送信側のワーカーを塞いだままにする）
+int open_stalled_request(int port, const std::string& target) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    // 受信バッファを小さくして、サーバーの送信がすぐに詰まるようにする
+    int rcvbuf = 4096;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    std::string request = "GET " + target + " HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+    if (send(fd, request.data(), request.size(), 0) != static_cast<ssize_t>(request.size())) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// 条件が成り立つまで最大timeoutだけ繰り返し確かめる
+template <typename Condition>
+bool eventually(Condition condition, std::chrono::milliseconds timeout) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (std::chrono::steady_clock::now() < deadline) {
+        if (condition()) {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    return condition();
+}
+
+// 索引に開始時刻を1秒ずつずらしたイベントをcount件登録する
+void add_events(EventIndex& index, int count) {
+    for (int i = 1; i <= count; i++) {
+        EventRecord record;
+        record.incident = static_cast<uint64_t>(i);
+        record.start_ms = 1767268800000 + i * 1000;
+        record.video_file = "20260101_" + std::to_string(i) + ".mp4";
+        record.photo_file = "20260101_" + std::to_string(i) + ".jpg";
+        index.begin_event(record);
+    }
+}
+
+} // namespace
+
+TEST_CASE("web/stop_before_run_does_not_listen") {
+    WebOnly web;
+    REQUIRE(web.config_store->reload());
+
+    // パイプラインを開けずに終了する場合、run()より先にstop()が呼ばれることがある
+    web.server->stop();
+    std::promise<void> finished;
+    std::future<void> done = finished.get_future();
+    std::thread thread([&] {
+        web.server->run(0);
+        finished.set_value();
+    });
+    CHECK(returns_within(thread, done, std::chrono::seconds(5)));
+    CHECK_EQ(web.server->wait_until_ready(), -1);
+}
+
+TEST_CASE("web/stop_while_listening_returns") {
+    WebOnly web;
+    REQUIRE(web.config_store->reload());
+
+    std::promise<void> finished;
+    std::future<void> done = finished.get_future();
+    std::thread thread([&] {
+        web.server->run(0);
+        finished.set_value();
+    });
+    int port = web.server->wait_until_ready();
+    REQUIRE(port > 0);
+    httplib::Client client("127.0.0.1", port);
+    auto res = client.Get("/config_version");
+    REQUIRE(res);
+    CHECK_EQ(res->status, 200);
+
+    web.server->stop();
+    web.server->stop(); // 2回目は何もしない
+    CHECK(returns_within(thread, done, std::chrono::seconds(5)));
+}
+
+TEST_CASE("web/webhook_verifier_follows_reloaded_secret") {
+    WebOnly web;
+    REQUIRE(web.config_store->reload());
+
+    std::promise<void> finished;
+    std::future<void> done = finished.get_future();
+    std::thread thread([&] {
+        web.server->run(0);
+        finished.set_value();
+    });
+    int port = web.server->wait_until_ready();
+    REQUIRE(port > 0);
+
+    // イベントのないWebhook（署名の検証だけを通る）
+    const std::string body = "{\"destination\":\"Utest\",\"events\":[]}";
+    auto post_signed = [&](const std::string& secret) {
+        httplib::Client client("127.0.0.1", port);
+        httplib::Headers headers = {{"X-Line-Signature", sign_webhook(secret, body)}};
+        auto res = client.Post("/webhook", headers, body, "application/json");
+        return res ? res->status : -1;
+    };
+
+    // 検証器はワーカーごとに持つので、複数のワーカーに当たるよう何度か送る
+    for (int i = 0; i < 8; i++) {
+        CHECK_EQ(post_signed("test-secret"), 200);
+    }
+
+    // シークレットを差し替えると、どのワーカーも新しいシークレットで検証する
+    write_test_config(web.dir / "config.txt", {{"CHANNEL_SECRET", "rotated-secret"}});
+    REQUIRE(web.config_store->reload());
+    for (int i = 0; i < 8; i++) {
+        CHECK_EQ(post_signed("test-secret"), 401);
+        CHECK_EQ(post_signed("rotated-secret"), 200);
+    }
+
+    web.server->stop();
+    CHECK(returns_within(thread, done, std::chrono::seconds(5)));
+}
+
+TEST_CASE("web/request_rejected_before_routing_is_not_timed") {
+    TempDir dir;
+    StubLineServer line_server;
+    PicamRig::Options options;
+    options.replay.source = write_frames(dir / "frames", 2, cv::Size(160, 120));
+    options.web_server = true;
+    PicamRig rig(dir, line_server, options);
+    REQUIRE(rig.open());
+    httplib::Client client("127.0.0.1", rig.web_port);
+
+    auto scrape = [&] {
+        auto res = client.Get("/metrics");
+        return res ? res->body : std::string();
+    };
+    const std::string events_count = "picam_http_request_duration_seconds_count{route=\"/events\"}";
+    const std::string responses_4xx = "picam_http_responses_total{code=\"4xx\"}";
+    std::string before = scrape();
+    REQUIRE_EQ(metric_value(before, events_count), 0.0);
+    REQUIRE_EQ(metric_value(before, responses_4xx), 0.0);
+
+    // Rangeが読めないリクエストはルーティングの前に416で返る（開始時刻がないので処理時間は記録しない）
+    auto rejected = client.Get("/events", {{"Range", "bytes=abc"}});
+    REQUIRE(rejected);
+    CHECK_EQ(rejected->status, 416);
+    // ロガーは本文を送ってから呼ばれるので、応答を受け取った直後にはまだ数えられていないことがある
+    std::string after_rejected;
+    CHECK(eventually([&] {
+        after_rejected = scrape();
+        return metric_value(after_rejected, responses_4xx) == 1.0;
+    }, std::chrono::milliseconds(2000)));
+    CHECK_EQ(metric_value(after_rejected, events_count), 0.0);
+
+    // ルーティングを通ったリクエストは記録する
+    auto listed = client.Get("/events");
+    REQUIRE(listed);
+    CHECK_EQ(listed->status, 200);
+    CHECK(eventually([&] { return metric_value(scrape(), events_count) == 1.0; }, std::chrono::milliseconds(2000)));
+    rig.shutdown();
+}
+
+TEST_CASE("web/busy_media_and_queries_leave_webhook_worker") {
+    TempDir dir;
+    StubLineServer line_server;
+    PicamRig::Options options;
+    options.replay.source = write_frames(dir / "frames", 2, cv::Size(160, 120));
+    options.web_server = true;
+    // ワーカー4・Webhook予約1なので、配信と検索で使えるのは3
+    options.config = {{"HTTP_VIDEO_MAX_CONCURRENCY", "3"}, {"HTTP_WRITE_TIMEOUT", "1s"}};
+    PicamRig rig(dir, line_server, options);
+    REQUIRE(rig.open());
+    {
+        std::ofstream video(dir / "out/video/big.mp4", std::ios::binary);
+        std::string chunk(1024 * 1024, 'v');
+        for (int i = 0; i < 32; i++) {
+            video.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+        }
+    }
+    httplib::Client client("127.0.0.1", rig.web_port);
+
+    // 配信の応答は1回で接続を閉じてもらう
+    auto image = client.Get("/image?file=none.jpg");
+    REQUIRE(image);
+    CHECK_EQ(image->status, 404);
+    CHECK_EQ(image->get_header_value("Connection"), std::string("close"));
+
+    // 読まれない動画の送信で、配信と検索の枠を使い切る
+    std::vector<int> stalled;
+    for (int i = 0; i < 3; i++) {
+        int fd = open_stalled_request(rig.web_port, "/video?file=big.mp4");
+        REQUIRE(fd >= 0);
+        stalled.push_back(fd);
+    }
+    CHECK(eventually([&] {
+        auto res = client.Get("/image?file=none.jpg");
+        return res && res->status == 503;
+    }, std::chrono::seconds(5)));
+
+    // /events・/metricsも503で断り、Webhookは予約したワーカーで受け付ける
+    auto events = client.Get("/events");
+    REQUIRE(events);
+    CHECK_EQ(events->status, 503);
+    auto metrics = client.Get("/metrics");
+    REQUIRE(metrics);
+    CHECK_EQ(metrics->status, 503);
+    const std::string body = "{\"destination\":\"Utest\",\"events\":[]}";
+    httplib::Headers headers = {{"X-Line-Signature", sign_webhook("test-secret", body)}};
+    auto webhook = client.Post("/webhook", headers, body, "application/json");
+    REQUIRE(webhook);
+    CHECK_EQ(webhook->status, 200);
+
+    // 接続が切れたら枠が戻る
+    for (int fd : stalled) {
+        close(fd);
+    }
+    CHECK(eventually([&] {
+        auto res = client.Get("/metrics");
+        return res && res->status == 200;
+    }, std::chrono::seconds(10)));
+    rig.shutdown();
+}
+
+TEST_CASE("web/events_rejects_out_of_range_time") {
+    TempDir dir;
+    StubLineServer line_server;
+    PicamRig::Options options;
+    options.replay.source = write_frames(dir / "frames", 2, cv::Size(160, 120));
+    options.web_server = true;
+    PicamRig rig(dir, line_server, options);
+    REQUIRE(rig.open());
+    httplib::Client client("127.0.0.1", rig.web_port);
+    auto status = [&](const std::string& target) {
+        auto res = client.Get(target);
+        return res ? res->status : -1;
+    };
+
+    // ミリ秒にするとint64_tに収まらない値（INT64_MAX / 1000 + 1）は400
+    CHECK_EQ(status("/events?from=9223372036854776"), 400);
+    CHECK_EQ(status("/events?to=9223372036854776"), 400);
+    CHECK_EQ(status("/events?from=-9223372036854776"), 400);
+    CHECK_EQ(status("/events?to=99999999999999999999"), 400);
+    // 数字でない値・数字の後に余計な文字が続く値も400
+    CHECK_EQ(status("/events?from=abc"), 400);
+    CHECK_EQ(status("/events?from=12abc"), 400);
+    CHECK_EQ(status("/events?to="), 400);
+    // 収まる範囲の端は受け付ける
+    CHECK_EQ(status("/events?from=-9223372036854775&to=9223372036854775"), 200);
+    CHECK_EQ(status("/events?from=0&to=1767268800"), 200);
+    rig.shutdown();
+}
+
+TEST_CASE("web/webhook_replies_do_not_wait_for_camera") {
+    TempDir dir;
+    StubLineServer line_server;
+    PicamRig::Options options;
+    options.replay.source = write_frames(dir / "frames", 2, cv::Size(160, 120));
+    options.web_server = true;
+    PicamRig rig(dir, line_server, options);
+    REQUIRE(rig.open());
+    httplib::Client client("127.0.0.1", rig.web_port);
+    auto send = [&](const std::string& text, const std::string& reply_token) {
+        const std::string body = webhook_text_body(text, reply_token);
+        httplib::Headers headers = {{"X-Line-Signature", sign_webhook("test-secret", body)}};
+        auto res = client.Post("/webhook", headers, body, "application/json");
+        return res && res->status == 200;
+    };
+    auto replied = [&](const std::string& text) {
+        for (const auto& request : line_server.received()) {
+            if (request.body.find(text) != std::string::npos) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    // カメラスレッドを動かさないので、撮影と監視停止の結果は届かない
+    REQUIRE(send("！", "token-photo"));
+    REQUIRE(send("監視停止", "token-stop"));
+    REQUIRE(send("？", "token-status"));
+
+    // 「？」は撮影の結果（最大20秒）を待たずに返信される
+    CHECK(eventually([&] { return replied("現在、監視中です。"); }, std::chrono::seconds(2)));
+    // 監視停止は時間切れで「まだ確認できていない」と返信し、停止したとは返信しない
+    CHECK(eventually([&] { return replied("監視の停止をまだ確認できていません。"); }, std::chrono::seconds(6)));
+    CHECK(!replied("監視を停止します。"));
+    rig.shutdown();
+}
+
+TEST_CASE("web/events_pages_with_cursor") {
+    TempDir dir;
+    StubLineServer line_server;
+    PicamRig::Options options;
+    options.replay.source = write_frames(dir / "frames", 2, cv::Size(160, 120));
+    options.web_server = true;
+    PicamRig rig(dir, line_server, options);
+    REQUIRE(rig.open());
+    add_events(*rig.context.event_index, 5);
+    httplib::Client client("127.0.0.1", rig.web_port);
+
+    // 新しい順に2件ずつ、next_cursorをたどって最後まで読む
+    std::vector<uint64_t> ids;
+    std::string target = "/events?limit=2";
+    int pages = 0;
+    while (pages < 10) {
+        auto res = client.Get(target);
+        REQUIRE(res);
+        REQUIRE_EQ(res->status, 200);
+        auto page = nlohmann::json::parse(res->body);
+        pages++;
+        for (const auto& event : page["events"]) {
+            ids.push_back(event["id"].get<uint64_t>());
+        }
+        if (page["next_cursor"].is_null()) {
+            break;
+        }
+        target = "/events?limit=2&cursor=" + page["next_cursor"].get<std::string>();
+    }
+    CHECK_EQ(pages, 3);
+    CHECK(ids == std::vector<uint64_t>({5, 4, 3, 2, 1}));
+
+    // 範囲を絞ると、その中だけをページングする
+    auto ranged = client.Get("/events?from=1767268802&to=1767268804");
+    REQUIRE(ranged);
+    auto ranged_page = nlohmann::json::parse(ranged->body);
+    REQUIRE_EQ(ranged_page["events"].size(), 2u);
+    CHECK_EQ(ranged_page["events"][0]["id"].get<uint64_t>(), 3u);
+    CHECK(ranged_page["next_cursor"].is_null());
+    rig.shutdown();
+}
+
+TEST_CASE("web/event_etag_not_modified") {
+    TempDir dir;
+    StubLineServer line_server;
+    PicamRig::Options options;
+    options.replay.source = write_frames(dir / "frames", 2, cv::Size(160, 120));
+    options.web_server = true;
+    PicamRig rig(dir, line_server, options);
+    REQUIRE(rig.open());
+    add_events(*rig.context.event_index, 3);
+    httplib::Client client("127.0.0.1", rig.web_port);
+
+    auto first = client.Get("/events/2");
+    REQUIRE(first);
+    REQUIRE_EQ(first->status, 200);
+    std::string etag = first->get_header_value("ETag");
+    REQUIRE(!etag.empty());
+    httplib::Headers conditional = {{"If-None-Match", etag}};
+
+    // 変わっていなければ304（一覧も同じETagで304）
+    auto again = client.Get("/events/2", conditional);
+    REQUIRE(again);
+    CHECK_EQ(again->status, 304);
+    auto list = client.Get("/events", conditional);
+    REQUIRE(list);
+    CHECK_EQ(list->status, 304);
+
+    // 存在しないidはETagが一致しても404
+    auto missing = client.Get("/events/99", conditional);
+    REQUIRE(missing);
+    CHECK_EQ(missing->status, 404);
+    auto missing_any = client.Get("/events/99", {{"If-None-Match", "*"}});
+    REQUIRE(missing_any);
+    CHECK_EQ(missing_any->status, 404);
+
+    // イベントが増えたら古いETagでは304にならない
+    add_events(*rig.context.event_index, 1);
+    auto changed = client.Get("/events/2", conditional);
+    REQUIRE(changed);
+    CHECK_EQ(changed->status, 200);
+    CHECK(changed->get_header_value("ETag") != etag);
+    rig.shutdown();
+}
+
+TEST_CASE("web/events_gzip_follows_accept_encoding") {
+    TempDir dir;
+    StubLineServer line_server;
+    PicamRig::Options options;
+    options.replay.source = write_frames(dir / "frames", 2, cv::Size(160, 120));
+    options.web_server = true;
+    PicamRig rig(dir, line_server, options);
+    REQUIRE(rig.open());
+    add_events(*rig.context.event_index, 10);
+    httplib::Client client("127.0.0.1", rig.web_port);
+    client.set_decompress(false); // 圧縮されたままの本文を確かめる
+    auto encoding_for = [&](const std::string& accept_encoding) {
+        auto res = client.Get("/events", {{"Accept-Encoding", accept_encoding}});
+        if (!res || res->status != 200) {
+            return std::string("error");
+        }
+        // gzipなら本文がgzipのマジックナンバーで始まる
+        bool gzip_body = res->body.size() > 2 && static_cast<unsigned char>(res->body[0]) == 0x1f &&
+                         static_cast<unsigned char>(res->body[1]) == 0x8b;
+        std::string encoding = res->get_header_value("Content-Encoding");
+        return gzip_body == (encoding == "gzip") ? encoding : std::string("mismatch");
+    };
+
+    CHECK_EQ(encoding_for("gzip"), std::string("gzip"));
+    CHECK_EQ(encoding_for("deflate, gzip;q=0.5"), std::string("gzip"));
+    CHECK_EQ(encoding_for("br, *"), std::string("gzip"));
+    // q=0は拒否
+    CHECK_EQ(encoding_for("gzip;q=0"), std::string(""));
+    CHECK_EQ(encoding_for("gzip; q=0.000, deflate"), std::string(""));
+    CHECK_EQ(encoding_for("*;q=0.5, gzip;q=0"), std::string(""));
+    CHECK_EQ(encoding_for("identity"), std::string(""));
+    rig.shutdown();
+}
+
+TEST_CASE("web/accepts_gzip_reads_quality_values") {
+    CHECK(accepts_gzip("gzip"));
+    CHECK(accepts_gzip("GZIP;Q=1"));
+    CHECK(accepts_gzip("gzip;q=0.001"));
+    CHECK(accepts_gzip("x-gzip"));
+    CHECK(accepts_gzip("deflate, *;q=0.1"));
+    CHECK(!accepts_gzip(""));
+    CHECK(!accepts_gzip("gzip;q=0"));
+    CHECK(!accepts_gzip("gzip;q=0.0"));
+    CHECK(!accepts_gzip("deflate, gzip ; q=0"));
+    CHECK(!accepts_gzip("*;q=0"));
+    CHECK(!accepts_gzip("gzip;q=0, *"));
+    // gzipの指定は "*" より優先する
+    CHECK(accepts_gzip("*;q=0, gzip"));
+    // 名前の一部にgzipを含むだけのコーディングは別物
+    CHECK(!accepts_gzip("notgzip"));
+}
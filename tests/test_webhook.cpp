@@ -0,0 +1,153 @@
+// Webhookボディのストリーミング解析（parse_webhook_events）とコマンド表のテスト
+// 解析はJSONのDOMを作らないので、入れ子・種類の違うイベント・大きなボディで取り違えないことを確かめる
+
+#include <string>
+#include <vector>
+
+#include "test_harness.h"
+#include "test_support.h"
+#include "webhook_parser.h"
+
+namespace {
+
+// イベント1件分のJSON
+std::string text_event(const std::string& text, const std::string& reply_token) {
+    return "{\"type\":\"message\",\"replyToken\":\"" + reply_token +
+           "\",\"message\":{\"type\":\"text\",\"id\":\"1\",\"text\":\"" + text + "\"}}";
+}
+
+std::string webhook_body(const std::string& events) {
+    return "{\"destination\":\"Utest\",\"events\":[" + events + "]}";
+}
+
+} // namespace
+
+TEST_CASE("webhook/parses_text_messages") {
+    std::vector<WebhookEvent> events;
+    REQUIRE(parse_webhook_events(webhook_body(text_event("！", "token-1") + "," + text_event("監視停止", "token-2")), events));
+    REQUIRE_EQ(events.size(), 2u);
+    CHECK_EQ(events[0].text, std::string("！"));
+    CHECK_EQ(events[0].reply_token, std::string("token-1"));
+    CHECK_EQ(events[1].text, std::string("監視停止"));
+    CHECK_EQ(events[1].reply_token, std::string("token-2"));
+
+    // イベントのないボディ（LINE Developersの接続確認）は成功して0件
+    events.clear();
+    REQUIRE(parse_webhook_events(webhook_body(""), events));
+    CHECK(events.empty());
+
+    // 不正なJSONは失敗
+    events.clear();
+    CHECK(!parse_webhook_events("{\"events\":[", events));
+    CHECK(!parse_webhook_events("", events));
+}
+
+TEST_CASE("webhook/nested_objects_do_not_override_fields") {
+    // messageの中の入れ子（emojis・mention・quotedMessageId）や、イベントの他のオブジェクト
+    // （source・deliveryContext）にあるtype・textは拾わない。キーの順序にも依存しない
+    const std::string event =
+        "{\"message\":{\"emojis\":[{\"index\":0,\"type\":\"sticker\",\"text\":\"絵文字\"}],"
+        "\"mention\":{\"mentionees\":[{\"type\":\"user\",\"text\":\"@someone\"}]},"
+        "\"text\":\"？\",\"id\":\"2\",\"type\":\"text\",\"quotedMessageId\":\"1\"},"
+        "\"source\":{\"type\":\"user\",\"userId\":\"Uabc\"},"
+        "\"deliveryContext\":{\"isRedelivery\":false},"
+        "\"replyToken\":\"token-nested\",\"mode\":\"active\",\"type\":\"message\"}";
+    std::vector<WebhookEvent> events;
+    REQUIRE(parse_webhook_events(webhook_body(event), events));
+    REQUIRE_EQ(events.size(), 1u);
+    CHECK_EQ(events[0].text, std::string("？"));
+    CHECK_EQ(events[0].reply_token, std::string("token-nested"));
+
+    // 解析器が追う深さを超えた入れ子があっても、後続のイベントを読める
+    std::string deep;
+    for (int i = 0; i < 40; i++) {
+        deep += "{\"a\":[";
+    }
+    for (int i = 0; i < 40; i++) {
+        deep += "]}";
+    }
+    const std::string deep_event = "{\"type\":\"message\",\"replyToken\":\"token-deep\",\"extra\":" + deep +
+                                   ",\"message\":{\"type\":\"text\",\"text\":\"監視再開\"}}";
+    events.clear();
+    REQUIRE(parse_webhook_events(webhook_body(deep_event + "," + text_event("！", "token-after")), events));
+    REQUIRE_EQ(events.size(), 2u);
+    CHECK_EQ(events[0].text, std::string("監視再開"));
+    CHECK_EQ(events[0].reply_token, std::string("token-deep"));
+    CHECK_EQ(events[1].reply_token, std::string("token-after"));
+}
+
+TEST_CASE("webhook/skips_non_text_events") {
+    const std::string sticker =
+        "{\"type\":\"message\",\"replyToken\":\"token-sticker\",\"message\":{\"type\":\"sticker\",\"id\":\"3\",\"packageId\":\"1\",\"stickerId\":\"1\"}}";
+    const std::string image =
+        "{\"type\":\"message\",\"replyToken\":\"token-image\",\"message\":{\"type\":\"image\",\"id\":\"4\",\"text\":\"！\"}}";
+    const std::string follow = "{\"type\":\"follow\",\"replyToken\":\"token-follow\",\"source\":{\"type\":\"user\",\"userId\":\"Uabc\"}}";
+    const std::string postback = "{\"type\":\"postback\",\"replyToken\":\"token-postback\",\"postback\":{\"data\":\"！\"}}";
+    const std::string unfollow = "{\"type\":\"unfollow\",\"source\":{\"type\":\"user\",\"userId\":\"Uabc\"}}";
+
+    std::vector<WebhookEvent> events;
+    REQUIRE(parse_webhook_events(webhook_body(sticker + "," + image + "," + follow + "," + text_event("？", "token-text") + "," +
+                                              postback + "," + unfollow),
+                                 events));
+    // テキストメッセージだけが残り、前のイベントの返信トークンや本文が混ざらない
+    REQUIRE_EQ(events.size(), 1u);
+    CHECK_EQ(events[0].text, std::string("？"));
+    CHECK_EQ(events[0].reply_token, std::string("token-text"));
+}
+
+TEST_CASE("webhook/large_text_and_oversized_body") {
+    // 上限より小さければ、長い本文もそのまま取り出す
+    const std::string long_text(5000, 'a');
+    std::vector<WebhookEvent> events;
+    REQUIRE(parse_webhook_events(webhook_body(text_event(long_text, "token-long")), events));
+    REQUIRE_EQ(events.size(), 1u);
+    CHECK_EQ(events[0].text.size(), long_text.size());
+
+    // WEBHOOK_MAX_BODYを超えるボディは解析せずに413で断り、返信もしない
+    TempDir dir;
+    StubLineServer line_server;
+    PicamRig::Options options;
+    options.replay.source = write_frames(dir / "frames", 2, cv::Size(160, 120));
+    options.web_server = true;
+    options.config = {{"WEBHOOK_MAX_BODY", "1KB"}};
+    PicamRig rig(dir, line_server, options);
+    REQUIRE(rig.open());
+    httplib::Client client("127.0.0.1", rig.web_port);
+    auto post = [&](const std::string& body) {
+        httplib::Headers headers = {{"X-Line-Signature", sign_webhook("test-secret", body)}};
+        auto res = client.Post("/webhook", headers, body, "application/json");
+        return res ? res->status : -1;
+    };
+
+    CHECK_EQ(post(webhook_body(text_event(std::string(2000, 'a'), "token-oversized"))), 413);
+    // 上限以下なら受け付けて返信する（コマンド表にない本文なのでコマンド一覧）
+    CHECK_EQ(post(webhook_body(text_event(std::string(100, 'a'), "token-small"))), 200);
+    rig.shutdown();
+
+    std::vector<StubLineServer::Received> received = line_server.received();
+    CHECK_EQ(received.size(), 1u);
+    for (const auto& request : received) {
+        CHECK(request.body.find("token-oversized") == std::string::npos);
+        CHECK(request.body.find("token-small") != std::string::npos);
+    }
+}
+
+TEST_CASE("webhook/command_table_lookup") {
+    // 表の各行がその行のコマンドに引ける
+    for (const auto& entry : WEBHOOK_COMMAND_TABLE) {
+        CHECK(lookup_webhook_command(entry.text) == entry.command);
+    }
+    CHECK(lookup_webhook_command("！") == WebhookCommand::TakePhoto);
+    CHECK(lookup_webhook_command("？") == WebhookCommand::QueryStatus);
+    CHECK(lookup_webhook_command("監視停止") == WebhookCommand::StopMonitoring);
+    CHECK(lookup_webhook_command("監視再開") == WebhookCommand::ResumeMonitoring);
+    CHECK(lookup_webhook_command("プログラム終了") == WebhookCommand::Shutdown);
+
+    // 完全一致だけを受け付け、それ以外はコマンド一覧
+    CHECK(lookup_webhook_command("") == WebhookCommand::Help);
+    CHECK(lookup_webhook_command("!") == WebhookCommand::Help);   // 半角
+    CHECK(lookup_webhook_command("?") == WebhookCommand::Help);
+    CHECK(lookup_webhook_command("監視") == WebhookCommand::Help);
+    CHECK(lookup_webhook_command("監視停止 ") == WebhookCommand::Help);
+    CHECK(lookup_webhook_command("！！") == WebhookCommand::Help);
+}
@@ -0,0 +1,418 @@
+// 顔検出パラメーターの調整ツール
+//
+//   ./detect_tuner [オプション] <動画ファイルまたはディレクトリ>...
+//
+//   --cascade <XML>           カスケード分類機（省略時はOpenCVの標準の場所）
+//   --scale-factors 1.05,1.1  DETECTION_SCALE_FACTORの候補（以下、カンマ区切り）
+//   --min-neighbors 3,5,7     DETECTION_MIN_NEIGHBORSの候補
+//   --min-sizes 20,30,40      DETECTION_MIN_SIZEの候補（縮小後の画像でのピクセル数）
+//   --downscales 0.5,0.75     DETECTION_DOWNSCALEの候補
+//   --intervals 1,3,5         DETECTION_INTERVALの候補
+//   --iou 0.3                 正解の枠と一致とみなす重なり（IoU）
+//   --min-recall 0.9          選ぶパラメーターに求める再現率
+//   --max-fp 0.01             選ぶパラメーターに許す1フレームあたりの誤検出数
+//   --out detect_tuned.txt    選んだパラメーター（config.txtの形式）
+//   --report detect_tuner.json すべての組み合わせの結果とパレート最適解
+//
+// 正解ラベルは動画と同じ名前の .labels ファイルに書く（clip01.mp4 なら clip01.labels）
+//
+//   # <フレーム番号>[-<最後のフレーム番号>] <x> <y> <幅> <高さ>（元の解像度のピクセル座標）
+//   120-180 200 150 80 80
+//   181 205 152 78 80
+//
+// 書かれていないフレームには顔が映っていないものとして扱う
+//
+// 各フレームを一度だけデコードし、すべての組み合わせで検出する
+// 検出間隔は、間引いたフレームの結果を次の検出まで使い続ける（カメラスレッドと同じ）ものとして評価する
+
+#include <time.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+#include "nlohmann/json.hpp"
+
+#include "detection_labels.h"
+#include "face_detector.h"
+#include "pipeline_metrics.h"
+
+namespace {
+
+struct TunerOptions {
+    std::string cascade_path = "/usr/share/opencv4/haarcascades/haarcascade_frontalface_default.xml";
+    std::vector<double> scale_factors = {1.05, 1.1, 1.2, 1.3};
+    std::vector<double> min_neighbors = {3, 5, 7};
+    std::vector<double> min_sizes = {20, 30, 40};
+    std::vector<double> downscales = {0.5, 0.75, 1.0};
+    std::vector<double> intervals = {1, 3, 5};
+    double iou = 0.3;
+    double min_recall = 0.9;
+    double max_fp = 0.01;
+    std::string out_path = "detect_tuned.txt";
+    std::string report_path = "detect_tuner.json";
+    std::vector<std::string> inputs;
+};
+
+bool parse_list(const std::string& text, std::vector<double>& values) {
+    values.clear();
+    std::stringstream ss(text);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        values.push_back(std::stod(item));
+    }
+    return !values.empty();
+}
+
+bool parse_options(int argc, char* argv[], TunerOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 2, "--") != 0) {
+            options.inputs.push_back(arg);
+            continue;
+        }
+        if (i + 1 >= argc) {
+            std::fprintf(stderr, "値がありません: %s\n", arg.c_str());
+            return false;
+        }
+        std::string value = argv[++i];
+        bool ok = true;
+        if (arg == "--cascade") {
+            options.cascade_path = value;
+        } else if (arg == "--scale-factors") {
+            ok = parse_list(value, options.scale_factors);
+        } else if (arg == "--min-neighbors") {
+            ok = parse_list(value, options.min_neighbors);
+        } else if (arg == "--min-sizes") {
+            ok = parse_list(value, options.min_sizes);
+        } else if (arg == "--downscales") {
+            ok = parse_list(value, options.downscales);
+        } else if (arg == "--intervals") {
+            ok = parse_list(value, options.intervals);
+        } else if (arg == "--iou") {
+            options.iou = std::stod(value);
+        } else if (arg == "--min-recall") {
+            options.min_recall = std::stod(value);
+        } else if (arg == "--max-fp") {
+            options.max_fp = std::stod(value);
+        } else if (arg == "--out") {
+            options.out_path = value;
+        } else if (arg == "--report") {
+            options.report_path = value;
+        } else {
+            std::fprintf(stderr, "不明な引数です: %s\n", arg.c_str());
+            return false;
+        }
+        if (!ok) {
+            std::fprintf(stderr, "候補がありません: %s\n", arg.c_str());
+            return false;
+        }
+    }
+    if (options.inputs.empty()) {
+        std::fprintf(stderr, "動画ファイルかディレクトリを指定してください\n");
+        return false;
+    }
+    return true;
+}
+
+// ラベル付きの動画1本
+struct LabeledClip {
+    std::string video_path;
+    DetectionLabels labels; // フレーム番号 → 正解の枠
+};
+
+// 引数の動画と、ディレクトリ内のラベルがある動画を集める
+std::vector<LabeledClip> collect_clips(const std::vector<std::string>& inputs) {
+    namespace fs = std::filesystem;
+    std::vector<std::string> videos;
+    for (const auto& input : inputs) {
+        if (fs::is_directory(input)) {
+            std::vector<std::string> found;
+            for (const auto& entry : fs::directory_iterator(input)) {
+                std::string ext = entry.path().extension().string();
+                if (ext != ".labels" && fs::exists(fs::path(entry.path()).replace_extension(".labels"))) {
+                    found.push_back(entry.path().string());
+                }
+            }
+            std::sort(found.begin(), found.end());
+            videos.insert(videos.end(), found.begin(), found.end());
+        } else {
+            videos.push_back(input);
+        }
+    }
+
+    std::vector<LabeledClip> clips;
+    for (const auto& video : videos) {
+        LabeledClip clip;
+        clip.video_path = video;
+        std::string labels_path = DetectionLabels::path_for(video);
+        std::string error;
+        if (!clip.labels.load(labels_path, error)) {
+            std::fprintf(stderr, "%s（この動画は除外します）\n", error.c_str());
+            continue;
+        }
+        clips.push_back(std::move(clip));
+    }
+    return clips;
+}
+
+double iou(const cv::Rect& a, const cv::Rect& b) {
+    int x1 = std::max(a.x, b.x);
+    int y1 = std::max(a.y, b.y);
+    int x2 = std::min(a.x + a.width, b.x + b.width);
+    int y2 = std::min(a.y + a.height, b.y + b.height);
+    double inter = std::max(0, x2 - x1) * static_cast<double>(std::max(0, y2 - y1));
+    double uni = static_cast<double>(a.area()) + b.area() - inter;
+    return uni > 0.0 ? inter / uni : 0.0;
+}
+
+// プロセス全体のCPU時間（OpenCVが内部で使うスレッドの分も含める）
+double process_cpu_ms() {
+    timespec ts{};
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// 1つのパラメーターの組み合わせの集計
+struct Candidate {
+    DetectionParams params;
+    int interval = 1;
+
+    uint64_t frames = 0;
+    uint64_t detections = 0;     // detect()を呼んだ回数
+    double cpu_ms = 0.0;         // detect()のCPU時間の合計
+    uint64_t true_positives = 0;
+    uint64_t false_negatives = 0;
+    uint64_t false_positives = 0;
+
+    std::vector<cv::Rect> held; // 次の検出まで使い続ける結果
+
+    double cpu_ms_per_frame() const { return frames ? cpu_ms / frames : 0.0; }
+    double recall() const {
+        uint64_t labeled = true_positives + false_negatives;
+        return labeled ? static_cast<double>(true_positives) / labeled : 1.0;
+    }
+    double fp_per_frame() const { return frames ? static_cast<double>(false_positives) / frames : 0.0; }
+
+    // CPU時間・再現率・誤検出のすべてで劣らず、どれかで勝っていればtrue
+    bool dominates(const Candidate& other) const {
+        bool no_worse = cpu_ms_per_frame() <= other.cpu_ms_per_frame() && recall() >= other.recall() &&
+                        fp_per_frame() <= other.fp_per_frame();
+        bool better = cpu_ms_per_frame() < other.cpu_ms_per_frame() || recall() > other.recall() ||
+                      fp_per_frame() < other.fp_per_frame();
+        return no_worse && better;
+    }
+
+    nlohmann::json to_json() const {
+        return {{"scale_factor", params.scale_factor},
+                {"min_neighbors", params.min_neighbors},
+                {"min_size", params.min_size},
+                {"downscale", params.downscale},
+                {"interval", interval},
+                {"cpu_ms_per_frame", cpu_ms_per_frame()},
+                {"recall", recall()},
+                {"fp_per_frame", fp_per_frame()},
+                {"frames", frames},
+                {"detections", detections}};
+    }
+};
+
+// 正解の枠と検出結果を貪欲に対応付けて数える
+void score_frame(Candidate& c, const std::vector<cv::Rect>& truth, double iou_threshold) {
+    std::vector<bool> used(c.held.size(), false);
+    for (const auto& t : truth) {
+        int best = -1;
+        double best_iou = iou_threshold;
+        for (size_t i = 0; i < c.held.size(); i++) {
+            double v = used[i] ? 0.0 : iou(t, c.held[i]);
+            if (v >= best_iou) {
+                best = static_cast<int>(i);
+                best_iou = v;
+            }
+        }
+        if (best >= 0) {
+            used[best] = true;
+            c.true_positives++;
+        } else {
+            c.false_negatives++;
+        }
+    }
+    c.false_positives += std::count(used.begin(), used.end(), false);
+}
+
+} // namespace
+
+
+int main(int argc, char* argv[]) {
+    TunerOptions options;
+    if (!parse_options(argc, argv, options)) {
+        return 2;
+    }
+
+    std::vector<LabeledClip> clips = collect_clips(options.inputs);
+    if (clips.empty()) {
+        std::fprintf(stderr, "ラベル付きの動画がありません\n");
+        return 1;
+    }
+
+    PipelineMetrics metrics; // FaceDetectorが記録する先（このツールでは使わない）
+    FaceDetector detector(metrics);
+    if (!detector.load(options.cascade_path)) {
+        std::fprintf(stderr, "カスケード分類機を読み込めません: %s\n", options.cascade_path.c_str());
+        return 1;
+    }
+
+    // 検出パラメーター × 検出間隔の組み合わせ
+    // 検出結果は間隔によらないので、検出は (縮小率, スケール, 近傍数, 最小サイズ) ごとに1回だけ行う
+    std::vector<DetectionParams> param_sets;
+    for (double ds : options.downscales)
+        for (double sf : options.scale_factors)
+            for (double mn : options.min_neighbors)
+                for (double ms : options.min_sizes) {
+                    DetectionParams p;
+                    p.downscale = ds;
+                    p.scale_factor = sf;
+                    p.min_neighbors = static_cast<int>(mn);
+                    p.min_size = static_cast<int>(ms);
+                    param_sets.push_back(p);
+                }
+    std::vector<Candidate> candidates; // param_sets[i] の間隔ごとの結果は i * intervals.size() から
+    for (const auto& p : param_sets) {
+        for (double interval : options.intervals) {
+            Candidate c;
+            c.params = p;
+            c.interval = std::max(1, static_cast<int>(interval));
+            candidates.push_back(c);
+        }
+    }
+    const size_t per_set = options.intervals.size();
+    std::printf("%zu本の動画で%zu通りを評価します\n", clips.size(), candidates.size());
+
+    cv::Mat frame;
+    std::vector<cv::Rect> faces;
+    std::vector<int> neighbors;
+    for (const auto& clip : clips) {
+        cv::VideoCapture cap(clip.video_path);
+        if (!cap.isOpened()) {
+            std::fprintf(stderr, "動画を開けません: %s\n", clip.video_path.c_str());
+            continue;
+        }
+        for (auto& c : candidates) {
+            c.held.clear();
+        }
+        int frame_no = 0;
+        while (cap.read(frame) && !frame.empty()) {
+            const std::vector<cv::Rect>& truth = clip.labels.at(frame_no);
+
+            for (size_t s = 0; s < param_sets.size(); s++) {
+                // この組み合わせでいずれかの間隔が検出するフレームなら、1回だけ検出する
+                bool needed = false;
+                for (size_t k = 0; k < per_set; k++) {
+                    needed = needed || frame_no % candidates[s * per_set + k].interval == 0;
+                }
+                double cost = 0.0;
+                if (needed) {
+                    double begin = process_cpu_ms();
+                    detector.detect(frame, param_sets[s], faces, neighbors);
+                    cost = process_cpu_ms() - begin;
+                }
+                for (size_t k = 0; k < per_set; k++) {
+                    Candidate& c = candidates[s * per_set + k];
+                    if (frame_no % c.interval == 0) {
+                        c.held = faces;
+                        c.cpu_ms += cost;
+                        c.detections++;
+                    }
+                    c.frames++;
+                    score_frame(c, truth, options.iou);
+                }
+            }
+            frame_no++;
+        }
+        if (frame_no == 0) {
+            std::fprintf(stderr, "フレームを読み込めません: %s\n", clip.video_path.c_str());
+        }
+        std::printf("  %s: %dフレーム\n", clip.video_path.c_str(), frame_no);
+    }
+
+    // パレート最適解（CPU時間・再現率・誤検出のどれかを犠牲にしないと改善できない組み合わせ）
+    std::vector<const Candidate*> front;
+    for (const auto& c : candidates) {
+        bool dominated = std::any_of(candidates.begin(), candidates.end(),
+                                     [&c](const Candidate& other) { return other.dominates(c); });
+        if (!dominated) {
+            front.push_back(&c);
+        }
+    }
+    std::sort(front.begin(), front.end(),
+              [](const Candidate* a, const Candidate* b) {
+                  if (a->cpu_ms_per_frame() != b->cpu_ms_per_frame()) return a->cpu_ms_per_frame() < b->cpu_ms_per_frame();
+                  if (a->recall() != b->recall()) return a->recall() > b->recall();
+                  return a->fp_per_frame() < b->fp_per_frame();
+              });
+
+    std::printf("\nパレート最適解（%zu通り）\n", front.size());
+    std::printf("%10s %8s %6s %6s %8s %6s %10s %7s\n", "scale", "neighbor", "size", "down", "interval", "recall",
+                "fp/frame", "cpu ms");
+    for (const Candidate* c : front) {
+        std::printf("%10.2f %8d %6d %6.2f %8d %6.3f %10.4f %7.2f\n", c->params.scale_factor, c->params.min_neighbors,
+                    c->params.min_size, c->params.downscale, c->interval, c->recall(), c->fp_per_frame(),
+                    c->cpu_ms_per_frame());
+    }
+
+    // 条件を満たす中でCPU時間が最も少ないもの（なければ再現率が最も高いもの）を選ぶ
+    const Candidate* chosen = nullptr;
+    for (const Candidate* c : front) {
+        if (c->recall() >= options.min_recall && c->fp_per_frame() <= options.max_fp) {
+            chosen = c;
+            break;
+        }
+    }
+    if (!chosen) {
+        std::printf("\n条件（再現率 >= %.2f、誤検出 <= %.4f/フレーム）を満たす組み合わせがないため、再現率が最も高いものを選びます\n",
+                    options.min_recall, options.max_fp);
+        chosen = *std::max_element(front.begin(), front.end(), [](const Candidate* a, const Candidate* b) {
+            return a->recall() < b->recall() || (a->recall() == b->recall() && a->fp_per_frame() > b->fp_per_frame());
+        });
+    }
+
+    // 選んだパラメーターをconfig.txtの形式で書き出す（そのまま貼り付けられる）
+    std::ofstream out(options.out_path);
+    std::time_t now = std::time(nullptr);
+    char date[32];
+    std::strftime(date, sizeof(date), "%Y-%m-%d %H:%M", std::localtime(&now));
+    out << "# detect_tunerで選んだ顔検出のパラメータ（" << date << "、動画" << clips.size() << "本）\n";
+    out << "# 再現率 " << chosen->recall() << " / 誤検出 " << chosen->fp_per_frame() << " 件/フレーム / CPU "
+        << chosen->cpu_ms_per_frame() << " ms/フレーム\n";
+    out << "DETECTION_INTERVAL=" << chosen->interval << "\n";
+    out << "DETECTION_DOWNSCALE=" << chosen->params.downscale << "\n";
+    out << "DETECTION_SCALE_FACTOR=" << chosen->params.scale_factor << "\n";
+    out << "DETECTION_MIN_NEIGHBORS=" << chosen->params.min_neighbors << "\n";
+    out << "DETECTION_MIN_SIZE=" << chosen->params.min_size << "\n";
+    std::printf("\n選んだパラメータを%sに書き出しました\n", options.out_path.c_str());
+
+    nlohmann::json report;
+    report["clips"] = nlohmann::json::array();
+    for (const auto& clip : clips) {
+        report["clips"].push_back(clip.video_path);
+    }
+    report["candidates"] = nlohmann::json::array();
+    for (const auto& c : candidates) {
+        report["candidates"].push_back(c.to_json());
+    }
+    report["pareto_front"] = nlohmann::json::array();
+    for (const Candidate* c : front) {
+        report["pareto_front"].push_back(c->to_json());
+    }
+    report["chosen"] = chosen->to_json();
+    std::ofstream(options.report_path) << report.dump(2) << "\n";
+    std::printf("すべての結果を%sに書き出しました\n", options.report_path.c_str());
+    return 0;
+}